@@ -0,0 +1,108 @@
+#include "unordered_map.h"
+#include "u_map_alloc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+//================================================================================
+//       Большая таблица: calloc против арены и mmap с huge pages
+//================================================================================
+
+static const size_t ELEMS   = 8000000;
+static const size_t LOOKUPS = 20000000;
+
+static size_t hash_u64(const void* key) {
+    uint64_t x = 0;
+    memcpy(&x, key, sizeof(x));
+    return (size_t)x;
+}
+
+static bool cmp_u64(const void* a, const void* b) {
+    return *(const uint64_t*)a == *(const uint64_t*)b;
+}
+
+static uint64_t xorshift64(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+static double now_sec() {
+    struct timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// reserve + вставка (первое касание страниц) и случайные попадания
+static void run(const char* name, const u_map_allocator_t* allocator) {
+    u_map_t map = {};
+    double start = now_sec();
+    if (u_map_init_with_allocator(&map, 0, sizeof(uint64_t), alignof(uint64_t), sizeof(uint64_t), alignof(uint64_t),
+                                  hash_u64, cmp_u64, nullptr, allocator) != HM_ERR_OK ||
+        u_map_reserve(&map, ELEMS) != HM_ERR_OK) {
+        printf("%-16s  no memory\n", name);
+        u_map_destroy(&map);
+        return;
+    }
+    const double reserve_sec = now_sec() - start;
+
+    uint64_t state = 0x2545F4914F6CDD1DULL;
+    start = now_sec();
+    for (size_t i = 0; i < ELEMS; ++i) {
+        const uint64_t key = xorshift64(&state);
+        u_map_insert_elem(&map, &key, &i);
+    }
+    const double insert_sec = now_sec() - start;
+
+    uint64_t sum = 0;
+    start = now_sec();
+    for (size_t i = 0; i < LOOKUPS; ++i) {
+        // Ключи повторяют последовательность вставки, чтобы все поиски попадали
+        if (i % ELEMS == 0) state = 0x2545F4914F6CDD1DULL;
+        const uint64_t key = xorshift64(&state);
+        uint64_t value = 0;
+        u_map_get_elem(&map, &key, &value);
+        sum += value;
+    }
+    const double lookup_sec = now_sec() - start;
+
+    printf("%-16s  reserve %7.3f s  insert %6.1f ns/op  lookup %6.1f ns/op  (%llu)\n", name,
+           reserve_sec, insert_sec * 1e9 / (double)ELEMS, lookup_sec * 1e9 / (double)LOOKUPS,
+           (unsigned long long)sum);
+    u_map_destroy(&map);
+}
+
+int main() {
+    printf("elems %zu, capacity after reserve %zu slots\n", ELEMS, (size_t)16 << 20);
+
+    const u_map_allocator_t heap = u_map_default_allocator();
+    run("calloc", &heap);
+
+    const u_map_allocator_t thp = u_map_mmap_allocator(0);
+    run("mmap thp", &thp);
+
+    const u_map_allocator_t thp_populate = u_map_mmap_allocator(U_MAP_MMAP_POPULATE);
+    run("mmap thp+pop", &thp_populate);
+
+    const u_map_allocator_t hugetlb = u_map_mmap_allocator(U_MAP_MMAP_HUGETLB | U_MAP_MMAP_POPULATE);
+    run("mmap hugetlb", &hugetlb);
+
+    // Арена на один буфер таблицы: после reserve таблица больше не растет
+    const size_t arena_bytes = u_map_required_bytes((size_t)16 << 20, sizeof(uint64_t), alignof(uint64_t),
+                                                    sizeof(uint64_t), alignof(uint64_t)) + (1 << 20);
+    void* buffer = malloc(arena_bytes);
+    if (buffer == nullptr) return 1;
+    u_map_arena_t arena = {};
+    u_map_arena_init(&arena, buffer, arena_bytes);
+    const u_map_allocator_t arena_allocator = u_map_arena_allocator(&arena);
+    run("arena (malloc)", &arena_allocator);
+    free(buffer);
+
+    return 0;
+}
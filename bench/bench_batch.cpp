@@ -0,0 +1,107 @@
+#include "unordered_map.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+//================================================================================
+//      Поиск в таблице больше LLC: цикл u_map_get_elem против u_map_get_batch
+//================================================================================
+
+static const size_t KEYS    = 16u << 20;
+static const size_t LOOKUPS = 20000000;
+static const size_t BATCH   = 256;
+static const int    REPEATS = 3;
+
+static size_t hash_u64(const void* key) {
+    uint64_t x = 0;
+    memcpy(&x, key, sizeof(x));
+    return (size_t)x;
+}
+
+static bool cmp_u64(const void* a, const void* b) {
+    return *(const uint64_t*)a == *(const uint64_t*)b;
+}
+
+static uint64_t xorshift64(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+static double now_sec() {
+    struct timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void run(u_map_probe_t probe, const uint64_t* queries) {
+    u_map_opts_t opts = {};
+    opts.probe = probe;
+
+    u_map_t map = {};
+    u_map_init_ex(&map, 0, sizeof(uint64_t), alignof(uint64_t), sizeof(uint64_t), alignof(uint64_t),
+                  hash_u64, cmp_u64, &opts);
+    u_map_reserve(&map, KEYS);
+    for (uint64_t key = 0; key < KEYS; ++key) {
+        u_map_insert_elem(&map, &key, &key);
+    }
+
+    // Замеры чередуются и повторяются, берется лучший: фоновый шум влияет на оба варианта одинаково
+    double   loop_sec  = 1e9, batch_sec = 1e9;
+    uint64_t sum       = 0,   batch_sum = 0;
+    for (int rep = 0; rep < REPEATS; ++rep) {
+        sum = 0;
+        double start = now_sec();
+        for (size_t i = 0; i < LOOKUPS; ++i) {
+            uint64_t value = 0;
+            if (u_map_get_elem(&map, &queries[i], &value)) sum += value;
+        }
+        const double loop = now_sec() - start;
+        if (loop < loop_sec) loop_sec = loop;
+
+        uint64_t values[BATCH] = {};
+        bool     found[BATCH]  = {};
+        batch_sum = 0;
+        start = now_sec();
+        for (size_t i = 0; i < LOOKUPS; i += BATCH) {
+            const size_t count = LOOKUPS - i < BATCH ? LOOKUPS - i : BATCH;
+            u_map_get_batch(&map, &queries[i], count, values, found);
+            for (size_t j = 0; j < count; ++j) {
+                batch_sum += (uint64_t)found[j] * values[j];
+            }
+        }
+        const double batch = now_sec() - start;
+        if (batch < batch_sec) batch_sec = batch;
+    }
+
+    printf("%-10s  loop %6.1f ns/op   batch %6.1f ns/op   x%.2f   %s\n",
+           probe == U_MAP_PROBE_ROBIN_HOOD ? "robin_hood" : "swiss",
+           loop_sec * 1e9 / LOOKUPS, batch_sec * 1e9 / LOOKUPS, loop_sec / batch_sec,
+           sum == batch_sum ? "ok" : "MISMATCH");
+
+    u_map_destroy(&map);
+}
+
+int main() {
+    uint64_t* queries = (uint64_t*)calloc(LOOKUPS, sizeof(uint64_t));
+    if (!queries) return 1;
+
+    // Половина запросов — промахи
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    for (size_t i = 0; i < LOOKUPS; ++i) {
+        queries[i] = xorshift64(&state) % (KEYS * 2);
+    }
+
+    printf("keys %zu, lookups %zu, batch %zu\n", KEYS, LOOKUPS, BATCH);
+    run(U_MAP_PROBE_SWISS,      queries);
+    run(U_MAP_PROBE_ROBIN_HOOD, queries);
+
+    free(queries);
+    return 0;
+}
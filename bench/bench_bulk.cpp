@@ -0,0 +1,79 @@
+#include "unordered_map.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+//================================================================================
+//          Загрузка массива пар: поштучная вставка против u_map_bulk_build
+//================================================================================
+
+static const size_t PAIRS = 10000000;
+
+typedef struct pair_t {
+    uint64_t key;
+    uint64_t value;
+} pair_t;
+
+static size_t hash_u64(const void* key) {
+    uint64_t x = 0;
+    memcpy(&x, key, sizeof(x));
+    return (size_t)x;
+}
+
+static bool cmp_u64(const void* a, const void* b) {
+    return *(const uint64_t*)a == *(const uint64_t*)b;
+}
+
+static uint64_t xorshift64(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+static double now_sec() {
+    struct timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+int main() {
+    pair_t* pairs = (pair_t*)calloc(PAIRS, sizeof(pair_t));
+    if (!pairs) return 1;
+
+    // Примерно 5% ключей повторяются
+    uint64_t state = 0x2545F4914F6CDD1DULL;
+    for (size_t i = 0; i < PAIRS; ++i) {
+        pairs[i].key   = xorshift64(&state) % (PAIRS * 10);
+        pairs[i].value = i;
+    }
+
+    u_map_t map = {};
+    SIMPLE_U_MAP_INIT(&map, 0, uint64_t, uint64_t, hash_u64, cmp_u64);
+    double start = now_sec();
+    for (size_t i = 0; i < PAIRS; ++i) {
+        u_map_insert_elem(&map, &pairs[i].key, &pairs[i].value);
+    }
+    const double loop_sec = now_sec() - start;
+    const size_t loop_size = u_map_size(&map);
+    u_map_destroy(&map);
+
+    SIMPLE_U_MAP_INIT(&map, 0, uint64_t, uint64_t, hash_u64, cmp_u64);
+    size_t duplicates = 0;
+    start = now_sec();
+    u_map_bulk_build(&map, pairs, PAIRS, &duplicates);
+    const double bulk_sec = now_sec() - start;
+
+    printf("pairs %zu, unique %zu, duplicates %zu\n", PAIRS, u_map_size(&map), duplicates);
+    printf("insert loop  %7.3f s  (size %zu)\n", loop_sec, loop_size);
+    printf("bulk build   %7.3f s\n", bulk_sec);
+
+    u_map_destroy(&map);
+    free(pairs);
+    return 0;
+}
@@ -0,0 +1,125 @@
+#include "unordered_map.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+//================================================================================
+//   Строковые ключи: дополненные нулями до 64 байт против u_map_init_bytes
+//================================================================================
+
+static const size_t ELEMS      = 2000000;
+static const size_t LOOKUPS    = 8000000;
+static const size_t PADDED_LEN = 64;
+static const size_t LONG_EVERY = 8;        // каждый LONG_EVERY-й ключ длиннее 15 байт
+
+typedef struct padded_key_t {
+    unsigned char bytes[PADDED_LEN];
+} padded_key_t;
+
+static size_t hash_padded(const void* key) {
+    const unsigned char* ptr = (const unsigned char*)key;
+    uint64_t hash = 0;
+    for (size_t i = 0; i < PADDED_LEN; i += sizeof(uint64_t)) {
+        uint64_t word = 0;
+        memcpy(&word, ptr + i, sizeof(word));
+        hash = (hash ^ word) * 0x9e3779b97f4a7c15ULL;
+        hash ^= hash >> 32;
+    }
+    return (size_t)hash;
+}
+
+static bool cmp_padded(const void* a, const void* b) {
+    return memcmp(a, b, PADDED_LEN) == 0;
+}
+
+static double now_sec() {
+    struct timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Ключ номер i: "user:<i>" (до 15 байт), каждый LONG_EVERY-й — длинный путь до 60 байт
+static size_t make_key(size_t i, char* out) {
+    if (i % LONG_EVERY != 0) return (size_t)snprintf(out, PADDED_LEN, "user:%zu", i);
+    return (size_t)snprintf(out, PADDED_LEN, "/var/lib/service/sessions/%zu/state.json", i);
+}
+
+static size_t next_index(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return (size_t)(x % ELEMS);
+}
+
+static void report(const char* name, const u_map_t* map, double insert_sec, double lookup_sec, size_t hits) {
+    u_map_stats_t stats = {};
+    u_map_stats(map, &stats);
+    printf("%-8s  insert %6.1f ns/op  lookup %6.1f ns/op  memory %7.1f MB  (%zu hits)\n", name,
+           insert_sec * 1e9 / (double)ELEMS, lookup_sec * 1e9 / (double)LOOKUPS,
+           (double)stats.bytes_in_use / (1 << 20), hits);
+}
+
+static void run_padded() {
+    u_map_t map = {};
+    if (u_map_init(&map, 0, sizeof(padded_key_t), 1, sizeof(size_t), alignof(size_t),
+                   hash_padded, cmp_padded) != HM_ERR_OK) return;
+
+    padded_key_t key = {};
+    double start = now_sec();
+    for (size_t i = 0; i < ELEMS; ++i) {
+        memset(&key, 0, sizeof(key));
+        make_key(i, (char*)key.bytes);
+        u_map_insert_elem(&map, &key, &i);
+    }
+    const double insert_sec = now_sec() - start;
+
+    uint64_t state = 0x2545F4914F6CDD1DULL;
+    size_t hits = 0;
+    start = now_sec();
+    for (size_t n = 0; n < LOOKUPS; ++n) {
+        memset(&key, 0, sizeof(key));
+        make_key(next_index(&state), (char*)key.bytes);
+        hits += u_map_get_elem(&map, &key, nullptr);
+    }
+    const double lookup_sec = now_sec() - start;
+
+    report("padded", &map, insert_sec, lookup_sec, hits);
+    u_map_destroy(&map);
+}
+
+static void run_bytes() {
+    u_map_t map = {};
+    if (u_map_init_bytes(&map, 0, sizeof(size_t), alignof(size_t), nullptr) != HM_ERR_OK) return;
+
+    char key[PADDED_LEN] = {};
+    double start = now_sec();
+    for (size_t i = 0; i < ELEMS; ++i) {
+        const size_t len = make_key(i, key);
+        u_map_insert_bytes(&map, key, len, &i);
+    }
+    const double insert_sec = now_sec() - start;
+
+    uint64_t state = 0x2545F4914F6CDD1DULL;
+    size_t hits = 0;
+    start = now_sec();
+    for (size_t n = 0; n < LOOKUPS; ++n) {
+        const size_t len = make_key(next_index(&state), key);
+        hits += u_map_get_bytes(&map, key, len, nullptr);
+    }
+    const double lookup_sec = now_sec() - start;
+
+    report("bytes", &map, insert_sec, lookup_sec, hits);
+    u_map_destroy(&map);
+}
+
+int main() {
+    printf("elems %zu, every %zu-th key is long, padded keys take %zu bytes\n", ELEMS, LONG_EVERY, PADDED_LEN);
+    run_padded();
+    run_bytes();
+    return 0;
+}
@@ -0,0 +1,115 @@
+#include "unordered_map.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+//================================================================================
+//          Замер удаления/вставки при постоянном размере таблицы (churn)
+//================================================================================
+
+static const size_t LIVE_KEYS = 1u << 18;
+static const size_t OPS       = 1u << 23;
+
+static size_t hash_u64(const void* key) {
+    uint64_t x = 0;
+    memcpy(&x, key, sizeof(x));
+    return (size_t)x;
+}
+
+static bool cmp_u64(const void* a, const void* b) {
+    return *(const uint64_t*)a == *(const uint64_t*)b;
+}
+
+static uint64_t xorshift64(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+static double now_sec() {
+    struct timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Каждая операция удаляет случайный живой ключ и вставляет новый на его место.
+// Статическая таблица не растет и живет только за счет чистки надгробий на месте
+static void bench_churn(u_map_probe_t probe, bool is_static) {
+    u_map_opts_t opts = {};
+    opts.probe = probe;
+
+    void* buffer = nullptr;
+    u_map_t map = {};
+    hm_error_t err = HM_ERR_OK;
+    if (is_static) {
+        const size_t bytes = u_map_required_bytes_ex(LIVE_KEYS * 2, sizeof(uint64_t), alignof(uint64_t),
+                                                     sizeof(uint64_t), alignof(uint64_t), &opts);
+        buffer = aligned_alloc(64, (bytes + 63) / 64 * 64);
+        if (!buffer) return;
+        err = u_map_static_init_ex(&map, buffer, LIVE_KEYS * 2,
+                                   sizeof(uint64_t), alignof(uint64_t),
+                                   sizeof(uint64_t), alignof(uint64_t),
+                                   hash_u64, cmp_u64, &opts);
+    } else {
+        err = u_map_init_ex(&map, LIVE_KEYS * 2,
+                            sizeof(uint64_t), alignof(uint64_t),
+                            sizeof(uint64_t), alignof(uint64_t),
+                            hash_u64, cmp_u64, &opts);
+    }
+    if (err != HM_ERR_OK) {
+        free(buffer);
+        return;
+    }
+
+    uint64_t* keys = (uint64_t*)calloc(LIVE_KEYS, sizeof(uint64_t));
+    if (!keys) {
+        u_map_destroy(&map);
+        free(buffer);
+        return;
+    }
+
+    uint64_t state = 0x2545F4914F6CDD1DULL;
+    for (size_t i = 0; i < LIVE_KEYS; ++i) {
+        keys[i] = xorshift64(&state);
+        u_map_insert_elem(&map, &keys[i], &i);
+    }
+
+    size_t failed = 0;
+    double worst_ns = 0;
+    const double start = now_sec();
+    for (size_t i = 0; i < OPS; ++i) {
+        const size_t slot = (size_t)(xorshift64(&state) % LIVE_KEYS);
+        const double op_start = now_sec();
+
+        u_map_remove_elem(&map, &keys[slot], nullptr);
+        keys[slot] = xorshift64(&state);
+        if (u_map_insert_elem(&map, &keys[slot], &i) != HM_ERR_OK) failed++;
+
+        const double op_ns = (now_sec() - op_start) * 1e9;
+        if (op_ns > worst_ns) worst_ns = op_ns;
+    }
+    const double avg_ns = (now_sec() - start) * 1e9 / (double)OPS;
+
+    printf("%-6s %-7s  %8.1f  %12.0f  %10zu  %8zu\n",
+           probe == U_MAP_PROBE_ROBIN_HOOD ? "robin" : "swiss", is_static ? "static" : "dynamic",
+           avg_ns, worst_ns, u_map_capacity(&map), failed);
+
+    u_map_destroy(&map);
+    free(keys);
+    free(buffer);
+}
+
+int main() {
+    printf("probe  table      avg ns   worst op ns    capacity    failed\n");
+    bench_churn(U_MAP_PROBE_SWISS,      false);
+    bench_churn(U_MAP_PROBE_ROBIN_HOOD, false);
+    bench_churn(U_MAP_PROBE_SWISS,      true);
+    bench_churn(U_MAP_PROBE_ROBIN_HOOD, true);
+    return 0;
+}
@@ -0,0 +1,109 @@
+#include "unordered_map.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+//================================================================================
+//        Снимок для читателя: u_map_raw_copy против u_map_snapshot (cow)
+//================================================================================
+
+static const size_t PAIRS   = 4000000;
+static const size_t UPDATES[] = {1000, 20000, 200000};
+static const int    REPEATS = 5;
+
+static size_t hash_u64(const void* key) {
+    uint64_t x = 0;
+    memcpy(&x, key, sizeof(x));
+    return (size_t)x;
+}
+
+static bool cmp_u64(const void* a, const void* b) {
+    return *(const uint64_t*)a == *(const uint64_t*)b;
+}
+
+static uint64_t xorshift64(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+static double now_sec() {
+    struct timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Память процесса; страница memfd, отображенная и таблицей, и снимком, считается один раз
+static size_t pss_kb() {
+    FILE* file = fopen("/proc/self/smaps_rollup", "r");
+    if (file == nullptr) return 0;
+    char   line[256] = {};
+    size_t kb        = 0;
+    while (fgets(line, sizeof(line), file) != nullptr)
+        if (sscanf(line, "Pss: %zu kB", &kb) == 1) break;
+    fclose(file);
+    return kb;
+}
+
+// Обновления существующих ключей: ёмкость не меняется, снимок отдает страницы по одной
+static double update_sec(u_map_t* map, size_t count) {
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    const double start = now_sec();
+    for (size_t i = 0; i < count; ++i) {
+        const uint64_t key = xorshift64(&state) % PAIRS;
+        u_map_insert_elem(map, &key, &i);
+    }
+    return now_sec() - start;
+}
+
+static void run(bool cow) {
+    u_map_opts_t opts = {};
+    opts.cow_snapshots = cow;
+
+    u_map_t map = {};
+    if (u_map_init_ex(&map, 0, sizeof(uint64_t), alignof(uint64_t), sizeof(uint64_t), alignof(uint64_t),
+                      hash_u64, cmp_u64, &opts) != HM_ERR_OK) exit(1);
+    for (uint64_t key = 0; key < PAIRS; ++key) u_map_insert_elem(&map, &key, &key);
+
+    printf("%s (capacity %zu):\n", cow ? "cow_snapshots" : "raw_copy", map.capacity);
+
+    double best = 1e9;
+    for (int r = 0; r < REPEATS; ++r) {
+        u_map_t snap = {};
+        const double start = now_sec();
+        if (u_map_snapshot(&map, &snap) != HM_ERR_OK) exit(1);
+        const double sec = now_sec() - start;
+        if (sec < best) best = sec;
+        u_map_destroy(&snap);
+    }
+    printf("  snapshot  %8.3f ms\n", best * 1e3);
+
+    // Случайные обновления: каждое задевает свою страницу, пока снимку не скопирована вся таблица
+    for (size_t count : UPDATES) {
+        const double plain = update_sec(&map, count);
+
+        u_map_t snap = {};
+        const size_t before = pss_kb();
+        if (u_map_snapshot(&map, &snap) != HM_ERR_OK) exit(1);
+        const double with_snap = update_sec(&map, count);
+        const size_t after = pss_kb();
+
+        printf("  %6zu updates  %8.3f ms alone, %8.3f ms with snapshot, snapshot memory %7zu KiB\n",
+               count, plain * 1e3, with_snap * 1e3, after - before);
+        u_map_destroy(&snap);
+    }
+
+    u_map_destroy(&map);
+}
+
+int main() {
+    run(false);
+    run(true);
+    return 0;
+}
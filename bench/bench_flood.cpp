@@ -0,0 +1,138 @@
+#include "unordered_map.h"
+#include "u_map_hash.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+//================================================================================
+//   Подбор коллизий: ключи, собранные под несоленую таблицу, и цена соли
+//================================================================================
+
+static const size_t ATTACK_KEYS = 40000;
+static const size_t PLAIN_KEYS  = 1u << 20;
+static const size_t LOOKUPS     = 1u << 22;
+static const int    ROUNDS      = 3;
+
+static size_t hash_identity(const void* key) {
+    uint64_t x = 0;
+    memcpy(&x, key, sizeof(x));
+    return (size_t)x;
+}
+
+static bool cmp_u64(const void* a, const void* b) {
+    return *(const uint64_t*)a == *(const uint64_t*)b;
+}
+
+static double now_sec() {
+    struct timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static uint64_t xorshift64(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+//--------------------------------------------------------------------------------
+// Атакующий знает hash_func (тождество) и несоленый splitmix64, который обратим:
+// ключ под любой нужный хэш считается напрямую
+//--------------------------------------------------------------------------------
+
+static uint64_t mul_inverse(uint64_t a) {
+    uint64_t x = a;
+    for (int i = 0; i < 6; ++i) x *= 2 - a * x;  // Ньютон: каждый шаг удваивает верные биты
+    return x;
+}
+
+static uint64_t unxorshift(uint64_t y, int shift) {
+    uint64_t x = y;
+    for (int i = 0; i < 64 / shift + 1; ++i) x = y ^ (x >> shift);
+    return x;
+}
+
+static uint64_t unmix(uint64_t hash) {
+    uint64_t x = unxorshift(hash, 31);
+    x = unxorshift(x * mul_inverse(0x94d049bb133111ebULL), 27);
+    x = unxorshift(x * mul_inverse(0xbf58476d1ce4e5b9ULL), 30);
+    return x - 0x9e3779b97f4a7c15ULL;
+}
+
+// Все хэши с одними и теми же младшими 40 битами: одна домашняя группа и один отпечаток
+static uint64_t attack_key(size_t i) {
+    return unmix(((uint64_t)i << 40) | 0x55);
+}
+
+static void run_attack(const char* name, const u_map_opts_t* opts) {
+    u_map_t map = {};
+    if (u_map_init_ex(&map, 0, sizeof(uint64_t), alignof(uint64_t), sizeof(uint64_t), alignof(uint64_t),
+                      hash_identity, cmp_u64, opts) != HM_ERR_OK) return;
+
+    const double start = now_sec();
+    for (size_t i = 0; i < ATTACK_KEYS; ++i) {
+        const uint64_t key = attack_key(i);
+        u_map_insert_elem(&map, &key, &i);
+    }
+    const double sec = now_sec() - start;
+
+    u_map_stats_t stats = {};
+    u_map_stats(&map, &stats);
+    printf("attack  %-12s  %8.1f ns/insert  flood events %6zu  reseeds %zu\n", name,
+           sec * 1e9 / (double)ATTACK_KEYS, stats.flood_events, stats.reseeds);
+    u_map_destroy(&map);
+}
+
+// Обычные ключи: во что обходится соль на поиске (u_map_hash_u64 без соли не перемешивается)
+static void run_plain(const char* name, key_func_t hash_func, const u_map_opts_t* opts) {
+    u_map_t map = {};
+    if (u_map_init_ex(&map, 0, sizeof(uint64_t), alignof(uint64_t), sizeof(uint64_t), alignof(uint64_t),
+                      hash_func, cmp_u64, opts) != HM_ERR_OK) return;
+    for (uint64_t i = 0; i < PLAIN_KEYS; ++i) u_map_insert_elem(&map, &i, &i);
+
+    double best = 1e9;
+    uint64_t sum = 0;
+    for (int r = 0; r < ROUNDS; ++r) {
+        uint64_t state = 0x2545F4914F6CDD1DULL;
+        const double start = now_sec();
+        for (size_t i = 0; i < LOOKUPS; ++i) {
+            const uint64_t key = xorshift64(&state) & (PLAIN_KEYS - 1);
+            uint64_t value = 0;
+            u_map_get_elem(&map, &key, &value);
+            sum += value;
+        }
+        const double sec = now_sec() - start;
+        if (sec < best) best = sec;
+    }
+    printf("plain   %-26s  lookup %5.1f ns  (%llu)\n", name, best * 1e9 / (double)LOOKUPS,
+           (unsigned long long)(sum & 0xFF));
+    u_map_destroy(&map);
+}
+
+int main() {
+    printf("%zu crafted keys against identity hash_func\n", ATTACK_KEYS);
+
+    u_map_opts_t opts = {};
+    opts.no_reseed = true;
+    run_attack("no_reseed", &opts);
+
+    opts = {};
+    run_attack("default", &opts);
+
+    opts.random_seed = true;
+    run_attack("random_seed", &opts);
+
+    opts = {};
+    run_plain("identity",                hash_identity,  &opts);
+    run_plain("u_map_hash_u64",          u_map_hash_u64, &opts);
+    opts.random_seed = true;
+    run_plain("identity + seed",         hash_identity,  &opts);
+    run_plain("u_map_hash_u64 + seed",   u_map_hash_u64, &opts);
+    return 0;
+}
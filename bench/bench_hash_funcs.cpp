@@ -0,0 +1,309 @@
+#include "unordered_map.h"
+#include "u_map_hash.h"
+#include "u_map_group.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+
+//================================================================================
+//   Встроенные хэши: лавинный эффект, коллизии, скорость и поиск в таблице
+//================================================================================
+
+static const size_t AVALANCHE_SAMPLES = 2000;
+static const size_t BUCKET_BITS       = 20;
+static const size_t HASH_CALLS        = 20000000;
+static const size_t LOOKUPS           = 1u << 22;
+static const int    ROUNDS            = 5;
+
+typedef size_t (*bytes_hash_t)(const void* data, size_t len, uint64_t seed);
+
+static size_t hash_identity(const void* key) {
+    uint64_t x = 0;
+    memcpy(&x, key, sizeof(x));
+    return (size_t)x;
+}
+
+static bool cmp_u64(const void* a, const void* b) {
+    return *(const uint64_t*)a == *(const uint64_t*)b;
+}
+
+// Тождество + splitmix64 — то, что таблица делает со слабым hash_func
+static size_t hash_identity_mixed(const void* data, size_t len, uint64_t seed) {
+    (void)len;
+    (void)seed;
+    return u_map_mix_hash(hash_identity(data));
+}
+
+static size_t hash_u64_bytes(const void* data, size_t len, uint64_t seed) {
+    (void)len;
+    (void)seed;
+    return u_map_hash_u64(data);
+}
+
+static size_t hash_fnv1a(const void* data, size_t len, uint64_t seed) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    uint64_t h = 0xcbf29ce484222325ULL ^ seed;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= bytes[i];
+        h *= 0x100000001b3ULL;
+    }
+    return (size_t)h;
+}
+
+static uint64_t xorshift64(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+static double now_sec() {
+    struct timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+//--------------------------------------------------------------------------------
+// Качество
+//--------------------------------------------------------------------------------
+
+// Худшее отклонение вероятности переворота выходного бита от 1/2 при перевороте входного
+static double avalanche_bias(bytes_hash_t hash, size_t len) {
+    const size_t in_bits = len * 8;
+    size_t* flips = (size_t*)calloc(in_bits * 64, sizeof(size_t));
+    unsigned char* key = (unsigned char*)malloc(len);
+    if (flips == nullptr || key == nullptr) {
+        free(flips);
+        free(key);
+        return -1.0;
+    }
+
+    uint64_t state = 0x2545F4914F6CDD1DULL;
+    for (size_t s = 0; s < AVALANCHE_SAMPLES; ++s) {
+        for (size_t i = 0; i < len; ++i) key[i] = (unsigned char)xorshift64(&state);
+        const uint64_t base = hash(key, len, 0);
+
+        for (size_t bit = 0; bit < in_bits; ++bit) {
+            key[bit / 8] ^= (unsigned char)(1u << (bit % 8));
+            const uint64_t diff = base ^ (uint64_t)hash(key, len, 0);
+            key[bit / 8] ^= (unsigned char)(1u << (bit % 8));
+            for (size_t out = 0; out < 64; ++out) flips[bit * 64 + out] += (diff >> out) & 1;
+        }
+    }
+
+    double worst = 0.0;
+    for (size_t i = 0; i < in_bits * 64; ++i) {
+        const double bias = fabs((double)flips[i] / (double)AVALANCHE_SAMPLES - 0.5);
+        if (bias > worst) worst = bias;
+    }
+    free(flips);
+    free(key);
+    return worst;
+}
+
+// Ключи раскладываются по 2^BUCKET_BITS корзинам теми же битами, что выбирают группу (h1);
+// chi^2 / число корзин: около 1 — как у случайной функции
+typedef void (*make_key_t)(size_t i, unsigned char* out, size_t* len_out);
+
+static void key_sequential(size_t i, unsigned char* out, size_t* len_out) {
+    const uint64_t x = i;
+    memcpy(out, &x, sizeof(x));
+    *len_out = sizeof(x);
+}
+
+static void key_strided(size_t i, unsigned char* out, size_t* len_out) {
+    const uint64_t x = (uint64_t)i << 32;
+    memcpy(out, &x, sizeof(x));
+    *len_out = sizeof(x);
+}
+
+static void key_text(size_t i, unsigned char* out, size_t* len_out) {
+    *len_out = (size_t)snprintf((char*)out, 64, "user:%zu", i);
+}
+
+// Полные 64-битные коллизии: сортировкой
+static size_t count_collisions(uint64_t* seen, size_t count) {
+    qsort(seen, count, sizeof(uint64_t), [](const void* a, const void* b) {
+        const uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+        return (x > y) - (x < y);
+    });
+    size_t collisions = 0;
+    for (size_t i = 1; i < count; ++i) collisions += seen[i] == seen[i - 1];
+    return collisions;
+}
+
+static double bucket_chi2(bytes_hash_t hash, make_key_t make_key, size_t count, size_t* collisions_out) {
+    const size_t buckets = (size_t)1 << BUCKET_BITS;
+    uint32_t* load = (uint32_t*)calloc(buckets, sizeof(uint32_t));
+    uint64_t* seen = (uint64_t*)calloc(count, sizeof(uint64_t));
+    if (load == nullptr || seen == nullptr) {
+        free(load);
+        free(seen);
+        return -1.0;
+    }
+
+    unsigned char key[64] = {};
+    for (size_t i = 0; i < count; ++i) {
+        size_t len = 0;
+        make_key(i, key, &len);
+        const uint64_t h = hash(key, len, 0);
+        seen[i] = h;
+        load[u_map_hash_h1((size_t)h) & (buckets - 1)]++;
+    }
+
+    const double expected = (double)count / (double)buckets;
+    double chi2 = 0.0;
+    for (size_t b = 0; b < buckets; ++b) chi2 += ((double)load[b] - expected) * ((double)load[b] - expected) / expected;
+
+    *collisions_out = count_collisions(seen, count);
+
+    free(load);
+    free(seen);
+    return chi2 / (double)buckets;
+}
+
+static void quality(const char* name, bytes_hash_t hash, size_t len, make_key_t make_key, const char* keys) {
+    size_t collisions = 0;
+    const double chi2 = bucket_chi2(hash, make_key, (size_t)1 << BUCKET_BITS, &collisions);
+    printf("%-22s  len %4zu  avalanche bias %.3f  %-10s keys: chi2/buckets %6.2f  collisions %zu\n",
+           name, len, avalanche_bias(hash, len), keys, chi2, collisions);
+}
+
+// Подобранные ключи: слово, которое хэш умножает после XOR с константой wyhash (HASH_P1 в
+// u_map_hash.cpp), равно ей самой, остальные байты случайны. Если множитель обнуляется вместе
+// со вторым, все такие ключи получают один хэш при любой соли
+static const uint64_t WY_P1 = 0xe7037ed1a0b428dbULL;
+
+static void key_fill_random(size_t i, unsigned char* out, size_t len) {
+    uint64_t state = (uint64_t)i * 0x9E3779B97F4A7C15ULL + 1;
+    for (size_t j = 0; j < len; ++j) out[j] = (unsigned char)xorshift64(&state);
+}
+
+// 16 байт: множитель собирается из байтов 0-3 (старшая половина) и 8-11 (младшая)
+static void key_cancel_16(size_t i, unsigned char* out, size_t* len_out) {
+    key_fill_random(i, out, 16);
+    const uint32_t hi = (uint32_t)(WY_P1 >> 32), lo = (uint32_t)WY_P1;
+    memcpy(out, &hi, sizeof(hi));
+    memcpy(out + 8, &lo, sizeof(lo));
+    *len_out = 16;
+}
+
+// 33 байта: первый 16-байтный блок начинается с константы, его байты 8-15 случайны, хвост нулевой
+static void key_cancel_33(size_t i, unsigned char* out, size_t* len_out) {
+    memset(out, 0, 33);
+    memcpy(out, &WY_P1, sizeof(WY_P1));
+    key_fill_random(i, out + 8, 8);
+    *len_out = 33;
+}
+
+static void adversarial(const char* name, bytes_hash_t hash, make_key_t make_key, const char* keys) {
+    const size_t count = (size_t)1 << BUCKET_BITS;
+    uint64_t* seen = (uint64_t*)calloc(count, sizeof(uint64_t));
+    if (seen == nullptr) return;
+
+    const uint64_t seeds[] = {0, 0x2545F4914F6CDD1DULL, 0x9E3779B97F4A7C15ULL};
+    printf("%-22s  %-10s keys:", name, keys);
+    for (size_t s = 0; s < sizeof(seeds) / sizeof(seeds[0]); ++s) {
+        unsigned char key[64] = {};
+        for (size_t i = 0; i < count; ++i) {
+            size_t len = 0;
+            make_key(i, key, &len);
+            seen[i] = hash(key, len, seeds[s]);
+        }
+        printf("  seed %llx collisions %zu", (unsigned long long)seeds[s], count_collisions(seen, count));
+    }
+    printf("\n");
+    free(seen);
+}
+
+//--------------------------------------------------------------------------------
+// Скорость
+//--------------------------------------------------------------------------------
+
+static void throughput(const char* name, bytes_hash_t hash, size_t len) {
+    unsigned char* data = (unsigned char*)malloc(len + 64);
+    if (data == nullptr) return;
+    for (size_t i = 0; i < len + 64; ++i) data[i] = (unsigned char)(i * 131);
+
+    const size_t calls = len >= 256 ? HASH_CALLS / (len / 64) : HASH_CALLS;
+    uint64_t acc = 0;
+    const double start = now_sec();
+    for (size_t i = 0; i < calls; ++i) acc += hash(data + (i & 63), len, acc);
+    const double sec = now_sec() - start;
+
+    printf("%-22s  len %5zu  %6.2f ns/hash  %6.2f GB/s  (%llx)\n", name, len, sec * 1e9 / (double)calls,
+           (double)len * (double)calls / sec / 1e9, (unsigned long long)(acc & 0xF));
+    free(data);
+}
+
+// Маленькая таблица живет в кэше, и хэш — заметная часть поиска; большая упирается в память
+static void table_lookups(const char* name, key_func_t hash_func, size_t keys) {
+    u_map_t map = {};
+    if (u_map_init(&map, 0, sizeof(uint64_t), alignof(uint64_t), sizeof(uint64_t), alignof(uint64_t),
+                   hash_func, cmp_u64) != HM_ERR_OK) return;
+    for (uint64_t i = 0; i < keys; ++i) u_map_insert_elem(&map, &i, &i);
+
+    // Лучший из ROUNDS прогонов: на общей машине разброс одного прогона больше разницы хэшей
+    double best = 1e9;
+    uint64_t sum = 0;
+    for (int r = 0; r < ROUNDS; ++r) {
+        uint64_t state = 0x2545F4914F6CDD1DULL;
+        const double start = now_sec();
+        for (size_t i = 0; i < LOOKUPS; ++i) {
+            const uint64_t key = xorshift64(&state) & (keys - 1);
+            uint64_t value = 0;
+            u_map_get_elem(&map, &key, &value);
+            sum += value;
+        }
+        const double sec = now_sec() - start;
+        if (sec < best) best = sec;
+    }
+
+    printf("%-22s  %8zu sequential keys  lookup %5.1f ns  (%llu)\n", name, keys,
+           best * 1e9 / (double)LOOKUPS, (unsigned long long)(sum & 0xFF));
+    u_map_destroy(&map);
+}
+
+int main() {
+    printf("-- quality: worst avalanche bias (0 ideal), chi2/buckets over %zu buckets (1 ideal)\n",
+           (size_t)1 << BUCKET_BITS);
+    quality("identity+splitmix64", hash_identity_mixed,        8,   key_sequential, "sequential");
+    quality("u_map_hash_u64",      hash_u64_bytes,             8,   key_sequential, "sequential");
+    quality("u_map_hash_u64",      hash_u64_bytes,             8,   key_strided,    "strided");
+    quality("fnv1a",               hash_fnv1a,                 16,  key_text,       "text");
+    quality("bytes_portable",      u_map_hash_bytes_portable,  3,   key_text,       "text");
+    quality("bytes_portable",      u_map_hash_bytes_portable,  16,  key_text,       "text");
+    quality("bytes_portable",      u_map_hash_bytes_portable,  40,  key_text,       "text");
+    quality("bytes_portable",      u_map_hash_bytes_portable,  100, key_text,       "text");
+    quality("bytes (aes if any)",  u_map_hash_bytes,           128, key_text,       "text");
+    quality("bytes (aes if any)",  u_map_hash_bytes,           300, key_text,       "text");
+
+    printf("-- adversarial: %zu keys with a word equal to the multiplier constant (0 collisions ideal)\n",
+           (size_t)1 << BUCKET_BITS);
+    adversarial("bytes_portable", u_map_hash_bytes_portable, key_cancel_16, "cancel-16");
+    adversarial("bytes_portable", u_map_hash_bytes_portable, key_cancel_33, "cancel-33");
+
+    printf("-- throughput\n");
+    throughput("identity+splitmix64", hash_identity_mixed, 8);
+    throughput("u_map_hash_u64",      hash_u64_bytes,      8);
+    const size_t lens[] = {8, 16, 32, 64, 128, 256, 4096};
+    for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); ++i) {
+        throughput("fnv1a",              hash_fnv1a,                lens[i]);
+        throughput("bytes_portable",     u_map_hash_bytes_portable, lens[i]);
+        throughput("bytes (aes if any)", u_map_hash_bytes,          lens[i]);
+    }
+
+    printf("-- table\n");
+    const size_t sizes[] = {(size_t)1 << 12, (size_t)1 << 22};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        table_lookups("identity (mixed)", hash_identity,  sizes[i]);
+        table_lookups("u_map_hash_u64",   u_map_hash_u64, sizes[i]);
+    }
+    return 0;
+}
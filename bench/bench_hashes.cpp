@@ -0,0 +1,139 @@
+#include "unordered_map.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+//================================================================================
+//          Цена и выигрыш store_hashes для маленьких и больших ключей
+//================================================================================
+
+static const size_t KEYS    = 1u << 20;
+static const size_t LOOKUPS = 1u << 22;
+
+typedef struct big_key_t {
+    uint64_t parts[8];
+} big_key_t;
+
+static size_t hash_u64(const void* key) {
+    uint64_t x = 0;
+    memcpy(&x, key, sizeof(x));
+    return (size_t)x;
+}
+
+static bool cmp_u64(const void* a, const void* b) {
+    return *(const uint64_t*)a == *(const uint64_t*)b;
+}
+
+// Побайтовый FNV-1a по всем 64 байтам — заведомо дорогой хэш составного ключа
+static size_t hash_big(const void* key) {
+    const unsigned char* bytes = (const unsigned char*)key;
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < sizeof(big_key_t); ++i) {
+        h ^= bytes[i];
+        h *= 0x100000001b3ULL;
+    }
+    return (size_t)h;
+}
+
+static bool cmp_big(const void* a, const void* b) {
+    return memcmp(a, b, sizeof(big_key_t)) == 0;
+}
+
+static uint64_t xorshift64(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+static double now_sec() {
+    struct timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Ключи лежат подряд с шагом key_size; младший бит первого слова — признак «есть в таблице»
+static void bench_one(const char* name, size_t key_size, size_t key_align,
+                      key_func_t hash_func, key_cmp_t key_cmp, bool store_hashes) {
+    u_map_opts_t opts = {};
+    opts.store_hashes = store_hashes;
+
+    unsigned char* keys   = (unsigned char*)calloc(KEYS, key_size);
+    unsigned char* misses = (unsigned char*)calloc(KEYS, key_size);
+    if (!keys || !misses) {
+        free(keys);
+        free(misses);
+        return;
+    }
+
+    uint64_t state = 0x2545F4914F6CDD1DULL;
+    for (size_t i = 0; i < KEYS * key_size / sizeof(uint64_t); ++i) {
+        uint64_t word = xorshift64(&state);
+        memcpy(keys   + i * sizeof(uint64_t), &word, sizeof(word));
+        word = xorshift64(&state);
+        memcpy(misses + i * sizeof(uint64_t), &word, sizeof(word));
+    }
+    for (size_t i = 0; i < KEYS; ++i) {
+        keys  [i * key_size] |= 1;
+        misses[i * key_size] &= (unsigned char)~1u;
+    }
+
+    u_map_t map = {};
+    if (u_map_init_ex(&map, 0, key_size, key_align, sizeof(uint64_t), alignof(uint64_t),
+                      hash_func, key_cmp, &opts) != HM_ERR_OK) {
+        free(keys);
+        free(misses);
+        return;
+    }
+
+    double start = now_sec();
+    for (size_t i = 0; i < KEYS; ++i) {
+        u_map_insert_elem(&map, keys + i * key_size, &i);
+    }
+    const double insert_ns = (now_sec() - start) * 1e9 / (double)KEYS;
+
+    uint64_t sink = 0;
+    start = now_sec();
+    for (size_t i = 0; i < LOOKUPS; ++i) {
+        sink += u_map_get_elem(&map, keys + (xorshift64(&state) % KEYS) * key_size, nullptr);
+    }
+    const double hit_ns = (now_sec() - start) * 1e9 / (double)LOOKUPS;
+
+    start = now_sec();
+    for (size_t i = 0; i < LOOKUPS; ++i) {
+        sink += u_map_get_elem(&map, misses + (xorshift64(&state) % KEYS) * key_size, nullptr);
+    }
+    const double miss_ns = (now_sec() - start) * 1e9 / (double)LOOKUPS;
+
+    u_map_t copy = {};
+    start = now_sec();
+    u_map_smart_copy(&copy, &map);
+    const double copy_ms = (now_sec() - start) * 1e3;
+    u_map_destroy(&copy);
+
+    const size_t bytes = u_map_required_bytes_ex(u_map_capacity(&map), key_size, key_align,
+                                                 sizeof(uint64_t), alignof(uint64_t), &opts);
+
+    printf("%-5s %-6s  %6.1f  %8.1f  %7.1f  %7.1f  %8.1f  (%llu)\n",
+           name, store_hashes ? "on" : "off",
+           (double)bytes / (double)u_map_capacity(&map),
+           insert_ns, hit_ns, miss_ns, copy_ms, (unsigned long long)sink);
+
+    u_map_destroy(&map);
+    free(keys);
+    free(misses);
+}
+
+int main() {
+    printf("key   hashes  B/slot  insert ns  hit ns  miss ns  copy ms\n");
+    bench_one("u64", sizeof(uint64_t),  alignof(uint64_t),  hash_u64, cmp_u64, false);
+    bench_one("u64", sizeof(uint64_t),  alignof(uint64_t),  hash_u64, cmp_u64, true);
+    bench_one("64B", sizeof(big_key_t), alignof(big_key_t), hash_big, cmp_big, false);
+    bench_one("64B", sizeof(big_key_t), alignof(big_key_t), hash_big, cmp_big, true);
+    return 0;
+}
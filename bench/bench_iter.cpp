@@ -0,0 +1,168 @@
+#include "unordered_map.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+//================================================================================
+//   Обход и копирование: обычная раскладка против плотной (opts.dense)
+//================================================================================
+
+static const size_t ELEMS   = 4000000;
+static const size_t KEEP    = 10;       // после роста остается каждый KEEP-й элемент
+static const size_t LOOKUPS = 4000000;
+static const int    ROUNDS  = 5;
+
+static size_t hash_u64(const void* key) {
+    uint64_t x = 0;
+    memcpy(&x, key, sizeof(x));
+    return (size_t)x;
+}
+
+static bool cmp_u64(const void* a, const void* b) {
+    return *(const uint64_t*)a == *(const uint64_t*)b;
+}
+
+static uint64_t xorshift64(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+static double now_sec() {
+    struct timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static bool sum_values(const void* key, const void* value, void* ctx) {
+    (void)key;
+    *(uint64_t*)ctx += *(const uint64_t*)value;
+    return true;
+}
+
+// Так обходили таблицу до итераторов: по байту состояния на каждый слот ёмкости
+static uint64_t scan_states(const u_map_t* map) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < map->capacity; ++i) {
+        if ((map->data_states[i] & 0x80) != 0) continue;
+        sum += *(const uint64_t*)(const void*)((const unsigned char*)map->data_values + i * map->value_stride);
+    }
+    return sum;
+}
+
+static double best_for_each_sec(const u_map_t* map, uint64_t* sum) {
+    double best = 1e9;
+    for (int r = 0; r < ROUNDS; ++r) {
+        *sum = 0;
+        const double start = now_sec();
+        u_map_for_each(map, sum_values, sum);
+        const double sec = now_sec() - start;
+        if (sec < best) best = sec;
+    }
+    return best;
+}
+
+static double best_raw_copy_sec(const u_map_t* map) {
+    double best = 1e9;
+    for (int r = 0; r < ROUNDS; ++r) {
+        u_map_t copy = {};
+        const double start = now_sec();
+        if (u_map_raw_copy(&copy, map) != HM_ERR_OK) return -1.0;
+        const double sec = now_sec() - start;
+        u_map_destroy(&copy);
+        if (sec < best) best = sec;
+    }
+    return best;
+}
+
+static double lookup_ns(const u_map_t* map) {
+    uint64_t state = 0x2545F4914F6CDD1DULL;
+    uint64_t sum   = 0;
+    const double start = now_sec();
+    for (size_t i = 0; i < LOOKUPS; ++i) {
+        const uint64_t key = xorshift64(&state);
+        uint64_t value = 0;
+        if (u_map_get_elem(map, &key, &value)) sum += value;
+    }
+    const double sec = now_sec() - start;
+    if (sum == 1) printf("(unlikely)\n");
+    return sec * 1e9 / (double)LOOKUPS;
+}
+
+// Таблица выросла до ELEMS, потом потеряла все, кроме каждого KEEP-го, одним
+// u_map_remove_batch (как чистка по TTL): сжатие проверяется только до пакета, ёмкость остается прежней
+static bool build(u_map_t* map, bool dense, bool sparse) {
+    u_map_opts_t opts = {};
+    opts.dense = dense;
+    if (u_map_init_ex(map, 0, sizeof(uint64_t), alignof(uint64_t), sizeof(uint64_t), alignof(uint64_t),
+                      hash_u64, cmp_u64, &opts) != HM_ERR_OK) return false;
+
+    uint64_t state = 0x2545F4914F6CDD1DULL;
+    for (size_t i = 0; i < ELEMS; ++i) {
+        const uint64_t key = xorshift64(&state);
+        if (u_map_insert_elem(map, &key, &i) != HM_ERR_OK) return false;
+    }
+    if (!sparse) return true;
+
+    uint64_t* keys = (uint64_t*)malloc(ELEMS * sizeof(uint64_t));
+    if (keys == nullptr) return false;
+
+    size_t count = 0;
+    state = 0x2545F4914F6CDD1DULL;
+    for (size_t i = 0; i < ELEMS; ++i) {
+        const uint64_t key = xorshift64(&state);
+        if (i % KEEP != 0) keys[count++] = key;
+    }
+    u_map_remove_batch(map, keys, count, nullptr, nullptr);
+    free(keys);
+    return true;
+}
+
+static void run(const char* name, bool dense, bool sparse) {
+    u_map_t map = {};
+    if (!build(&map, dense, sparse)) {
+        printf("%-14s  no memory\n", name);
+        u_map_destroy(&map);
+        return;
+    }
+
+    uint64_t sum = 0;
+    const double for_each_sec = best_for_each_sec(&map, &sum);
+
+    double scan_sec = -1.0;
+    if (!dense) {
+        scan_sec = 1e9;
+        for (int r = 0; r < ROUNDS; ++r) {
+            const double start = now_sec();
+            const uint64_t scan_sum = scan_states(&map);
+            const double sec = now_sec() - start;
+            if (scan_sum != sum) printf("(scan mismatch)\n");
+            if (sec < scan_sec) scan_sec = sec;
+        }
+    }
+
+    const double copy_sec = best_raw_copy_sec(&map);
+
+    // У плотной раскладки в слотах номера записей: побайтовый обход к ней не применим
+    char scan[32] = "      -   ";
+    if (scan_sec >= 0.0) snprintf(scan, sizeof(scan), "%7.2f ms", scan_sec * 1e3);
+
+    printf("%-14s  size %8zu  capacity %8zu  byte scan %s  for_each %7.2f ms  raw_copy %7.2f ms  lookup %5.1f ns\n",
+           name, u_map_size(&map), u_map_capacity(&map), scan, for_each_sec * 1e3, copy_sec * 1e3, lookup_ns(&map));
+    u_map_destroy(&map);
+}
+
+int main() {
+    printf("elems %zu, sparse keeps every %zu-th\n", ELEMS, KEEP);
+    run("full",          false, false);
+    run("full dense",    true,  false);
+    run("sparse",        false, true);
+    run("sparse dense",  true,  true);
+    return 0;
+}
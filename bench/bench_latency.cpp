@@ -0,0 +1,82 @@
+#include "unordered_map.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+//================================================================================
+//          Задержка отдельной вставки при обычном и инкрементальном рехэше
+//================================================================================
+
+static const size_t KEYS = 1u << 23;
+
+static size_t hash_u64(const void* key) {
+    uint64_t x = 0;
+    memcpy(&x, key, sizeof(x));
+    return (size_t)x;
+}
+
+static bool cmp_u64(const void* a, const void* b) {
+    return *(const uint64_t*)a == *(const uint64_t*)b;
+}
+
+static double now_ns() {
+    struct timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static int cmp_double(const void* a, const void* b) {
+    const double x = *(const double*)a;
+    const double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void bench_inserts(size_t rehash_step, double* latencies) {
+    u_map_opts_t opts = {};
+    opts.rehash_step = rehash_step;
+
+    u_map_t map = {};
+    if (u_map_init_ex(&map, 0, sizeof(uint64_t), alignof(uint64_t),
+                      sizeof(uint64_t), alignof(uint64_t), hash_u64, cmp_u64, &opts) != HM_ERR_OK) {
+        return;
+    }
+
+    const double start = now_ns();
+    for (size_t i = 0; i < KEYS; ++i) {
+        const uint64_t key = i * 0x9e3779b97f4a7c15ULL;
+        const double op_start = now_ns();
+        u_map_insert_elem(&map, &key, &i);
+        latencies[i] = now_ns() - op_start;
+    }
+    const double total_ms = (now_ns() - start) * 1e-6;
+
+    const double finish_start = now_ns();
+    u_map_finish_rehash(&map);
+    const double finish_ms = (now_ns() - finish_start) * 1e-6;
+
+    qsort(latencies, KEYS, sizeof(double), cmp_double);
+    printf("%11zu  %9.0f  %9.0f  %9.0f  %12.0f  %8.1f  %9.2f\n",
+           rehash_step,
+           latencies[KEYS / 2], latencies[KEYS - KEYS / 1000], latencies[KEYS - KEYS / 100000],
+           latencies[KEYS - 1], total_ms, finish_ms);
+
+    u_map_destroy(&map);
+}
+
+int main() {
+    double* latencies = (double*)calloc(KEYS, sizeof(double));
+    if (!latencies) return 1;
+
+    static const size_t steps[] = {0, 16, 256, 4096};
+
+    printf("rehash_step     p50 ns   p99.9 ns  p99.999 ns    max ns    total ms  finish ms\n");
+    for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); ++i) {
+        bench_inserts(steps[i], latencies);
+    }
+
+    free(latencies);
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include "unordered_map.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+//================================================================================
+//   Политика ёмкости: размер гуляет вверх-вниз, считаем рехэши и худшую операцию
+//================================================================================
+
+static const size_t PEAK_KEYS = 1u << 18;
+static const size_t LOW_KEYS  = PEAK_KEYS / 16;  // ниже порога сжатия по умолчанию
+static const int    WAVES     = 12;
+
+static size_t hash_u64(const void* key) {
+    uint64_t x = 0;
+    memcpy(&x, key, sizeof(x));
+    return (size_t)x;
+}
+
+static bool cmp_u64(const void* a, const void* b) {
+    return *(const uint64_t*)a == *(const uint64_t*)b;
+}
+
+static double now_sec() {
+    struct timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+typedef struct wave_result_t {
+    size_t resizes;   // сколько раз менялась ёмкость
+    double worst_op;  // самая долгая вставка или удаление, сек
+    double total;
+} wave_result_t;
+
+static void timed_op(u_map_t* map, uint64_t key, bool insert, wave_result_t* result) {
+    const size_t capacity = u_map_capacity(map);
+    const double start = now_sec();
+    if (insert) u_map_insert_elem(map, &key, &key);
+    else        u_map_remove_elem(map, &key, nullptr);
+    const double sec = now_sec() - start;
+
+    if (sec > result->worst_op) result->worst_op = sec;
+    result->total += sec;
+    if (u_map_capacity(map) != capacity) result->resizes++;
+}
+
+// Волна: наполнение до PEAK_KEYS и удаление до LOW_KEYS
+static void run(const char* name, const u_map_load_policy_t* policy, bool shrink_at_idle) {
+    u_map_opts_t opts = {};
+    opts.load = *policy;
+
+    u_map_t map = {};
+    if (u_map_init_ex(&map, 0, sizeof(uint64_t), alignof(uint64_t), sizeof(uint64_t), alignof(uint64_t),
+                      hash_u64, cmp_u64, &opts) != HM_ERR_OK) {
+        printf("%-26s  bad policy\n", name);
+        return;
+    }
+
+    // Первые LOW_KEYS ключей живут всегда
+    for (uint64_t key = 0; key < LOW_KEYS; ++key) u_map_insert_elem(&map, &key, &key);
+
+    wave_result_t result = {};
+    size_t peak_capacity = 0;
+    for (int wave = 0; wave < WAVES; ++wave) {
+        for (uint64_t key = LOW_KEYS; key < PEAK_KEYS; ++key) timed_op(&map, key, true, &result);
+        if (u_map_capacity(&map) > peak_capacity) peak_capacity = u_map_capacity(&map);
+        for (uint64_t key = LOW_KEYS; key < PEAK_KEYS; ++key) timed_op(&map, key, false, &result);
+    }
+    const size_t low_capacity = u_map_capacity(&map);
+
+    double idle_sec = 0.0;
+    if (shrink_at_idle) {
+        const double start = now_sec();
+        u_map_shrink_to_fit(&map);
+        idle_sec = now_sec() - start;
+    }
+
+    printf("%-26s  resizes %4zu  worst op %7.2f ms  total %6.1f ms  capacity peak %7zu low %7zu -> %7zu"
+           "  (shrink_to_fit %.2f ms)\n",
+           name, result.resizes, result.worst_op * 1e3, result.total * 1e3, peak_capacity, low_capacity,
+           u_map_capacity(&map), idle_sec * 1e3);
+    u_map_destroy(&map);
+}
+
+int main() {
+    printf("%d waves between %zu and %zu keys\n", WAVES, LOW_KEYS, PEAK_KEYS);
+
+    u_map_load_policy_t policy = {};
+    run("default",                   &policy, false);
+
+    policy.no_auto_shrink = true;
+    run("no_auto_shrink + idle fit", &policy, true);
+
+    policy = {};
+    policy.max_load = 0.875;
+    run("max_load 0.875",            &policy, false);
+
+    policy = {};
+    policy.shrink_load = 0.5;
+    run("shrink_load 0.5 (rejected)", &policy, false);
+    return 0;
+}
@@ -0,0 +1,123 @@
+#define HASH_MAP_LOGGER_ALL
+#include "logger.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+//================================================================================
+//        Цена сообщения: фоновый вывод против printf в вызывающем потоке
+//================================================================================
+
+static const size_t MESSAGES = 1000000;
+static const size_t BATCH    = 512;     // меньше кольца потока: фоновый поток успевает разобрать
+static const char*  PATH     = "bench_logger.log";
+
+static double now_sec() {
+    struct timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Так писал сообщение прежний логгер: время в строку и fprintf на каждый вызов
+__attribute__((format(printf, 4, 5)))
+static void sync_log(FILE* out, const char* file, int line, const char* format, ...) {
+    char stamp[32] = "";
+    time_t t = time(nullptr);
+    struct tm tmv;
+    localtime_r(&t, &tmv);
+    strftime(stamp, sizeof stamp, "%H:%M:%S:%Y-%m-%d", &tmv);
+    fprintf(out, "%s. %s:%d. %s. ", stamp, file, line, "DEBUG");
+
+    va_list ap;
+    va_start(ap, format);
+    vfprintf(out, format, ap);
+    va_end(ap);
+    fputc('\n', out);
+}
+
+// Деструктор ключа, созданного после ключа логгера, срабатывает уже после того, как поток
+// отдал свое кольцо: сообщение должно дойти, а не попасть в освобожденное кольцо
+static const size_t  LATE_THREADS = 64;
+static pthread_key_t late_key;
+
+static void late_log(void* arg) {
+    logger_flush();   // выводит последние записи потока
+    logger_flush();   // и освобождает его закрытое кольцо
+    LOGGER_DEBUG("late message from thread %zu", (size_t)(uintptr_t)arg);
+}
+
+static void* late_thread(void* arg) {
+    LOGGER_DEBUG("thread %zu started", (size_t)(uintptr_t)arg);
+    pthread_setspecific(late_key, arg);
+    return nullptr;
+}
+
+// Сколько строк файла содержат needle
+static size_t count_lines(const char* path, const char* needle) {
+    FILE* in = fopen(path, "r");
+    if (in == nullptr) return 0;
+    char line[1024];
+    size_t count = 0;
+    while (fgets(line, sizeof line, in) != nullptr) count += strstr(line, needle) != nullptr;
+    fclose(in);
+    return count;
+}
+
+// Логгер уже пишет в PATH, его ключ создан раньше late_key
+static void run_late_threads() {
+    pthread_key_create(&late_key, late_log);
+
+    pthread_t threads[LATE_THREADS];
+    for (size_t i = 0; i < LATE_THREADS; ++i)
+        pthread_create(&threads[i], nullptr, late_thread, (void*)(uintptr_t)(i + 1));
+    for (size_t i = 0; i < LATE_THREADS; ++i) pthread_join(threads[i], nullptr);
+
+    pthread_key_delete(late_key);
+}
+
+int main() {
+    FILE* out = fopen(PATH, "w");
+    if (out == nullptr) return 1;
+
+    double start = now_sec();
+    for (size_t i = 0; i < MESSAGES; ++i)
+        sync_log(out, __FILE__, __LINE__, "Changing capacity from %zu to %zu", i, 2 * i);
+    const double sync_sec = now_sec() - start;
+    fclose(out);
+
+    if (logger_initialize_file(PATH) != 0) return 1;
+
+    // Вызывающий поток платит только за запись в кольцо; вывод — в фоновом потоке
+    double async_sec = 0;
+    for (size_t done = 0; done < MESSAGES; done += BATCH) {
+        start = now_sec();
+        for (size_t i = done; i < done + BATCH; ++i)
+            LOGGER_DEBUG("Changing capacity from %zu to %zu", i, 2 * i);
+        async_sec += now_sec() - start;
+        logger_flush();
+    }
+
+    start = now_sec();
+    logger_set_level(LOGGER_MODE_WARNING);
+    for (size_t i = 0; i < MESSAGES; ++i)
+        LOGGER_DEBUG("Changing capacity from %zu to %zu", i, 2 * i);
+    const double filtered_sec = now_sec() - start;
+
+    logger_set_level(LOGGER_MODE_DEBUG);
+    run_late_threads();
+
+    logger_close();
+    const size_t late = count_lines(PATH, "late message from thread");
+    remove(PATH);
+
+    printf("sync fprintf      %7.1f ns/message\n", sync_sec     / (double)MESSAGES * 1e9);
+    printf("async ring        %7.1f ns/message\n", async_sec    / (double)MESSAGES * 1e9);
+    printf("below level       %7.1f ns/message\n", filtered_sec / (double)MESSAGES * 1e9);
+    printf("late messages     %zu / %zu\n", late, LATE_THREADS);
+    return late == LATE_THREADS ? 0 : 1;
+}
@@ -0,0 +1,107 @@
+#include "unordered_map.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+//================================================================================
+//          Замер поиска (hit / miss) в статической таблице при разных загрузках
+//================================================================================
+
+static const size_t LOOKUPS = 1u << 22;
+
+static size_t hash_u64(const void* key) {
+    uint64_t x = 0;
+    memcpy(&x, key, sizeof(x));
+    return (size_t)x;
+}
+
+static bool cmp_u64(const void* a, const void* b) {
+    return *(const uint64_t*)a == *(const uint64_t*)b;
+}
+
+static uint64_t xorshift64(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+static double now_sec() {
+    struct timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Ключи вставки — нечетные числа, промахи ищутся по четным
+static void bench_one(size_t capacity, double load_factor, u_map_probe_t probe) {
+    size_t bytes = u_map_required_bytes(capacity, sizeof(uint64_t), alignof(uint64_t),
+                                                  sizeof(uint64_t), alignof(uint64_t));
+    void* buffer = aligned_alloc(64, (bytes + 63) / 64 * 64);
+    if (!buffer) return;
+
+    u_map_opts_t opts = {};
+    opts.probe = probe;
+
+    u_map_t map = {};
+    u_map_static_init_ex(&map, buffer, capacity,
+                         sizeof(uint64_t), alignof(uint64_t),
+                         sizeof(uint64_t), alignof(uint64_t),
+                         hash_u64, cmp_u64, &opts);
+
+    const size_t count = (size_t)((double)capacity * load_factor);
+    uint64_t* keys = (uint64_t*)calloc(count, sizeof(uint64_t));
+    if (!keys) {
+        free(buffer);
+        return;
+    }
+
+    uint64_t state = 0x2545F4914F6CDD1DULL;
+    for (size_t i = 0; i < count; ++i) {
+        keys[i] = xorshift64(&state) | 1;
+        u_map_insert_elem(&map, &keys[i], &i);
+    }
+
+    uint64_t sink = 0;
+    double start = now_sec();
+    for (size_t i = 0; i < LOOKUPS; ++i) {
+        uint64_t value = 0;
+        if (u_map_get_elem(&map, &keys[xorshift64(&state) % count], &value)) sink += value;
+    }
+    const double hit_ns = (now_sec() - start) * 1e9 / (double)LOOKUPS;
+
+    start = now_sec();
+    for (size_t i = 0; i < LOOKUPS; ++i) {
+        uint64_t key = xorshift64(&state) & ~(uint64_t)1;
+        sink += u_map_get_elem(&map, &key, nullptr);
+    }
+    const double miss_ns = (now_sec() - start) * 1e9 / (double)LOOKUPS;
+
+    printf("%-6s %10zu  %4.2f  %8.1f  %8.1f  (%llu)\n",
+           probe == U_MAP_PROBE_ROBIN_HOOD ? "robin" : "swiss",
+           capacity, load_factor, hit_ns, miss_ns, (unsigned long long)sink);
+
+    u_map_destroy(&map);
+    free(keys);
+    free(buffer);
+}
+
+int main() {
+    static const size_t capacities[]   = {1u << 12, 1u << 16, 1u << 22};
+    static const double load_factors[] = {0.5, 0.7, 0.8, 0.9};
+    static const u_map_probe_t probes[] = {U_MAP_PROBE_SWISS, U_MAP_PROBE_ROBIN_HOOD};
+
+    printf("probe    capacity  load    hit ns   miss ns\n");
+    for (size_t p = 0; p < sizeof(probes) / sizeof(probes[0]); ++p) {
+        for (size_t c = 0; c < sizeof(capacities) / sizeof(capacities[0]); ++c) {
+            for (size_t l = 0; l < sizeof(load_factors) / sizeof(load_factors[0]); ++l) {
+                bench_one(capacities[c], load_factors[l], probes[p]);
+            }
+        }
+    }
+    return 0;
+}
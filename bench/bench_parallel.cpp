@@ -0,0 +1,105 @@
+#include "unordered_map.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+//================================================================================
+//   Параллельные рехэш, копия и bulk_build: время от числа потоков (opts.threads)
+//================================================================================
+
+static const size_t KEYS    = 1u << 22;
+static const int    REPEATS = 3;
+
+typedef struct pair_t {
+    uint64_t key;
+    uint64_t value;
+} pair_t;
+
+static size_t hash_u64(const void* key) {
+    uint64_t x = 0;
+    memcpy(&x, key, sizeof(x));
+    return (size_t)x;
+}
+
+static bool cmp_u64(const void* a, const void* b) {
+    return *(const uint64_t*)a == *(const uint64_t*)b;
+}
+
+static double now_sec() {
+    struct timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static bool init_map(u_map_t* map, size_t threads) {
+    u_map_opts_t opts = {};
+    opts.threads = threads;
+    return u_map_init_ex(map, 0, sizeof(uint64_t), alignof(uint64_t), sizeof(uint64_t), alignof(uint64_t),
+                         hash_u64, cmp_u64, &opts) == HM_ERR_OK;
+}
+
+typedef struct par_result_t {
+    double bulk;    // bulk_build в пустую таблицу
+    double grow;    // u_map_reserve на вдвое большую ёмкость
+    double copy;    // u_map_smart_copy
+} par_result_t;
+
+// Лучшее из REPEATS: шум планировщика только прибавляет
+static par_result_t run(const pair_t* pairs, size_t threads) {
+    par_result_t best = {1e9, 1e9, 1e9};
+    for (int r = 0; r < REPEATS; ++r) {
+        u_map_t map = {};
+        u_map_t copy = {};
+        if (!init_map(&map, threads)) return best;
+
+        double start = now_sec();
+        u_map_bulk_build(&map, pairs, KEYS, nullptr);
+        const double bulk = now_sec() - start;
+
+        start = now_sec();
+        u_map_reserve(&map, u_map_capacity(&map));
+        const double grow = now_sec() - start;
+
+        start = now_sec();
+        u_map_smart_copy(&copy, &map);
+        const double copy_sec = now_sec() - start;
+
+        if (bulk     < best.bulk) best.bulk = bulk;
+        if (grow     < best.grow) best.grow = grow;
+        if (copy_sec < best.copy) best.copy = copy_sec;
+
+        u_map_destroy(&copy);
+        u_map_destroy(&map);
+    }
+    return best;
+}
+
+int main() {
+    pair_t* pairs = (pair_t*)calloc(KEYS, sizeof(pair_t));
+    if (pairs == nullptr) return 1;
+
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+    for (size_t i = 0; i < KEYS; ++i) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        pairs[i].key   = state;
+        pairs[i].value = i;
+    }
+
+    const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    printf("%zu keys, %ld cpus online\n", KEYS, cpus);
+
+    const par_result_t base = run(pairs, 1);
+    for (size_t threads = 1; threads <= 16; threads *= 2) {
+        const par_result_t res = threads == 1 ? base : run(pairs, threads);
+        printf("threads %2zu  bulk %7.1f ms (x%.2f)  grow %7.1f ms (x%.2f)  copy %7.1f ms (x%.2f)\n", threads,
+               res.bulk * 1e3, base.bulk / res.bulk, res.grow * 1e3, base.grow / res.grow,
+               res.copy * 1e3, base.copy / res.copy);
+    }
+
+    free(pairs);
+    return 0;
+}
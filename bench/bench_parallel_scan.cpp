@@ -0,0 +1,102 @@
+#include "unordered_map.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+//================================================================================
+//   Параллельные for_each / reduce: сумма значений от числа потоков и загрузки
+//================================================================================
+
+static const size_t CAPACITY_KEYS = 1u << 22;
+static const int    REPEATS       = 5;
+
+static size_t hash_u64(const void* key) {
+    uint64_t x = 0;
+    memcpy(&x, key, sizeof(x));
+    return (size_t)x;
+}
+
+static bool cmp_u64(const void* a, const void* b) {
+    return *(const uint64_t*)a == *(const uint64_t*)b;
+}
+
+static double now_sec() {
+    struct timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void fold_sum(void* acc, const void* key, const void* value, void* ctx) {
+    (void)key;
+    (void)ctx;
+    *(double*)acc += *(const double*)value;
+}
+
+static void combine_sum(void* acc, const void* other, void* ctx) {
+    (void)ctx;
+    *(double*)acc += *(const double*)other;
+}
+
+static bool visit_sum(const void* key, const void* value, void* ctx) {
+    (void)key;
+    *(double*)ctx += *(const double*)value;
+    return true;
+}
+
+// Таблица на CAPACITY_KEYS ключей, из которых живы только keep_every-й: обход платит за всю ёмкость
+static void run(size_t keep_every) {
+    u_map_t map = {};
+    if (u_map_init(&map, 0, sizeof(uint64_t), alignof(uint64_t), sizeof(double), alignof(double),
+                   hash_u64, cmp_u64) != HM_ERR_OK) {
+        return;
+    }
+
+    u_map_reserve(&map, CAPACITY_KEYS);
+    for (uint64_t key = 0; key < CAPACITY_KEYS; ++key) {
+        const double value = (double)key;
+        u_map_insert_elem(&map, &key, &value);
+    }
+    for (uint64_t key = 0; key < CAPACITY_KEYS; ++key) {
+        if (key % keep_every != 0) u_map_remove_elem(&map, &key, nullptr);
+    }
+
+    printf("size %zu, capacity %zu\n", u_map_size(&map), u_map_capacity(&map));
+
+    double best = 1e9;
+    double sum  = 0.0;
+    for (int r = 0; r < REPEATS; ++r) {
+        sum = 0.0;
+        const double start = now_sec();
+        u_map_for_each(&map, visit_sum, &sum);
+        const double sec = now_sec() - start;
+        if (sec < best) best = sec;
+    }
+    printf("  for_each            %7.2f ms  sum %.17g\n", best * 1e3, sum);
+
+    for (size_t threads = 1; threads <= 16; threads *= 2) {
+        map.threads = threads;  // то же, что opts.threads при создании
+
+        best = 1e9;
+        for (int r = 0; r < REPEATS; ++r) {
+            sum = 0.0;
+            const double start = now_sec();
+            u_map_parallel_reduce(&map, &sum, sizeof(sum), fold_sum, combine_sum, nullptr);
+            const double sec = now_sec() - start;
+            if (sec < best) best = sec;
+        }
+        printf("  reduce threads %2zu  %7.2f ms  sum %.17g\n", threads, best * 1e3, sum);
+    }
+
+    u_map_destroy(&map);
+}
+
+int main() {
+    printf("%ld cpus online\n", sysconf(_SC_NPROCESSORS_ONLN));
+    run(1);
+    run(16);
+    return 0;
+}
@@ -0,0 +1,187 @@
+#include "unordered_map.h"
+#include "u_map_sharded.h"
+#include "u_map_rcu.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+//================================================================================
+//   Читатели при редких записях: rwlock / шарды / u_map_rcu_t (чтение без блокировок)
+//================================================================================
+
+static const size_t KEYS             = 1u << 18;
+static const size_t READS_PER_THREAD = 4000000;
+static const int    READERS[]        = {1, 2, 4, 8};
+
+typedef enum bench_kind_t {
+    BENCH_RWLOCK  = 0,
+    BENCH_SHARDED = 1,
+    BENCH_RCU     = 2,
+} bench_kind_t;
+
+static size_t hash_u64(const void* key) {
+    uint64_t x = 0;
+    memcpy(&x, key, sizeof(x));
+    return (size_t)x;
+}
+
+static bool cmp_u64(const void* a, const void* b) {
+    return *(const uint64_t*)a == *(const uint64_t*)b;
+}
+
+static uint64_t xorshift64(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+static double now_sec() {
+    struct timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+typedef struct bench_maps_t {
+    u_map_t          plain;
+    pthread_rwlock_t plain_lock;
+    u_map_sharded_t  sharded;
+    u_map_rcu_t      rcu;
+    bench_kind_t     kind;
+    bool             stop;
+} bench_maps_t;
+
+typedef struct reader_ctx_t {
+    bench_maps_t* maps;
+    uint64_t      seed;
+    uint64_t      found;
+} reader_ctx_t;
+
+static void* reader_thread(void* arg) {
+    reader_ctx_t* ctx  = (reader_ctx_t*)arg;
+    bench_maps_t* maps = ctx->maps;
+    uint64_t state = ctx->seed;
+
+    u_map_rcu_reader_t* reader = maps->kind == BENCH_RCU ? u_map_rcu_register_reader(&maps->rcu) : nullptr;
+
+    for (size_t i = 0; i < READS_PER_THREAD; ++i) {
+        const uint64_t key = xorshift64(&state) % KEYS;
+        uint64_t value = 0;
+        bool is_found = false;
+
+        switch (maps->kind) {
+            case BENCH_RWLOCK:
+                pthread_rwlock_rdlock(&maps->plain_lock);
+                is_found = u_map_get_elem(&maps->plain, &key, &value);
+                pthread_rwlock_unlock(&maps->plain_lock);
+                break;
+            case BENCH_SHARDED:
+                is_found = u_map_sharded_get(&maps->sharded, &key, &value);
+                break;
+            case BENCH_RCU:
+                is_found = u_map_rcu_get(&maps->rcu, reader, &key, &value);
+                break;
+            default:
+                break;
+        }
+        ctx->found += is_found;
+    }
+
+    if (reader != nullptr) u_map_rcu_unregister_reader(&maps->rcu, reader);
+    return nullptr;
+}
+
+// Редкие обновления: примерно одна запись в 50 мкс
+static void* writer_thread(void* arg) {
+    bench_maps_t* maps = (bench_maps_t*)arg;
+    uint64_t state = 0xC0FFEEULL;
+
+    while (!__atomic_load_n(&maps->stop, __ATOMIC_ACQUIRE)) {
+        const uint64_t key   = xorshift64(&state) % KEYS;
+        const uint64_t value = state;
+
+        switch (maps->kind) {
+            case BENCH_RWLOCK:
+                pthread_rwlock_wrlock(&maps->plain_lock);
+                u_map_insert_elem(&maps->plain, &key, &value);
+                pthread_rwlock_unlock(&maps->plain_lock);
+                break;
+            case BENCH_SHARDED:
+                u_map_sharded_insert(&maps->sharded, &key, &value);
+                break;
+            case BENCH_RCU:
+                u_map_rcu_insert(&maps->rcu, &key, &value);
+                break;
+            default:
+                break;
+        }
+        usleep(50);
+    }
+    return nullptr;
+}
+
+static double run(bench_maps_t* maps, bench_kind_t kind, int reader_count) {
+    pthread_t    readers[8];
+    reader_ctx_t ctx[8];
+    pthread_t    writer;
+
+    maps->kind = kind;
+    maps->stop = false;
+    pthread_create(&writer, nullptr, writer_thread, maps);
+
+    const double start = now_sec();
+    for (int t = 0; t < reader_count; ++t) {
+        ctx[t].maps  = maps;
+        ctx[t].seed  = 0x9E3779B97F4A7C15ULL * (uint64_t)(t + 1);
+        ctx[t].found = 0;
+        pthread_create(&readers[t], nullptr, reader_thread, &ctx[t]);
+    }
+    for (int t = 0; t < reader_count; ++t) pthread_join(readers[t], nullptr);
+    const double sec = now_sec() - start;
+
+    __atomic_store_n(&maps->stop, true, __ATOMIC_RELEASE);
+    pthread_join(writer, nullptr);
+
+    return (double)READS_PER_THREAD * reader_count / sec / 1e6;
+}
+
+int main() {
+    bench_maps_t* maps = (bench_maps_t*)calloc(1, sizeof(bench_maps_t));
+    if (!maps) return 1;
+
+    SIMPLE_U_MAP_INIT(&maps->plain, 0, uint64_t, uint64_t, hash_u64, cmp_u64);
+    pthread_rwlock_init(&maps->plain_lock, nullptr);
+    u_map_sharded_init(&maps->sharded, 0, 0, sizeof(uint64_t), alignof(uint64_t), sizeof(uint64_t), alignof(uint64_t),
+                       hash_u64, cmp_u64, nullptr);
+    u_map_rcu_init(&maps->rcu, 0, sizeof(uint64_t), alignof(uint64_t), sizeof(uint64_t), alignof(uint64_t),
+                   hash_u64, cmp_u64);
+
+    for (uint64_t key = 0; key < KEYS; ++key) {
+        u_map_insert_elem(&maps->plain, &key, &key);
+        u_map_sharded_insert(&maps->sharded, &key, &key);
+        u_map_rcu_insert(&maps->rcu, &key, &key);
+    }
+
+    printf("keys %zu, reads per thread %zu, one writer\n", KEYS, READS_PER_THREAD);
+    printf("readers   rwlock, Mops/s   sharded, Mops/s   rcu, Mops/s\n");
+    for (size_t i = 0; i < sizeof(READERS) / sizeof(READERS[0]); ++i) {
+        const double rwlock  = run(maps, BENCH_RWLOCK,  READERS[i]);
+        const double sharded = run(maps, BENCH_SHARDED, READERS[i]);
+        const double rcu     = run(maps, BENCH_RCU,     READERS[i]);
+        printf("%7d   %14.2f   %15.2f   %11.2f\n", READERS[i], rwlock, sharded, rcu);
+    }
+
+    u_map_rcu_destroy(&maps->rcu);
+    u_map_sharded_destroy(&maps->sharded);
+    pthread_rwlock_destroy(&maps->plain_lock);
+    u_map_destroy(&maps->plain);
+    free(maps);
+    return 0;
+}
@@ -0,0 +1,136 @@
+#include "unordered_map.h"
+#include "u_map_sharded.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+//================================================================================
+//   Пропускная способность: u_map_t под общим мьютексом против u_map_sharded_t
+//================================================================================
+
+static const size_t KEYS           = 1u << 20;
+static const size_t OPS_PER_THREAD = 2000000;
+static const int    THREADS[]      = {1, 2, 4, 8, 16};
+
+static size_t hash_u64(const void* key) {
+    uint64_t x = 0;
+    memcpy(&x, key, sizeof(x));
+    return (size_t)x;
+}
+
+static bool cmp_u64(const void* a, const void* b) {
+    return *(const uint64_t*)a == *(const uint64_t*)b;
+}
+
+static uint64_t xorshift64(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+static double now_sec() {
+    struct timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+typedef struct bench_ctx_t {
+    u_map_t*         global_map;   // вариант с общим мьютексом
+    pthread_mutex_t* global_lock;
+    u_map_sharded_t* sharded_map;
+    unsigned         read_percent;
+    uint64_t         seed;
+} bench_ctx_t;
+
+static void* bench_worker(void* arg) {
+    const bench_ctx_t* ctx = (const bench_ctx_t*)arg;
+    uint64_t state = ctx->seed;
+
+    for (size_t i = 0; i < OPS_PER_THREAD; ++i) {
+        const uint64_t rnd = xorshift64(&state);
+        const uint64_t key = rnd % (KEYS * 2);
+        const unsigned op  = (unsigned)((rnd >> 40) % 100);
+        uint64_t value = key;
+
+        if (ctx->sharded_map != nullptr) {
+            if (op < ctx->read_percent)   u_map_sharded_get   (ctx->sharded_map, &key, &value);
+            else if (op & 1)              u_map_sharded_insert(ctx->sharded_map, &key, &value);
+            else                          u_map_sharded_remove(ctx->sharded_map, &key, nullptr);
+            continue;
+        }
+
+        pthread_mutex_lock(ctx->global_lock);
+        if (op < ctx->read_percent)   u_map_get_elem   (ctx->global_map, &key, &value);
+        else if (op & 1)              u_map_insert_elem(ctx->global_map, &key, &value);
+        else                          u_map_remove_elem(ctx->global_map, &key, nullptr);
+        pthread_mutex_unlock(ctx->global_lock);
+    }
+    return nullptr;
+}
+
+static double run_threads(bench_ctx_t* base, int thread_count) {
+    pthread_t   threads[16];
+    bench_ctx_t ctx[16];
+
+    const double start = now_sec();
+    for (int t = 0; t < thread_count; ++t) {
+        ctx[t] = *base;
+        ctx[t].seed = 0x9E3779B97F4A7C15ULL * (uint64_t)(t + 1);
+        pthread_create(&threads[t], nullptr, bench_worker, &ctx[t]);
+    }
+    for (int t = 0; t < thread_count; ++t) pthread_join(threads[t], nullptr);
+    const double sec = now_sec() - start;
+
+    return (double)OPS_PER_THREAD * thread_count / sec / 1e6;
+}
+
+static void run_mix(const char* name, unsigned read_percent) {
+    printf("\n%s (%u%% get)\n", name, read_percent);
+    printf("threads   global mutex, Mops/s   sharded, Mops/s\n");
+
+    for (size_t i = 0; i < sizeof(THREADS) / sizeof(THREADS[0]); ++i) {
+        u_map_t map = {};
+        SIMPLE_U_MAP_INIT(&map, 0, uint64_t, uint64_t, hash_u64, cmp_u64);
+        pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+        u_map_sharded_t sharded = {};
+        u_map_sharded_init(&sharded, 0, 0, sizeof(uint64_t), alignof(uint64_t), sizeof(uint64_t), alignof(uint64_t),
+                           hash_u64, cmp_u64, nullptr);
+
+        for (uint64_t key = 0; key < KEYS; ++key) {
+            u_map_insert_elem(&map, &key, &key);
+            u_map_sharded_insert(&sharded, &key, &key);
+        }
+
+        bench_ctx_t ctx = {};
+        ctx.read_percent = read_percent;
+
+        ctx.global_map  = &map;
+        ctx.global_lock = &lock;
+        const double global_mops = run_threads(&ctx, THREADS[i]);
+
+        ctx.global_map  = nullptr;
+        ctx.global_lock = nullptr;
+        ctx.sharded_map = &sharded;
+        const double sharded_mops = run_threads(&ctx, THREADS[i]);
+
+        printf("%7d   %20.2f   %15.2f\n", THREADS[i], global_mops, sharded_mops);
+
+        u_map_sharded_destroy(&sharded);
+        u_map_destroy(&map);
+    }
+}
+
+int main() {
+    printf("keys %zu, ops per thread %zu, shards %d\n", KEYS, OPS_PER_THREAD, U_MAP_DEFAULT_SHARDS);
+    run_mix("read-heavy",  95);
+    run_mix("write-heavy", 50);
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include "unordered_map.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+//================================================================================
+//        Старт сервиса: заново вставить все пары против u_map_open_mmap
+//================================================================================
+
+static const size_t PAIRS   = 10000000;
+static const size_t LOOKUPS = 1000000;
+static const char*  PATH    = "bench_snapshot.bin";
+
+static size_t hash_u64(const void* key) {
+    uint64_t x = 0;
+    memcpy(&x, key, sizeof(x));
+    return (size_t)x;
+}
+
+static bool cmp_u64(const void* a, const void* b) {
+    return *(const uint64_t*)a == *(const uint64_t*)b;
+}
+
+static uint64_t xorshift64(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+static double now_sec() {
+    struct timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Первые поиски после старта: на отображенном файле они же платят за ошибки страниц
+static double first_lookups_sec(const u_map_t* map) {
+    uint64_t state = 0x2545F4914F6CDD1DULL;
+    uint64_t sum   = 0;
+    const double start = now_sec();
+    for (size_t i = 0; i < LOOKUPS; ++i) {
+        const uint64_t key = xorshift64(&state);
+        uint64_t value = 0;
+        u_map_get_elem(map, &key, &value);
+        sum += value;
+    }
+    const double sec = now_sec() - start;
+    if (sum == 0) printf("(no hits)\n");
+    return sec;
+}
+
+int main() {
+    u_map_t map = {};
+    SIMPLE_U_MAP_INIT(&map, 0, uint64_t, uint64_t, hash_u64, cmp_u64);
+
+    uint64_t state = 0x2545F4914F6CDD1DULL;
+    double start = now_sec();
+    for (size_t i = 0; i < PAIRS; ++i) {
+        const uint64_t key = xorshift64(&state);
+        u_map_insert_elem(&map, &key, &i);
+    }
+    const double insert_sec = now_sec() - start;
+
+    start = now_sec();
+    if (u_map_save(&map, PATH) != HM_ERR_OK) return 1;
+    const double save_sec = now_sec() - start;
+    u_map_destroy(&map);
+
+    start = now_sec();
+    if (u_map_open_mmap(&map, PATH, hash_u64, cmp_u64, 0) != HM_ERR_OK) return 1;
+    const double open_sec = now_sec() - start;
+    const double mmap_lookup_sec = first_lookups_sec(&map);
+    u_map_destroy(&map);
+
+    start = now_sec();
+    if (u_map_open_mmap(&map, PATH, hash_u64, cmp_u64, U_MAP_OPEN_VERIFY) != HM_ERR_OK) return 1;
+    const double verify_sec = now_sec() - start;
+    u_map_destroy(&map);
+
+    printf("pairs %zu\n", PAIRS);
+    printf("insert all        %8.3f s\n", insert_sec);
+    printf("u_map_save        %8.3f s\n", save_sec);
+    printf("open_mmap         %8.3f ms, then %zu lookups %.3f s\n", open_sec * 1e3, LOOKUPS, mmap_lookup_sec);
+    printf("open_mmap+verify  %8.3f s\n", verify_sec);
+
+    remove(PATH);
+    return 0;
+}
@@ -0,0 +1,437 @@
+#include "unordered_map.h"
+
+#include <unordered_map>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+//================================================================================
+//      Сводный бенчмарк: u_map против std::unordered_map, результат — CSV
+//================================================================================
+//
+// Прогон перебирает размеры ключа и значения, число слотов (от помещающихся в L1
+// до много больше LLC), загрузку таблицы и распределение запросов (равномерное / Zipf).
+// Операции: insert, hit / miss lookup, remove, churn, bulk load (read_arr_to_u_map),
+// smart_copy, raw_copy. Для сравнимой загрузки u_map строится статической таблицей
+// фиксированной емкости; std::unordered_map получает reserve на то же число элементов.
+//
+// Запуск: bench_suite [--quick] [--large] [--seed N] [--out file.csv]
+// Все случайные данные берутся из seed, так что повторный прогон дает те же наборы ключей.
+
+typedef struct suite_opts_t {
+    bool        quick;
+    bool        large;
+    uint64_t    seed;
+    FILE*       out;
+} suite_opts_t;
+
+static const double LOAD_FACTORS[] = {0.25, 0.5, 0.7};
+static const double ZIPF_THETA     = 0.99;
+
+// Выше этого бюджета конфигурация пропускается (u_map и std держат таблицу одновременно)
+static const size_t MEMORY_BUDGET  = (size_t)3 << 30;
+
+static uint64_t splitmix64(uint64_t* state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static double now_sec() {
+    struct timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+//================================================================================
+//                        Ключи и значения
+//================================================================================
+
+// Первое слово — сам ключ, остальные — производные от него, чтобы сравнение шло по всем байтам
+template <size_t N>
+struct bench_key_t {
+    uint64_t words[N / sizeof(uint64_t)];
+};
+
+template <size_t N>
+struct bench_value_t {
+    uint64_t words[N / sizeof(uint64_t)];
+};
+
+template <size_t N>
+static bench_key_t<N> make_key(uint64_t x) {
+    bench_key_t<N> key = {};
+    for (size_t i = 0; i < N / sizeof(uint64_t); ++i) key.words[i] = x ^ (0x5851f42d4c957f2dULL * i);
+    return key;
+}
+
+template <size_t N>
+static bench_value_t<N> make_value(uint64_t x) {
+    bench_value_t<N> value = {};
+    for (size_t i = 0; i < N / sizeof(uint64_t); ++i) value.words[i] = x + i;
+    return value;
+}
+
+template <size_t N>
+static size_t hash_key(const void* key) {
+    uint64_t x = 0;
+    memcpy(&x, key, sizeof(x));
+    return (size_t)x;
+}
+
+template <size_t N>
+static bool cmp_key(const void* a, const void* b) {
+    return memcmp(a, b, N) == 0;
+}
+
+template <size_t N>
+struct std_hash_t {
+    size_t operator()(const bench_key_t<N>& key) const { return (size_t)key.words[0]; }
+};
+
+template <size_t N>
+struct std_eq_t {
+    bool operator()(const bench_key_t<N>& a, const bench_key_t<N>& b) const { return memcmp(&a, &b, N) == 0; }
+};
+
+//================================================================================
+//                        Распределения запросов
+//================================================================================
+
+typedef enum dist_t {
+    DIST_UNIFORM = 0,
+    DIST_ZIPF    = 1,
+} dist_t;
+
+static const char* dist_name(dist_t dist) {
+    return dist == DIST_ZIPF ? "zipf" : "uniform";
+}
+
+// Генератор Zipf по Gray et al. (как в YCSB): O(n) на подготовку, O(1) на число
+typedef struct zipf_t {
+    size_t n;
+    double theta;
+    double alpha;
+    double zetan;
+    double eta;
+} zipf_t;
+
+static double zeta(size_t n, double theta) {
+    double sum = 0;
+    for (size_t i = 1; i <= n; ++i) sum += 1.0 / pow((double)i, theta);
+    return sum;
+}
+
+static zipf_t zipf_make(size_t n, double theta) {
+    zipf_t zipf = {};
+    zipf.n     = n;
+    zipf.theta = theta;
+    zipf.alpha = 1.0 / (1.0 - theta);
+    zipf.zetan = zeta(n, theta);
+    zipf.eta   = (1.0 - pow(2.0 / (double)n, 1.0 - theta)) / (1.0 - zeta(2, theta) / zipf.zetan);
+    return zipf;
+}
+
+static size_t zipf_next(const zipf_t* zipf, uint64_t* state) {
+    const double u  = (double)(splitmix64(state) >> 11) * (1.0 / 9007199254740992.0);
+    const double uz = u * zipf->zetan;
+    if (uz < 1.0) return 0;
+    if (uz < 1.0 + pow(0.5, zipf->theta)) return 1;
+
+    const size_t rank = (size_t)((double)zipf->n * pow(zipf->eta * u - zipf->eta + 1.0, zipf->alpha));
+    return rank < zipf->n ? rank : zipf->n - 1;
+}
+
+// Индексы ключей для запросов; горячие ранги Zipf разбросаны по ключам, а не идут подряд
+static void fill_queries(size_t* queries, size_t count, size_t n, dist_t dist, uint64_t seed) {
+    uint64_t state = seed;
+    if (dist == DIST_UNIFORM) {
+        for (size_t i = 0; i < count; ++i) queries[i] = splitmix64(&state) % n;
+        return;
+    }
+
+    const zipf_t zipf = zipf_make(n, ZIPF_THETA);
+    for (size_t i = 0; i < count; ++i) {
+        queries[i] = (size_t)((zipf_next(&zipf, &state) * 0x9e3779b97f4a7c15ULL) % n);
+    }
+}
+
+//================================================================================
+//                        Вывод
+//================================================================================
+
+typedef struct bench_row_t {
+    size_t      key_size;
+    size_t      value_size;
+    size_t      capacity;
+    size_t      elems;
+    double      load_factor;
+} bench_row_t;
+
+static void emit_header(FILE* out) {
+    fprintf(out, "impl,op,key_size,value_size,capacity,elems,load_factor,dist,ns_per_op,speedup_vs_std\n");
+}
+
+static void emit(FILE* out, const bench_row_t* row, const char* op, const char* dist,
+                 double std_ns, double u_map_ns) {
+    fprintf(out, "std,%s,%zu,%zu,%zu,%zu,%.2f,%s,%.2f,1.00\n", op, row->key_size, row->value_size,
+            row->capacity, row->elems, row->load_factor, dist, std_ns);
+    fprintf(out, "u_map,%s,%zu,%zu,%zu,%zu,%.2f,%s,%.2f,%.2f\n", op, row->key_size, row->value_size,
+            row->capacity, row->elems, row->load_factor, dist, u_map_ns, std_ns / u_map_ns);
+    fflush(out);
+}
+
+//================================================================================
+//                        Одна конфигурация
+//================================================================================
+
+template <size_t KS, size_t VS>
+struct bench_set_t {
+    typedef bench_key_t<KS>   key_t;
+    typedef bench_value_t<VS> value_t;
+    typedef std::unordered_map<key_t, value_t, std_hash_t<KS>, std_eq_t<KS>> std_map_t;
+
+    // Пара в формате read_arr_to_u_map: значение после ключа, выровненного под value
+    struct pair_t {
+        key_t   key;
+        value_t value;
+    };
+};
+
+template <size_t KS, size_t VS>
+static void run_config(const suite_opts_t* opts, size_t capacity, double load_factor, size_t lookups) {
+    typedef typename bench_set_t<KS, VS>::key_t     key_t;
+    typedef typename bench_set_t<KS, VS>::value_t   value_t;
+    typedef typename bench_set_t<KS, VS>::std_map_t std_map_t;
+    typedef typename bench_set_t<KS, VS>::pair_t    pair_t;
+
+    const size_t elems = (size_t)((double)capacity * load_factor);
+    const size_t bytes = u_map_required_bytes(capacity, KS, alignof(key_t), VS, alignof(value_t));
+    if (elems == 0 || 3 * bytes + elems * (sizeof(pair_t) + 64) > MEMORY_BUDGET) return;
+
+    bench_row_t row = {KS, VS, capacity, elems, load_factor};
+
+    // Вставляемые ключи — нечетные, ключи промахов — четные
+    key_t*   keys   = (key_t*)  malloc(elems * sizeof(key_t));
+    key_t*   misses = (key_t*)  malloc(lookups * sizeof(key_t));
+    size_t*  query  = (size_t*) malloc(lookups * sizeof(size_t));
+    pair_t*  pairs  = (pair_t*) malloc(elems * sizeof(pair_t));
+    void*    buffer = aligned_alloc(64, (bytes + 63) / 64 * 64);
+    if (!keys || !misses || !query || !pairs || !buffer) {
+        fprintf(stderr, "bench_suite: out of memory at capacity %zu\n", capacity);
+        exit(1);
+    }
+
+    uint64_t state = opts->seed ^ (capacity * 31 + KS * 7 + VS);
+    for (size_t i = 0; i < elems; ++i) {
+        keys[i] = make_key<KS>(splitmix64(&state) | 1);
+        pairs[i].key   = keys[i];
+        pairs[i].value = make_value<VS>(i);
+    }
+    for (size_t i = 0; i < lookups; ++i) misses[i] = make_key<KS>(splitmix64(&state) & ~(uint64_t)1);
+
+    const value_t value = make_value<VS>(42);
+    value_t out = {};
+    volatile uint64_t sink = 0;
+
+    //--------------------------------------------------------------------------
+    // insert: таблица нужного размера заполняется до load_factor
+
+    std_map_t std_map;
+    std_map.reserve(elems);
+    double start = now_sec();
+    for (size_t i = 0; i < elems; ++i) std_map.emplace(keys[i], value);
+    const double std_insert = (now_sec() - start) * 1e9 / (double)elems;
+
+    u_map_t map = {};
+    u_map_static_init(&map, buffer, capacity, KS, alignof(key_t), VS, alignof(value_t), hash_key<KS>, cmp_key<KS>);
+    start = now_sec();
+    for (size_t i = 0; i < elems; ++i) u_map_insert_elem(&map, &keys[i], &value);
+    const double u_map_insert = (now_sec() - start) * 1e9 / (double)elems;
+
+    emit(opts->out, &row, "insert", "-", std_insert, u_map_insert);
+
+    //--------------------------------------------------------------------------
+    // hit / miss lookup и churn для каждого распределения
+
+    const dist_t dists[] = {DIST_UNIFORM, DIST_ZIPF};
+    for (size_t d = 0; d < sizeof(dists) / sizeof(dists[0]); ++d) {
+        fill_queries(query, lookups, elems, dists[d], opts->seed + d);
+
+        start = now_sec();
+        for (size_t i = 0; i < lookups; ++i) {
+            auto it = std_map.find(keys[query[i]]);
+            if (it != std_map.end()) sink += it->second.words[0];
+        }
+        const double std_hit = (now_sec() - start) * 1e9 / (double)lookups;
+
+        start = now_sec();
+        for (size_t i = 0; i < lookups; ++i) {
+            if (u_map_get_elem(&map, &keys[query[i]], &out)) sink += out.words[0];
+        }
+        const double u_map_hit = (now_sec() - start) * 1e9 / (double)lookups;
+
+        emit(opts->out, &row, "hit_lookup", dist_name(dists[d]), std_hit, u_map_hit);
+
+        // churn: поиск, удаление и возврат ключа — размер таблицы не меняется
+        const size_t churn_ops = lookups / 3;
+        start = now_sec();
+        for (size_t i = 0; i < churn_ops; ++i) {
+            auto it = std_map.find(keys[query[i]]);
+            if (it != std_map.end()) sink += it->second.words[0];
+            const key_t& victim = keys[query[churn_ops + i]];
+            std_map.erase(victim);
+            std_map.emplace(victim, value);
+        }
+        const double std_churn = (now_sec() - start) * 1e9 / (double)(churn_ops * 3);
+
+        start = now_sec();
+        for (size_t i = 0; i < churn_ops; ++i) {
+            if (u_map_get_elem(&map, &keys[query[i]], &out)) sink += out.words[0];
+            const key_t& victim = keys[query[churn_ops + i]];
+            u_map_remove_elem(&map, &victim, nullptr);
+            u_map_insert_elem(&map, &victim, &value);
+        }
+        const double u_map_churn = (now_sec() - start) * 1e9 / (double)(churn_ops * 3);
+
+        emit(opts->out, &row, "churn", dist_name(dists[d]), std_churn, u_map_churn);
+    }
+
+    start = now_sec();
+    for (size_t i = 0; i < lookups; ++i) sink += std_map.count(misses[i]);
+    const double std_miss = (now_sec() - start) * 1e9 / (double)lookups;
+
+    start = now_sec();
+    for (size_t i = 0; i < lookups; ++i) sink += u_map_get_elem(&map, &misses[i], &out);
+    const double u_map_miss = (now_sec() - start) * 1e9 / (double)lookups;
+
+    emit(opts->out, &row, "miss_lookup", "uniform", std_miss, u_map_miss);
+
+    //--------------------------------------------------------------------------
+    // Копии: ns на элемент; у std обе строки — конструктор копирования
+
+    start = now_sec();
+    {
+        std_map_t copy(std_map);
+        sink += copy.size();
+    }
+    const double std_copy = (now_sec() - start) * 1e9 / (double)elems;
+
+    u_map_t copy = {};
+    start = now_sec();
+    u_map_smart_copy(&copy, &map);
+    u_map_destroy(&copy);
+    const double u_map_smart = (now_sec() - start) * 1e9 / (double)elems;
+    emit(opts->out, &row, "smart_copy", "-", std_copy, u_map_smart);
+
+    start = now_sec();
+    u_map_raw_copy(&copy, &map);
+    u_map_destroy(&copy);
+    const double u_map_raw = (now_sec() - start) * 1e9 / (double)elems;
+    emit(opts->out, &row, "raw_copy", "-", std_copy, u_map_raw);
+
+    //--------------------------------------------------------------------------
+    // remove: все ключи по очереди
+
+    start = now_sec();
+    for (size_t i = 0; i < elems; ++i) std_map.erase(keys[i]);
+    const double std_remove = (now_sec() - start) * 1e9 / (double)elems;
+
+    start = now_sec();
+    for (size_t i = 0; i < elems; ++i) u_map_remove_elem(&map, &keys[i], nullptr);
+    const double u_map_remove = (now_sec() - start) * 1e9 / (double)elems;
+
+    emit(opts->out, &row, "remove", "-", std_remove, u_map_remove);
+    u_map_destroy(&map);
+
+    //--------------------------------------------------------------------------
+    // bulk load из массива пар в пустую динамическую таблицу
+
+    start = now_sec();
+    {
+        std_map_t bulk;
+        bulk.reserve(elems);
+        for (size_t i = 0; i < elems; ++i) bulk.emplace(pairs[i].key, pairs[i].value);
+        sink += bulk.size();
+    }
+    const double std_bulk = (now_sec() - start) * 1e9 / (double)elems;
+
+    u_map_t bulk = {};
+    u_map_init(&bulk, 0, KS, alignof(key_t), VS, alignof(value_t), hash_key<KS>, cmp_key<KS>);
+    start = now_sec();
+    read_arr_to_u_map(&bulk, pairs, elems);
+    u_map_destroy(&bulk);
+    const double u_map_bulk = (now_sec() - start) * 1e9 / (double)elems;
+    emit(opts->out, &row, "bulk_load", "-", std_bulk, u_map_bulk);
+
+    (void)sink;
+    free(keys);
+    free(misses);
+    free(query);
+    free(pairs);
+    free(buffer);
+}
+
+template <size_t KS, size_t VS>
+static void run_sizes(const suite_opts_t* opts) {
+    // 1K слотов — L1, 32K — L2, 1M — около LLC, 8M и 32M — далеко за LLC
+    const size_t quick_caps[]   = {(size_t)1 << 10, (size_t)1 << 16, (size_t)1 << 20};
+    const size_t default_caps[] = {(size_t)1 << 10, (size_t)1 << 15, (size_t)1 << 20, (size_t)1 << 23};
+    const size_t large_caps[]   = {(size_t)1 << 10, (size_t)1 << 15, (size_t)1 << 20, (size_t)1 << 23,
+                                   (size_t)1 << 25};
+
+    const size_t* caps = opts->large ? large_caps : opts->quick ? quick_caps : default_caps;
+    const size_t  caps_count = opts->large ? sizeof(large_caps)   / sizeof(large_caps[0])
+                             : opts->quick ? sizeof(quick_caps)   / sizeof(quick_caps[0])
+                                           : sizeof(default_caps) / sizeof(default_caps[0]);
+    const size_t lookups = opts->quick ? 300000 : 3000000;
+
+    for (size_t c = 0; c < caps_count; ++c) {
+        for (size_t l = 0; l < sizeof(LOAD_FACTORS) / sizeof(LOAD_FACTORS[0]); ++l) {
+            run_config<KS, VS>(opts, caps[c], LOAD_FACTORS[l], lookups);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    suite_opts_t opts = {};
+    opts.seed = 0x2545F4914F6CDD1DULL;
+    opts.out  = stdout;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--quick") == 0) {
+            opts.quick = true;
+        } else if (strcmp(argv[i], "--large") == 0) {
+            opts.large = true;
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            opts.seed = strtoull(argv[++i], nullptr, 0);
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            opts.out = fopen(argv[++i], "w");
+            if (!opts.out) {
+                perror("bench_suite: --out");
+                return 1;
+            }
+        } else {
+            fprintf(stderr, "usage: %s [--quick] [--large] [--seed N] [--out file.csv]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    emit_header(opts.out);
+
+    run_sizes<8, 8>(&opts);
+    run_sizes<16, 32>(&opts);
+    if (!opts.quick) {
+        run_sizes<8,  128>(&opts);
+        run_sizes<32, 8>(&opts);
+        run_sizes<32, 128>(&opts);
+    }
+
+    if (opts.out != stdout) fclose(opts.out);
+    return 0;
+}
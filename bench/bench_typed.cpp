@@ -0,0 +1,112 @@
+#include "unordered_map.h"
+#include "u_map.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+//================================================================================
+//        C API (указатели на функции, memcpy) против шаблона u_map<K, V>
+//================================================================================
+
+static const size_t KEYS    = 4u << 20;
+static const size_t LOOKUPS = 20000000;
+
+static size_t hash_u64(const void* key) {
+    uint64_t x = 0;
+    memcpy(&x, key, sizeof(x));
+    return (size_t)x;
+}
+
+static bool cmp_u64(const void* a, const void* b) {
+    return *(const uint64_t*)a == *(const uint64_t*)b;
+}
+
+struct hash_u64_t {
+    size_t operator()(uint64_t key) const { return (size_t)key; }
+};
+
+static uint64_t xorshift64(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+static double now_sec() {
+    struct timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void report(const char* name, double insert_sec, double lookup_sec, double remove_sec, uint64_t sum) {
+    printf("%-8s  insert %6.1f ns/op   lookup %6.1f ns/op   remove %6.1f ns/op   (sum %llu)\n", name,
+           insert_sec * 1e9 / KEYS, lookup_sec * 1e9 / LOOKUPS, remove_sec * 1e9 / KEYS, (unsigned long long)sum);
+}
+
+int main() {
+    uint64_t* keys    = (uint64_t*)calloc(KEYS,    sizeof(uint64_t));
+    uint64_t* queries = (uint64_t*)calloc(LOOKUPS, sizeof(uint64_t));
+    if (!keys || !queries) return 1;
+
+    // Половина запросов — промахи
+    uint64_t state = 0x2545F4914F6CDD1DULL;
+    for (size_t i = 0; i < KEYS; ++i)    keys[i]    = xorshift64(&state);
+    for (size_t i = 0; i < LOOKUPS; ++i) queries[i] = (i & 1) ? keys[xorshift64(&state) % KEYS] : xorshift64(&state);
+
+    printf("keys %zu, lookups %zu\n", KEYS, LOOKUPS);
+
+    {
+        u_map_t map = {};
+        SIMPLE_U_MAP_INIT(&map, 0, uint64_t, uint64_t, hash_u64, cmp_u64);
+
+        double start = now_sec();
+        for (size_t i = 0; i < KEYS; ++i) u_map_insert_elem(&map, &keys[i], &keys[i]);
+        const double insert_sec = now_sec() - start;
+
+        uint64_t sum = 0;
+        start = now_sec();
+        for (size_t i = 0; i < LOOKUPS; ++i) {
+            uint64_t value = 0;
+            if (u_map_get_elem(&map, &queries[i], &value)) sum += value;
+        }
+        const double lookup_sec = now_sec() - start;
+
+        start = now_sec();
+        for (size_t i = 0; i < KEYS; ++i) u_map_remove_elem(&map, &keys[i], nullptr);
+        const double remove_sec = now_sec() - start;
+
+        report("C API", insert_sec, lookup_sec, remove_sec, sum);
+        u_map_destroy(&map);
+    }
+
+    {
+        u_map<uint64_t, uint64_t, hash_u64_t> map;
+
+        double start = now_sec();
+        for (size_t i = 0; i < KEYS; ++i) map.insert(keys[i], keys[i]);
+        const double insert_sec = now_sec() - start;
+
+        uint64_t sum = 0;
+        start = now_sec();
+        for (size_t i = 0; i < LOOKUPS; ++i) {
+            const uint64_t* value = map.get(queries[i]);
+            if (value != nullptr) sum += *value;
+        }
+        const double lookup_sec = now_sec() - start;
+
+        start = now_sec();
+        for (size_t i = 0; i < KEYS; ++i) map.remove(keys[i]);
+        const double remove_sec = now_sec() - start;
+
+        report("u_map<>", insert_sec, lookup_sec, remove_sec, sum);
+    }
+
+    free(keys);
+    free(queries);
+    return 0;
+}
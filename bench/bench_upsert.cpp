@@ -0,0 +1,158 @@
+#include "unordered_map.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+//================================================================================
+//   Счетчики и большие значения: get + insert против try_emplace / get_ptr
+//================================================================================
+
+static const size_t KEYS    = 1u << 16;
+static const size_t UPDATES = 1u << 23;
+static const int    ROUNDS  = 3;
+
+// Агрегат на 256 байт: копирование значения туда и обратно дороже самого поиска
+typedef struct stats_value_t {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t hist[30];
+} stats_value_t;
+
+static size_t hash_u64(const void* key) {
+    uint64_t x = 0;
+    memcpy(&x, key, sizeof(x));
+    return (size_t)x;
+}
+
+static bool cmp_u64(const void* a, const void* b) {
+    return *(const uint64_t*)a == *(const uint64_t*)b;
+}
+
+static uint64_t xorshift64(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+static double now_sec() {
+    struct timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static bool init_map(u_map_t* map, size_t value_size) {
+    return u_map_init(map, 0, sizeof(uint64_t), alignof(uint64_t), value_size, alignof(uint64_t),
+                      hash_u64, cmp_u64) == HM_ERR_OK;
+}
+
+//--------------------------------------------------------------------------------
+// Счетчик uint64_t
+//--------------------------------------------------------------------------------
+
+static uint64_t counter_get_insert(u_map_t* map) {
+    uint64_t state = 0x2545F4914F6CDD1DULL;
+    for (size_t i = 0; i < UPDATES; ++i) {
+        const uint64_t key = xorshift64(&state) & (KEYS - 1);
+        uint64_t count = 0;
+        u_map_get_elem(map, &key, &count);
+        ++count;
+        u_map_insert_elem(map, &key, &count);
+    }
+    return u_map_size(map);
+}
+
+static uint64_t counter_try_emplace(u_map_t* map) {
+    uint64_t state = 0x2545F4914F6CDD1DULL;
+    for (size_t i = 0; i < UPDATES; ++i) {
+        const uint64_t key = xorshift64(&state) & (KEYS - 1);
+        uint64_t* count = nullptr;
+        u_map_try_emplace(map, &key, nullptr, (void**)&count, nullptr);
+        ++*count;
+    }
+    return u_map_size(map);
+}
+
+//--------------------------------------------------------------------------------
+// Большое значение
+//--------------------------------------------------------------------------------
+
+static void stats_add(stats_value_t* value, uint64_t sample) {
+    value->count++;
+    value->sum += sample;
+    value->hist[sample % 30]++;
+}
+
+static uint64_t big_get_insert(u_map_t* map) {
+    uint64_t state = 0x2545F4914F6CDD1DULL;
+    stats_value_t value = {};
+    for (size_t i = 0; i < UPDATES; ++i) {
+        const uint64_t sample = xorshift64(&state);
+        const uint64_t key = sample & (KEYS - 1);
+        if (!u_map_get_elem(map, &key, &value)) memset(&value, 0, sizeof(value));
+        stats_add(&value, sample >> 32);
+        u_map_insert_elem(map, &key, &value);
+    }
+    return u_map_size(map);
+}
+
+static uint64_t big_try_emplace(u_map_t* map) {
+    uint64_t state = 0x2545F4914F6CDD1DULL;
+    for (size_t i = 0; i < UPDATES; ++i) {
+        const uint64_t sample = xorshift64(&state);
+        const uint64_t key = sample & (KEYS - 1);
+        stats_value_t* value = nullptr;
+        u_map_try_emplace(map, &key, nullptr, (void**)&value, nullptr);
+        stats_add(value, sample >> 32);
+    }
+    return u_map_size(map);
+}
+
+// Только обновление существующих ключей: get_ptr вообще не вызывает normalize_capacity
+static uint64_t big_get_ptr(u_map_t* map) {
+    uint64_t state = 0x2545F4914F6CDD1DULL;
+    for (size_t i = 0; i < UPDATES; ++i) {
+        const uint64_t sample = xorshift64(&state);
+        const uint64_t key = sample & (KEYS - 1);
+        stats_value_t* value = (stats_value_t*)u_map_get_ptr(map, &key);
+        if (value != nullptr) stats_add(value, sample >> 32);
+    }
+    return u_map_size(map);
+}
+
+typedef uint64_t (*workload_t)(u_map_t* map);
+
+static void run(const char* name, size_t value_size, workload_t workload, bool prefill) {
+    double best = 1e9;
+    uint64_t size = 0;
+    for (int r = 0; r < ROUNDS; ++r) {
+        u_map_t map = {};
+        if (!init_map(&map, value_size)) return;
+        if (prefill) {
+            for (uint64_t key = 0; key < KEYS; ++key) u_map_try_emplace(&map, &key, nullptr, nullptr, nullptr);
+        }
+
+        const double start = now_sec();
+        size = workload(&map);
+        const double sec = now_sec() - start;
+        if (sec < best) best = sec;
+        u_map_destroy(&map);
+    }
+    printf("%-28s  value %3zu B  %6.1f ns/update  (%llu keys)\n", name, value_size,
+           best * 1e9 / (double)UPDATES, (unsigned long long)size);
+}
+
+int main() {
+    printf("keys %zu, updates %zu, best of %d\n", KEYS, UPDATES, ROUNDS);
+    run("counter get+insert",      sizeof(uint64_t),      counter_get_insert,  false);
+    run("counter try_emplace",     sizeof(uint64_t),      counter_try_emplace, false);
+    run("aggregate get+insert",    sizeof(stats_value_t), big_get_insert,      false);
+    run("aggregate try_emplace",   sizeof(stats_value_t), big_try_emplace,     false);
+    run("aggregate get_ptr (hot)", sizeof(stats_value_t), big_get_ptr,         true);
+    return 0;
+}
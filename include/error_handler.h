@@ -9,7 +9,9 @@ enum hm_error_t {
     HM_ERR_FULL,        
     HM_ERR_BAD_ARG,     
     HM_ERR_NOT_FOUND,  
-    HM_ERR_INTERNAL 
+    HM_ERR_INTERNAL,
+    HM_ERR_IO,           // файл не открылся / не записался
+    HM_ERR_READ_ONLY     // таблица открыта из файла только для чтения
 };
  
 #define RETURN_IF_ERROR(error_, ...)                       \
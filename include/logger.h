@@ -9,7 +9,8 @@ enum logger_mode_type {
     LOGGER_MODE_DEBUG = 0,
     LOGGER_MODE_INFO  = 1,
     LOGGER_MODE_WARNING = 2,
-    LOGGER_MODE_ERROR = 3
+    LOGGER_MODE_ERROR = 3,
+    LOGGER_MODE_OFF = 4        // только для logger_set_level: не писать ничего
 };
 
 enum logger_output_type {
@@ -17,31 +18,57 @@ enum logger_output_type {
     OWNED_FILE = 1
 };
 
+// Сообщение — запись фиксированного размера: id формата (адрес строкового литерала) и аргументы.
+// Поток пишет записи в свое кольцо без блокировок, форматирует и выводит их фоновый поток.
+// Аргументы %s копируются в запись, не длиннее LOGGER_TEXT_BYTES на сообщение
+#define LOGGER_MAX_ARGS      8
+#define LOGGER_TEXT_BYTES    96
+#define LOGGER_RING_RECORDS  1024   // на поток; при переполнении сообщения теряются и считаются
+
 //==============================================================================
 
 void logger_initialize_stream(FILE *stream); /* nullptr => stderr */
-int  logger_initialize_file(const char *path); 
+int  logger_initialize_file(const char *path);
 void logger_close();
 
+// Порог во время работы, без пересборки. Начальное значение — из переменной окружения
+// HASH_MAP_LOG_LEVEL (debug / info / warning / error / off), по умолчанию debug
+void logger_set_level(logger_mode_type mode);
+logger_mode_type logger_get_level();
+
+// Дождаться, пока фоновый поток выведет все уже записанные сообщения
+void logger_flush();
+
 //------------------------------------------------------------------------------
 
+// format — строковый литерал: запись хранит только указатель на него
 void logger_log_message(logger_mode_type mode,
                         const char *file, int line,
-                        const char *format, ...);
+                        const char *format, ...) __attribute__((format(printf, 4, 5)));
 
+extern int logger_level;
+
+static inline bool logger_enabled(logger_mode_type mode) {
+    return (int)mode >= __atomic_load_n(&logger_level, __ATOMIC_RELAXED);
+}
 
 //==============================================================================
 
 #ifdef HASH_MAP_LOGGER_ALL
-#define LOGGER_DEBUG(...)   logger_log_message(LOGGER_MODE_DEBUG,   __FILE__, __LINE__, __VA_ARGS__)
-#define LOGGER_INFO(...)    logger_log_message(LOGGER_MODE_INFO,    __FILE__, __LINE__, __VA_ARGS__)
-#define LOGGER_WARNING(...) logger_log_message(LOGGER_MODE_WARNING, __FILE__, __LINE__, __VA_ARGS__)
-#define LOGGER_ERROR(...)   logger_log_message(LOGGER_MODE_ERROR,   __FILE__, __LINE__, __VA_ARGS__)
+#define LOGGER_MESSAGE_(mode, ...)                                                 \
+    do {                                                                           \
+        if (logger_enabled(mode)) logger_log_message(mode, __FILE__, __LINE__, __VA_ARGS__); \
+    } while (0)
+
+#define LOGGER_DEBUG(...)   LOGGER_MESSAGE_(LOGGER_MODE_DEBUG,   __VA_ARGS__)
+#define LOGGER_INFO(...)    LOGGER_MESSAGE_(LOGGER_MODE_INFO,    __VA_ARGS__)
+#define LOGGER_WARNING(...) LOGGER_MESSAGE_(LOGGER_MODE_WARNING, __VA_ARGS__)
+#define LOGGER_ERROR(...)   LOGGER_MESSAGE_(LOGGER_MODE_ERROR,   __VA_ARGS__)
 #else
-#define LOGGER_DEBUG(...)   
-#define LOGGER_INFO(...)    
+#define LOGGER_DEBUG(...)
+#define LOGGER_INFO(...)
 #define LOGGER_WARNING(...)
-#define LOGGER_ERROR(...)  
+#define LOGGER_ERROR(...)
 #endif
 
-#endif
\ No newline at end of file
+#endif
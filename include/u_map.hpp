@@ -0,0 +1,399 @@
+#ifndef U_MAP_HPP_INCLUDED
+#define U_MAP_HPP_INCLUDED
+
+#include <new>
+#include <utility>
+#include <functional>
+#include <type_traits>
+
+#include <string.h>
+
+#include "unordered_map.h"
+#include "u_map_group.h"
+#include "asserts.h"
+
+//================================================================================
+//      Типизированная swiss-таблица: тот же алгоритм и раскладка, что у u_map_t
+//================================================================================
+
+// Hash и Eq — функторы времени компиляции, шаги слотов — sizeof(K) / sizeof(V),
+// поэтому проход по группе целиком встраивается компилятором. Ключи и значения
+// конструируются и перемещаются на месте, так что подходят и нетривиальные типы.
+// Исключение из конструктора K / V или из Hash не оставляет утечек: вставка и copy_from
+// разрушают построенное, а рехэш оставляет таблицу прежней, если перемещение K и V
+// noexcept или они копируются (иначе, как у std::vector, гарантия только базовая)
+// Раскладка буфера: [keys][values][states], capacity — степень двойки, не меньше группы
+template <typename K, typename V, typename Hash = std::hash<K>, typename Eq = std::equal_to<K>>
+class u_map {
+  public:
+    static constexpr size_t KEY_STRIDE   = sizeof(K);
+    static constexpr size_t VALUE_STRIDE = sizeof(V);
+
+    u_map() noexcept(std::is_nothrow_default_constructible<Hash>::value &&
+                     std::is_nothrow_default_constructible<Eq>::value)
+        : data_(nullptr), keys_(nullptr), values_(nullptr), states_(nullptr),
+          size_(0), occupied_(0), capacity_(0), hash_(), eq_() {}
+
+    explicit u_map(const Hash& hash, const Eq& eq = Eq())
+        : data_(nullptr), keys_(nullptr), values_(nullptr), states_(nullptr),
+          size_(0), occupied_(0), capacity_(0), hash_(hash), eq_(eq) {}
+
+    ~u_map() { release(); }
+
+    // Копирование может не получить память — только явно, через copy_from
+    u_map(const u_map&)            = delete;
+    u_map& operator=(const u_map&) = delete;
+
+    u_map(u_map&& other) noexcept
+        : data_(other.data_), keys_(other.keys_), values_(other.values_), states_(other.states_),
+          size_(other.size_), occupied_(other.occupied_), capacity_(other.capacity_),
+          hash_(std::move(other.hash_)), eq_(std::move(other.eq_)) {
+        other.forget();
+    }
+
+    u_map& operator=(u_map&& other) noexcept {
+        if (this != &other) {
+            release();
+            data_     = other.data_;
+            keys_     = other.keys_;
+            values_   = other.values_;
+            states_   = other.states_;
+            size_     = other.size_;
+            occupied_ = other.occupied_;
+            capacity_ = other.capacity_;
+            hash_     = std::move(other.hash_);
+            eq_       = std::move(other.eq_);
+            other.forget();
+        }
+        return *this;
+    }
+
+    size_t size()     const { return size_; }
+    size_t capacity() const { return capacity_; }
+    bool   is_empty() const { return size_ == 0; }
+
+    //--------------------------------------------------------------------------
+
+    const V* get(const K& key) const {
+        size_t idx = 0;
+        return find(key, hash_key(key), &idx) ? &values_[idx] : nullptr;
+    }
+
+    V* get(const K& key) {
+        size_t idx = 0;
+        return find(key, hash_key(key), &idx) ? &values_[idx] : nullptr;
+    }
+
+    bool contains(const K& key) const {
+        size_t idx = 0;
+        return find(key, hash_key(key), &idx);
+    }
+
+    // Как u_map_insert_elem: существующий ключ получает новое значение
+    template <typename KK, typename VV>
+    hm_error_t insert(KK&& key, VV&& value) {
+        return emplace(std::forward<KK>(key), std::forward<VV>(value));
+    }
+
+    // Новое значение строится из args прямо в слоте, у существующего ключа — присваивается
+    template <typename KK, typename... Args>
+    hm_error_t emplace(KK&& key, Args&&... args) {
+        hm_error_t err = normalize(false);
+        RETURN_IF_ERROR(err);
+
+        const size_t hash = hash_key(key);
+        size_t idx = 0;
+        if (find(key, hash, &idx)) {
+            values_[idx] = V(std::forward<Args>(args)...);
+            return HM_ERR_OK;
+        }
+
+        // Слот занимается только после обоих конструкторов: если бросит V, ключ разрушается здесь,
+        // а слот остается свободным
+        idx = find_free(hash);
+        new (&keys_[idx]) K(std::forward<KK>(key));
+        try {
+            new (&values_[idx]) V(std::forward<Args>(args)...);
+        } catch (...) {
+            keys_[idx].~K();
+            throw;
+        }
+        occupy(idx, hash);
+        return HM_ERR_OK;
+    }
+
+    // Как u_map_remove_elem; value_out получает значение перемещением
+    hm_error_t remove(const K& key, V* value_out = nullptr) {
+        hm_error_t err = normalize(true);
+        RETURN_IF_ERROR(err);
+
+        size_t idx = 0;
+        if (!find(key, hash_key(key), &idx)) return HM_ERR_NOT_FOUND;
+
+        if (value_out != nullptr) *value_out = std::move(values_[idx]);
+        erase(idx);
+        return HM_ERR_OK;
+    }
+
+    hm_error_t reserve(size_t count) {
+        size_t need = (size_t)((double)count / MAX_LOAD_FACTOR) + 1;
+        if (need < count) return HM_ERR_BAD_ARG;
+        need = next_pow2(need);
+
+        if (need <= capacity_) return HM_ERR_OK;
+        return rehash(need);
+    }
+
+    // Удаляет все элементы, буфер остается
+    void clear() {
+        destroy_elems();
+        if (states_ != nullptr) memset(states_, EMPTY, capacity_);
+        size_     = 0;
+        occupied_ = 0;
+    }
+
+    // Аналог u_map_smart_copy: та же емкость, слоты на тех же местах
+    hm_error_t copy_from(const u_map& source) {
+        if (this == &source) return HM_ERR_OK;
+
+        release();
+        hash_ = source.hash_;
+        eq_   = source.eq_;
+        if (source.capacity_ == 0) return HM_ERR_OK;
+
+        hm_error_t err = allocate(source.capacity_);
+        RETURN_IF_ERROR(err);
+
+        // Слот помечается занятым сразу после своей пары: если копия бросит, release разрушит
+        // ровно то, что уже построено
+        try {
+            for (size_t idx = 0; idx < capacity_; ++idx) {
+                if (!u_map_ctrl_is_full(source.states_[idx])) continue;
+                construct(idx, source.keys_[idx], source.values_[idx]);
+                states_[idx] = source.states_[idx];
+            }
+        } catch (...) {
+            release();
+            throw;
+        }
+        memcpy(states_, source.states_, capacity_);
+        size_     = source.size_;
+        occupied_ = source.occupied_;
+        return HM_ERR_OK;
+    }
+
+  private:
+    static constexpr size_t INITIAL_CAPACITY        = 32;
+    static constexpr double MAX_LOAD_FACTOR         = 0.7;
+    static constexpr double MIN_LOAD_FACTOR         = MAX_LOAD_FACTOR / 4.0;
+    static constexpr double MAX_GARBAGE_LOAD_FACTOR = 0.25;
+
+    static_assert(INITIAL_CAPACITY >= U_MAP_GROUP_WIDTH, "capacity must cover at least one group");
+    static_assert(alignof(K) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__ &&
+                  alignof(V) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__, "over-aligned keys/values are not supported");
+
+    void*    data_;
+    K*       keys_;
+    V*       values_;
+    uint8_t* states_;
+
+    size_t   size_;
+    size_t   occupied_;
+    size_t   capacity_;
+
+    Hash     hash_;
+    Eq       eq_;
+
+    static size_t next_pow2(size_t n) {
+        size_t p2 = 1;
+        while (p2 < n) p2 <<= 1;
+        return p2;
+    }
+
+    static size_t values_offset(size_t capacity) {
+        const size_t keys_bytes = capacity * KEY_STRIDE;
+        const size_t rem        = keys_bytes % alignof(V);
+        return rem == 0 ? keys_bytes : keys_bytes + (alignof(V) - rem);
+    }
+
+    static size_t states_offset(size_t capacity) {
+        return values_offset(capacity) + capacity * VALUE_STRIDE;
+    }
+
+    size_t hash_key(const K& key) const {
+        return u_map_mix_hash((size_t)hash_(key));
+    }
+
+    size_t groups_mask() const {
+        return capacity_ / U_MAP_GROUP_WIDTH - 1;
+    }
+
+    //--------------------------------------------------------------------------
+
+    bool find(const K& key, size_t hash, size_t* idx_out) const {
+        if (capacity_ == 0) return false;
+
+        const uint8_t h2 = u_map_hash_h2(hash);
+        u_map_probe_seq_t seq = u_map_probe_seq_start(hash, groups_mask());
+        do {
+            const size_t   base = seq.group * U_MAP_GROUP_WIDTH;
+            const uint8_t* ctrl = states_ + base;
+
+            for (u_map_group_mask_t match = u_map_group_match(ctrl, h2); match != 0; match &= match - 1) {
+                const size_t idx = base + u_map_mask_lowest_bit(match);
+                if (eq_(keys_[idx], key)) {
+                    *idx_out = idx;
+                    return true;
+                }
+            }
+
+            if (u_map_group_match_empty(ctrl) != 0) return false;
+        } while (u_map_probe_seq_next(&seq));
+
+        return false;
+    }
+
+    // Вызывается после normalize: свободный слот на пути ключа гарантированно есть
+    size_t find_free(size_t hash) const {
+        u_map_probe_seq_t seq = u_map_probe_seq_start(hash, groups_mask());
+        do {
+            const size_t base = seq.group * U_MAP_GROUP_WIDTH;
+            const u_map_group_mask_t free_mask = u_map_group_match_empty_or_deleted(states_ + base);
+            if (free_mask != 0) return base + u_map_mask_lowest_bit(free_mask);
+        } while (u_map_probe_seq_next(&seq));
+
+        HARD_ASSERT(false, "no free slot after normalize");
+        return 0;
+    }
+
+    void occupy(size_t idx, size_t hash) {
+        if (states_[idx] == EMPTY) occupied_++;
+        states_[idx] = u_map_hash_h2(hash);
+        size_++;
+    }
+
+    void erase(size_t idx) {
+        keys_[idx].~K();
+        values_[idx].~V();
+        size_--;
+
+        // Если в группе уже есть EMPTY, поиск через неё все равно остановится — надгробие не нужно
+        const uint8_t* group = states_ + (idx / U_MAP_GROUP_WIDTH) * U_MAP_GROUP_WIDTH;
+        if (u_map_group_match_empty(group) != 0) {
+            states_[idx] = EMPTY;
+            occupied_--;
+        } else {
+            states_[idx] = DELETED;
+        }
+    }
+
+    //--------------------------------------------------------------------------
+
+    hm_error_t allocate(size_t capacity) {
+        void* data = ::operator new(states_offset(capacity) + capacity, std::nothrow);
+        if (data == nullptr) return HM_ERR_MEM_ALLOC;
+
+        data_     = data;
+        keys_     = (K*)data;
+        values_   = (V*)(void*)((unsigned char*)data + values_offset(capacity));
+        states_   = (uint8_t*)data + states_offset(capacity);
+        capacity_ = capacity;
+        size_     = 0;
+        occupied_ = 0;
+        memset(states_, EMPTY, capacity);
+        return HM_ERR_OK;
+    }
+
+    // Ключ и значение в свободный слот idx; если бросит V, уже построенный ключ разрушается
+    template <typename KK, typename VV>
+    void construct(size_t idx, KK&& key, VV&& value) {
+        new (&keys_[idx]) K(std::forward<KK>(key));
+        try {
+            new (&values_[idx]) V(std::forward<VV>(value));
+        } catch (...) {
+            keys_[idx].~K();
+            throw;
+        }
+    }
+
+    // Переносит элементы в новый буфер; надгробия при этом пропадают. Перемещает, только если
+    // перемещение не бросает (std::move_if_noexcept), иначе копирует: тогда исключение посреди
+    // переноса оставляет таблицу прежней
+    hm_error_t rehash(size_t new_capacity) {
+        LOGGER_DEBUG("u_map<>: changing capacity from %zu to %zu", capacity_, new_capacity);
+
+        u_map old(std::move(*this));
+        hash_ = old.hash_;
+        eq_   = old.eq_;
+
+        hm_error_t err = allocate(new_capacity);
+        if (err != HM_ERR_OK) {
+            *this = std::move(old);
+            return err;
+        }
+
+        try {
+            for (size_t idx = 0; idx < old.capacity_; ++idx) {
+                if (!u_map_ctrl_is_full(old.states_[idx])) continue;
+
+                const size_t hash = hash_key(old.keys_[idx]);
+                const size_t dst  = find_free(hash);
+                construct(dst, std::move_if_noexcept(old.keys_[idx]), std::move_if_noexcept(old.values_[idx]));
+                occupy(dst, hash);
+            }
+        } catch (...) {
+            release();
+            *this = std::move(old);
+            throw;
+        }
+        return HM_ERR_OK;
+    }
+
+    // Те же пороги, что у normalize_capacity в C API
+    hm_error_t normalize(bool allow_shrink) {
+        if (capacity_ == 0) return allow_shrink ? HM_ERR_OK : rehash(INITIAL_CAPACITY);
+
+        const double load_occupied = (double)occupied_           / (double)capacity_;
+        const double load_real     = (double)size_               / (double)capacity_;
+        const double load_garbage  = (double)(occupied_ - size_) / (double)capacity_;
+
+        if (allow_shrink && capacity_ > INITIAL_CAPACITY && load_real < MIN_LOAD_FACTOR) {
+            return rehash(capacity_ / 2);
+        }
+        if (load_occupied > MAX_LOAD_FACTOR) {
+            const bool is_garbage = load_real < MAX_LOAD_FACTOR && load_garbage > MAX_GARBAGE_LOAD_FACTOR;
+            return rehash(is_garbage ? capacity_ : capacity_ * 2);
+        }
+        return HM_ERR_OK;
+    }
+
+    //--------------------------------------------------------------------------
+
+    void destroy_elems() {
+        if (std::is_trivially_destructible<K>::value && std::is_trivially_destructible<V>::value) return;
+
+        for (size_t idx = 0; idx < capacity_; ++idx) {
+            if (!u_map_ctrl_is_full(states_[idx])) continue;
+            keys_[idx].~K();
+            values_[idx].~V();
+        }
+    }
+
+    void release() {
+        destroy_elems();
+        ::operator delete(data_);
+        forget();
+    }
+
+    void forget() {
+        data_     = nullptr;
+        keys_     = nullptr;
+        values_   = nullptr;
+        states_   = nullptr;
+        size_     = 0;
+        occupied_ = 0;
+        capacity_ = 0;
+    }
+};
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef U_MAP_ALLOC_H_INCLUDED
+#define U_MAP_ALLOC_H_INCLUDED
+
+#include "unordered_map.h"
+
+//================================================================================
+//                 Встроенные аллокаторы для u_map_init_with_allocator
+//================================================================================
+
+// Арена: память берется подряд из буфера пользователя и возвращается вся сразу
+// (u_map_arena_reset или просто выброшенный буфер). Освободить и расширить на месте
+// можно только последний выделенный блок, остальные освобождения ничего не делают —
+// растущей таблице нужно примерно вдвое больше места, чем ее итоговый буфер
+// (или u_map_reserve сразу). Арена не потокобезопасна
+typedef struct u_map_arena_t {
+    unsigned char* base;
+    size_t         capacity;
+    size_t         used;
+    size_t         last;      // начало последнего блока
+} u_map_arena_t;
+
+void              u_map_arena_init     (u_map_arena_t* arena, void* buffer, size_t size);
+void              u_map_arena_reset    (u_map_arena_t* arena);
+u_map_allocator_t u_map_arena_allocator(u_map_arena_t* arena);
+
+// Большие блоки (от U_MAP_HUGE_PAGE_SIZE) — отдельные mmap, выровненные по 2 МБ,
+// с madvise(MADV_HUGEPAGE): прозрачные huge pages, меньше промахов TLB.
+// Меньшие — из обычной кучи. Флаги:
+// - U_MAP_MMAP_HUGETLB  — сначала пробовать MAP_HUGETLB (заранее зарезервированные
+//   страницы, vm.nr_hugepages); если их нет — как без флага
+// - U_MAP_MMAP_POPULATE — отобразить страницы сразу при выделении, а не при первом
+//   обращении: ошибки страниц уходят из горячего пути в рехэш / init
+#define U_MAP_HUGE_PAGE_SIZE ((size_t)2 << 20)
+
+enum {
+    U_MAP_MMAP_HUGETLB  = 1u << 0,
+    U_MAP_MMAP_POPULATE = 1u << 1,
+};
+
+u_map_allocator_t u_map_mmap_allocator(unsigned flags);
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef U_MAP_GROUP_H_INCLUDED
+#define U_MAP_GROUP_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "unordered_map.h"
+
+//================================================================================
+//       Общие примитивы swiss-таблицы: C API (unordered_map.cpp) и шаблон u_map.hpp
+//================================================================================
+
+// Битовая маска слотов группы: бит i <=> слот base + i
+typedef uint32_t u_map_group_mask_t;
+
+static inline bool u_map_ctrl_is_full(uint8_t ctrl) {
+    return (ctrl & 0x80) == 0;
+}
+
+#if defined(__SSE2__)
+
+static inline u_map_group_mask_t u_map_group_match(const uint8_t* ctrl, uint8_t h2) {
+    const __m128i group = _mm_loadu_si128((const __m128i*)(const void*)ctrl);
+    return (u_map_group_mask_t)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)h2)));
+}
+
+static inline u_map_group_mask_t u_map_group_match_empty(const uint8_t* ctrl) {
+    return u_map_group_match(ctrl, EMPTY);
+}
+
+// EMPTY и DELETED меньше SENTINEL как знаковые байты, занятые слоты (0..127) — больше
+static inline u_map_group_mask_t u_map_group_match_empty_or_deleted(const uint8_t* ctrl) {
+    const __m128i group = _mm_loadu_si128((const __m128i*)(const void*)ctrl);
+    return (u_map_group_mask_t)_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8((char)SENTINEL), group));
+}
+
+// Занятые слоты — единственные со сброшенным старшим битом (SENTINEL не попадает)
+static inline u_map_group_mask_t u_map_group_match_full(const uint8_t* ctrl) {
+    const __m128i group = _mm_loadu_si128((const __m128i*)(const void*)ctrl);
+    return (u_map_group_mask_t)_mm_movemask_epi8(group) ^ 0xFFFFu;
+}
+
+#else
+
+static inline u_map_group_mask_t u_map_group_match(const uint8_t* ctrl, uint8_t h2) {
+    u_map_group_mask_t mask = 0;
+    for (unsigned i = 0; i < U_MAP_GROUP_WIDTH; ++i) {
+        if (ctrl[i] == h2) mask |= (u_map_group_mask_t)1 << i;
+    }
+    return mask;
+}
+
+static inline u_map_group_mask_t u_map_group_match_empty(const uint8_t* ctrl) {
+    return u_map_group_match(ctrl, EMPTY);
+}
+
+static inline u_map_group_mask_t u_map_group_match_empty_or_deleted(const uint8_t* ctrl) {
+    u_map_group_mask_t mask = 0;
+    for (unsigned i = 0; i < U_MAP_GROUP_WIDTH; ++i) {
+        if (ctrl[i] == EMPTY || ctrl[i] == DELETED) mask |= (u_map_group_mask_t)1 << i;
+    }
+    return mask;
+}
+
+static inline u_map_group_mask_t u_map_group_match_full(const uint8_t* ctrl) {
+    u_map_group_mask_t mask = 0;
+    for (unsigned i = 0; i < U_MAP_GROUP_WIDTH; ++i) {
+        if (u_map_ctrl_is_full(ctrl[i])) mask |= (u_map_group_mask_t)1 << i;
+    }
+    return mask;
+}
+
+#endif
+
+static inline unsigned u_map_mask_lowest_bit(u_map_group_mask_t mask) {
+    return (unsigned)__builtin_ctz(mask);
+}
+
+//================================================================================
+//                        Хэширование и проход
+//================================================================================
+
+static const uint64_t U_MAP_GOLD_64               = 0x9e3779b97f4a7c15ULL;
+static const uint64_t U_MAP_BIG_RANDOM_EVEN_NUM_1 = 0xbf58476d1ce4e5b9ULL;
+static const uint64_t U_MAP_BIG_RANDOM_EVEN_NUM_2 = 0x94d049bb133111ebULL;
+
+static inline size_t u_map_mix_hash(size_t x) { // splitmix64
+    x += (size_t)U_MAP_GOLD_64;
+    x = (x ^ (x >> 30)) * (size_t)U_MAP_BIG_RANDOM_EVEN_NUM_1;
+    x = (x ^ (x >> 27)) * (size_t)U_MAP_BIG_RANDOM_EVEN_NUM_2;
+    x = x ^ (x >> 31);
+    return x;
+}
+
+// Слабый hash_func (тождество для целых) добивается splitmix64; сильный уже перемешан.
+// С солью перемешивается любой: иначе совпадения в битах группы не зависели бы от соли
+static inline size_t u_map_finish_hash(const u_map_t* u_map, size_t raw) {
+    if (u_map->seed == 0) return u_map->strong_hash ? raw : u_map_mix_hash(raw);
+    return u_map_mix_hash(raw ^ (size_t)u_map->seed);
+}
+
+// Младшие 7 бит хэша — отпечаток в управляющем байте (h2), группу выбирают биты над ними:
+// (hash >> 7) & groups_mask (h1)
+static inline size_t  u_map_hash_h1(size_t hash) { return hash >> 7; }
+static inline uint8_t u_map_hash_h2(size_t hash) { return (uint8_t)(hash & 0x7F); }
+
+// Треугольное пробирование по группам: при числе групп — степени двойки обходит все группы
+typedef struct u_map_probe_seq_t {
+    size_t group;
+    size_t index;
+    size_t groups_mask;
+} u_map_probe_seq_t;
+
+static inline u_map_probe_seq_t u_map_probe_seq_start(size_t hash, size_t groups_mask) {
+    u_map_probe_seq_t seq = {};
+    seq.groups_mask = groups_mask;
+    seq.group       = u_map_hash_h1(hash) & groups_mask;
+    seq.index       = 0;
+    return seq;
+}
+
+static inline bool u_map_probe_seq_next(u_map_probe_seq_t* seq) {
+    seq->index++;
+    seq->group = (seq->group + seq->index) & seq->groups_mask;
+    return seq->index <= seq->groups_mask;
+}
+
+#endif
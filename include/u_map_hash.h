@@ -0,0 +1,41 @@
+#ifndef U_MAP_HASH_H_INCLUDED
+#define U_MAP_HASH_H_INCLUDED
+
+#include "unordered_map.h"
+
+//================================================================================
+//             Встроенные хэш-функции для частых форм ключей
+//================================================================================
+
+// Таблица с u_map_hash_u32 / u_map_hash_u64 в качестве hash_func сама понимает, что хэш
+// уже перемешан, и не прогоняет его через splitmix64 (для своих хэшей того же качества,
+// в том числе из U_MAP_DEFINE_BYTES_HASH, — opts.strong_hash). Таблица с солью перемешивает
+// и их: пропуск splitmix64 только у таблиц без соли.
+// Результаты не зависят от процессора, кроме u_map_hash_bytes — см. ниже
+
+// Целые 4 и 8 байт: умножение 64x64->128 и свертка половин еще одним умножением
+size_t u_map_hash_u32(const void* key);
+size_t u_map_hash_u64(const void* key);
+
+// Байтовые строки любой длины, по схеме wyhash: 48 байт за шаг тремя независимыми умножениями.
+// Строки от U_MAP_HASH_AES_MIN_LEN байт на процессорах с AES-NI (проверяется при первом вызове)
+// считаются раундами AES по 64 байта за шаг (на коротких выигрыша нет), и значение хэша тогда
+// другое. От хэша зависит раскладка слотов, поэтому таблице, которая переживает процесс
+// (любой снимок u_map_save, открытый потом на другой машине), нужен u_map_hash_bytes_portable
+#define U_MAP_HASH_AES_MIN_LEN 128
+
+size_t u_map_hash_bytes         (const void* data, size_t len, uint64_t seed);
+size_t u_map_hash_bytes_portable(const void* data, size_t len, uint64_t seed);
+
+// hash_func для ключей фиксированного размера key_size_ (структуры, массивы байт):
+//   U_MAP_DEFINE_BYTES_HASH(hash_point, sizeof(point_t))
+// Поверх u_map_hash_bytes_portable: такую таблицу можно сохранить и открыть на любой машине
+#define U_MAP_DEFINE_BYTES_HASH(name_, key_size_)                     \
+    static size_t name_(const void* key) {                            \
+        return u_map_hash_bytes_portable(key, (key_size_), 0);        \
+    }
+
+// Встроенная ли это функция с уже перемешанным результатом
+bool   u_map_hash_is_strong(key_func_t hash_func);
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef U_MAP_RCU_H_INCLUDED
+#define U_MAP_RCU_H_INCLUDED
+
+#include <pthread.h>
+
+#include "unordered_map.h"
+
+//================================================================================
+//        Таблица для чтения без блокировок: один писатель, много читателей
+//================================================================================
+
+// Читатель не берет блокировок и не пишет в общую память: он проверяет счетчик версии
+// группы до и после чтения (seqlock) и повторяет чтение, если группу в это время меняли.
+// Писатель меняет слоты на месте, а при росте или чистке надгробий строит новую таблицу
+// и публикует ее атомарно; старая освобождается, когда все читатели ушли с нее (эпохи).
+// Режим всегда swiss, без инкрементального рехэша
+
+#define U_MAP_RCU_MAX_READERS 64
+
+// Опубликованная таблица: версии — по одной на группу, нечетная — группу сейчас пишут
+typedef struct u_map_rcu_table_t {
+    u_map_t                   map;
+    uint32_t*                 versions;
+    uint64_t                  retire_epoch;
+    struct u_map_rcu_table_t* next_retired;
+} u_map_rcu_table_t;
+
+// Слот читателя: пишет в него только свой поток. epoch == 0 — читатель вне таблицы
+typedef struct u_map_rcu_reader_t {
+    alignas(U_MAP_CACHE_LINE) uint64_t epoch;
+    bool in_use;
+} u_map_rcu_reader_t;
+
+typedef struct u_map_rcu_t {
+    u_map_rcu_table_t* current;   // публикуется атомарно
+    u_map_rcu_table_t* retired;   // ждут, пока читатели уйдут; только у писателя
+
+    alignas(U_MAP_CACHE_LINE) uint64_t epoch;
+    size_t             size;
+
+    pthread_mutex_t    writer_lock; // писатели сериализуются; читателей не касается
+
+    u_map_rcu_reader_t readers[U_MAP_RCU_MAX_READERS];
+} u_map_rcu_t;
+
+hm_error_t u_map_rcu_init(u_map_rcu_t* u_map, size_t capacity,
+                          size_t key_size,   size_t key_align,
+                          size_t value_size, size_t value_align,
+                          key_func_t hash_func, key_cmp_t key_cmp);
+
+// Читателей к этому моменту быть не должно
+hm_error_t u_map_rcu_destroy(u_map_rcu_t* u_map);
+
+// Каждый читающий поток один раз получает свой слот (nullptr — слоты кончились)
+u_map_rcu_reader_t* u_map_rcu_register_reader  (u_map_rcu_t* u_map);
+void                u_map_rcu_unregister_reader(u_map_rcu_t* u_map, u_map_rcu_reader_t* reader);
+
+// Поиск без блокировок и общих записей
+bool       u_map_rcu_get    (const u_map_rcu_t* u_map, u_map_rcu_reader_t* reader, const void* key, void* value_out);
+
+// Запись: семантика как у u_map_insert_elem / u_map_remove_elem / u_map_reserve
+hm_error_t u_map_rcu_insert (u_map_rcu_t* u_map, const void* key, const void* value);
+hm_error_t u_map_rcu_remove (u_map_rcu_t* u_map, const void* key, void* value_out);
+hm_error_t u_map_rcu_reserve(u_map_rcu_t* u_map, size_t count);
+
+// Освобождает старые таблицы, с которых ушли все читатели (писатель делает это и сам)
+void       u_map_rcu_reclaim(u_map_rcu_t* u_map);
+
+size_t     u_map_rcu_size   (const u_map_rcu_t* u_map);
+
+#endif
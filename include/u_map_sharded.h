@@ -0,0 +1,49 @@
+#ifndef U_MAP_SHARDED_H_INCLUDED
+#define U_MAP_SHARDED_H_INCLUDED
+
+#include <pthread.h>
+
+#include "unordered_map.h"
+
+//================================================================================
+//          Потокобезопасная таблица: ключи разбиты по независимым шардам
+//================================================================================
+
+// Шард — обычная u_map_t под своей rw-блокировкой. Каждый шард занимает отдельные
+// кэш-линии, так что потоки, работающие с разными шардами, не делят строки кэша
+typedef struct u_map_shard_t {
+    alignas(U_MAP_CACHE_LINE) pthread_rwlock_t lock;
+    u_map_t map;
+} u_map_shard_t;
+
+typedef struct u_map_sharded_t {
+    u_map_shard_t* shards;
+    size_t         shard_count;  // степень двойки
+    unsigned       shard_shift;  // шард выбирается старшими битами хэша: hash >> shard_shift
+    key_func_t     hash_func;
+    uint64_t       seed;         // соль выбора шарда (opts.seed / random_seed)
+    bool           strong_hash;  // как opts.strong_hash: без соли raw-хэш выбирает шард как есть
+} u_map_sharded_t;
+
+// - shard_count округляется вверх до степени двойки (0 — U_MAP_DEFAULT_SHARDS)
+// - capacity — суммарная начальная емкость, делится между шардами поровну
+// - opts применяются к каждому шарду; шарды растут и сжимаются независимо
+hm_error_t u_map_sharded_init(u_map_sharded_t* u_map, size_t shard_count, size_t capacity,
+                              size_t key_size,   size_t key_align,
+                              size_t value_size, size_t value_align,
+                              key_func_t hash_func, key_cmp_t key_cmp,
+                              const u_map_opts_t* opts);
+
+hm_error_t u_map_sharded_destroy(u_map_sharded_t* u_map);
+
+// Поиск берет блокировку шарда на чтение, вставка и удаление — на запись
+bool       u_map_sharded_get   (u_map_sharded_t* u_map, const void* key, void* value_out);
+hm_error_t u_map_sharded_insert(u_map_sharded_t* u_map, const void* key, const void* value);
+hm_error_t u_map_sharded_remove(u_map_sharded_t* u_map, const void* key, void* value_out);
+
+// Сумма по шардам; при параллельных изменениях — значение на момент обхода каждого шарда
+size_t     u_map_sharded_size  (u_map_sharded_t* u_map);
+
+#define U_MAP_DEFAULT_SHARDS 64
+
+#endif
@@ -5,6 +5,7 @@
 #include <stdbool.h>
 #include <stdalign.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #include "error_handler.h"
 
@@ -13,20 +14,111 @@
 typedef size_t (*key_func_t)(const void *key);
 typedef bool   (*key_cmp_t )(const void *a, const void *b);
 
+// Управляющий байт слота:
+// - 0b0hhhhhhh — слот занят; в swiss-режиме hhhhhhh — 7 бит хэша (отпечаток),
+//   в robin hood — расстояние от домашнего слота
+// - EMPTY / DELETED / SENTINEL — служебные значения со старшим битом
 typedef enum elem_state_t {
-    EMPTY   = 0,
-    USED    = 1,
-    DELETED = 2,
+    EMPTY    = 0x80,
+    DELETED  = 0xFE,
+    SENTINEL = 0xFF,
 } elem_state_t;
 
+// Способ пробирования, выбирается при инициализации
+typedef enum u_map_probe_t {
+    U_MAP_PROBE_SWISS       = 0, // группы по U_MAP_GROUP_WIDTH, удаление оставляет DELETED
+    U_MAP_PROBE_ROBIN_HOOD  = 1, // линейное robin hood, удаление обратным сдвигом, без DELETED
+} u_map_probe_t;
+
+// Исполнитель параллельных частей рехэша, загрузки и обхода: run вызывает task(task_ctx, i) для каждого
+// i из [0, count) — в любом порядке, на любых потоках — и возвращается, когда все вызовы закончились.
+// ctx передается как есть и должен жить, пока живет таблица
+typedef void (*u_map_task_t)(void* task_ctx, size_t index);
+
+typedef struct u_map_executor_t {
+    void (*run)(void* ctx, u_map_task_t task, void* task_ctx, size_t count);
+    void*  ctx;
+} u_map_executor_t;
+
+// Когда таблица меняет ёмкость: доли от capacity, 0 — значение по умолчанию.
+// shrink_load не больше max_load / 4: после сжатия вдвое таблица заполнена не больше чем
+// наполовину от max_load, а после роста — хотя бы вдвое выше shrink_load, так что размер,
+// колеблющийся у одного порога, не гоняет таблицу туда-обратно
+typedef struct u_map_load_policy_t {
+    double max_load;       // занятых слотов (с надгробиями) больше — рост или чистка; 0.7
+    double shrink_load;    // живых меньше — удаление сжимает таблицу вдвое; max_load / 4
+    double garbage_load;   // надгробий больше — вместо роста чистка на той же ёмкости; 0.25
+    bool   no_auto_shrink; // удаление не сжимает никогда, только u_map_shrink_to_fit
+} u_map_load_policy_t;
+
+// Дополнительные параметры инициализации (nullptr в *_ex — значения по умолчанию)
+typedef struct u_map_opts_t {
+    u_map_probe_t probe;
+    bool          store_hashes; // хранить полный хэш слота: меньше вызовов key_cmp, рехэш без hash_func
+    size_t        rehash_step;  // 0 — рехэш целиком; иначе инкрементальный, не больше rehash_step слотов за операцию
+    bool          dense;        // записи подряд в порядке вставки, в слотах — только их номера (rehash_step игнорируется)
+    bool          bytes_keys;   // ключи — байтовые строки любой длины (выставляет u_map_init_bytes)
+    bool          strong_hash;  // hash_func уже хорошо перемешивает биты: без splitmix64 поверх (u_map_hash.h)
+    u_map_load_policy_t load;   // пороги роста и сжатия (HM_ERR_BAD_ARG, если они вне (0, 1) или без зазора)
+    uint64_t      seed;         // соль хэша: 0 — без соли (если не random_seed)
+    bool          random_seed;  // взять соль из getrandom; для ключей из недоверенного источника
+    bool          no_reseed;    // не менять соль при подборе коллизий, только считать события
+    size_t        threads;      // > 1 — рехэш, копия, bulk_build и parallel-обход делятся на столько потоков
+    u_map_executor_t executor;  // run == nullptr — встроенный: потоки pthread на время операции
+    bool          cow_snapshots;// буфер в memfd: u_map_snapshot за O(1), копируются только измененные страницы
+} u_map_opts_t;
+
+// Откуда таблица берет память. Память не обязана быть обнулена.
+// - alloc   — size байт, выровненных по align (степень двойки); nullptr — нет памяти
+// - free    — ptr == nullptr не передается; size — тот же, что при выделении
+// ctx передается во все функции как есть и должен жить, пока живет таблица
+typedef struct u_map_allocator_t {
+    void* (*alloc)(void* ctx, size_t size, size_t align);
+    void  (*free) (void* ctx, void* ptr, size_t size);
+    void*  ctx;
+} u_map_allocator_t;
+
+// Гистограмма длин проб: корзина i — ключ найден (или место под него) через i групп
+// после домашней (robin hood — через i слотов); последняя корзина — «не меньше»
+#define U_MAP_STATS_PROBE_BUCKETS 16
+
+// Счетчики, которые ведутся только в сборке с HASH_MAP_STATS
+typedef struct u_map_counters_t {
+    uint64_t hit_probes   [U_MAP_STATS_PROBE_BUCKETS];
+    uint64_t miss_probes  [U_MAP_STATS_PROBE_BUCKETS];
+    uint64_t insert_probes[U_MAP_STATS_PROBE_BUCKETS];
+
+    uint64_t rehash_grow;      // рехэши в большую ёмкость
+    uint64_t rehash_shrink;    // в меньшую
+    uint64_t rehash_cleanup;   // на той же ёмкости (чистка надгробий, в том числе u_map_compact)
+    uint64_t rehash_ns;        // время в рехэше и шагах инкрементального переноса
+
+    uint64_t bytes_allocated;  // всего выделено под буферы таблиц за время жизни
+} u_map_counters_t;
+
+// Защита от подбора коллизий: вставка, которой пришлось пройти слишком далеко от домашней
+// позиции, считается событием, и следующая запись меняет соль и перестраивает таблицу
+typedef struct u_map_flood_t {
+    size_t events;       // вставки с аномально длинной пробой
+    size_t reseeds;      // смены соли
+    size_t reseed_size;  // size при последней смене соли
+    bool   pending;      // следующая запись сменит соль
+} u_map_flood_t;
+
 typedef struct u_map_t {
     void*         data;         
     void*         data_keys;    
     void*         data_values;  
-    elem_state_t* data_states;   
+    size_t*       data_hashes;  // nullptr, если хэши не хранятся
+    uint8_t*      data_states;  // max(capacity, U_MAP_GROUP_WIDTH) байт
+
+    // Плотная раскладка: keys / values / hashes нумеруются записями, а не слотами
+    uint32_t*     data_index;   // номер записи занятого слота; nullptr — обычная раскладка
+    uint8_t*      data_alive;   // 1 — запись жива, 0 — удалена
 
     size_t        size;        
     size_t        occupied;     
+    size_t        entries_used; // плотная раскладка: записей занято (вместе с удаленными)
     size_t        capacity;     
 
     size_t        key_size;
@@ -39,10 +131,47 @@ typedef struct u_map_t {
 
     key_func_t    hash_func;
     key_cmp_t     key_cmp;
+    bool          strong_hash;  // результат hash_func идет в таблицу как есть
+    uint64_t      seed;         // соль перемешивания хэша, 0 — без соли
+    bool          no_reseed;
+    u_map_flood_t flood;
+
+    u_map_probe_t probe;
+
+    // Инкрементальный рехэш: старая таблица живет рядом, пока не перенесена целиком
+    struct u_map_t* old_table;
+    size_t        migrate_pos;
+    size_t        rehash_step;
+
+    u_map_load_policy_t load;   // с подставленными значениями по умолчанию
+
+    size_t        threads;      // 0 / 1 — всё в вызывающем потоке
+    u_map_executor_t executor;
+
+    u_map_counters_t* counters; // nullptr, если статистика не собирается
+
+    struct u_map_key_arena_t* key_arena; // длинные байтовые ключи; nullptr — ключи фиксированного размера
+
+    u_map_allocator_t allocator;
+
+    // Таблица, открытая u_map_open_mmap: буфер лежит внутри отображения файла
+    void*         mapping;      // nullptr — обычная таблица
+    size_t        mapping_bytes;
+    bool          is_read_only;
+
+    // opts.cow_snapshots: буфер в memfd и снимки, которым нужны страницы до записи в них
+    struct u_map_cow_t*      cow;
+    struct u_map_cow_view_t* cow_view; // у снимка: его отображение буфера
 
     bool          is_static;
 } u_map_t;
 
+// Слоты просматриваются группами по U_MAP_GROUP_WIDTH управляющих байт
+#define U_MAP_GROUP_WIDTH 16
+
+// Размер кэш-линии для выравнивания структур, которые делят потоки
+#define U_MAP_CACHE_LINE 64
+
 //================================================================================
 //                      Функции-помощники
 //================================================================================
@@ -53,6 +182,12 @@ size_t u_map_required_bytes(size_t capacity,
                             size_t key_size,   size_t key_align,
                             size_t value_size, size_t value_align);
 
+// То же для таблицы с параметрами opts (store_hashes и dense увеличивают размер)
+size_t u_map_required_bytes_ex(size_t capacity,
+                               size_t key_size,   size_t key_align,
+                               size_t value_size, size_t value_align,
+                               const u_map_opts_t* opts);
+
 
 //================================================================================
 //                       Конструкторы / Деконструкторы /Копировальщиеи
@@ -66,18 +201,49 @@ hm_error_t u_map_init(u_map_t* u_map, size_t capacity,
 
 
 // - capacity округляетс вниз до ближайшей степени 2-ки  (больше > 0).
-// - при вызову должен быть предоставлен буффер выравненнй хотя бы по максимальному (key_align, value_align, alignof(elem_state_t))
-// - буффер должен быть хотя бы u_map_required_bytes(capacity, ...)
+// - при вызову должен быть предоставлен буффер выравненнй хотя бы по максимальному (key_align, value_align)
+//   (с store_hashes — еще и по alignof(size_t), с dense — по alignof(uint32_t))
+// - буффер должен быть хотя бы u_map_required_bytes(capacity, ...) (для *_ex — u_map_required_bytes_ex)
 hm_error_t u_map_static_init(u_map_t* u_map, void* data, size_t capacity,
                           size_t key_size,   size_t key_align,
                           size_t value_size, size_t value_align,
                           key_func_t hash_func, key_cmp_t key_cmp);
 
+// То же, что u_map_init / u_map_static_init, но с дополнительными параметрами
+hm_error_t u_map_init_ex(u_map_t* u_map, size_t capacity,
+                         size_t key_size,   size_t key_align,
+                         size_t value_size, size_t value_align,
+                         key_func_t hash_func, key_cmp_t key_cmp,
+                         const u_map_opts_t* opts);
+
+hm_error_t u_map_static_init_ex(u_map_t* u_map, void* data, size_t capacity,
+                                size_t key_size,   size_t key_align,
+                                size_t value_size, size_t value_align,
+                                key_func_t hash_func, key_cmp_t key_cmp,
+                                const u_map_opts_t* opts);
+
+// То же, что u_map_init_ex, но буферы таблицы (и при рехэше, и служебные) берутся у allocator.
+// allocator == nullptr — u_map_default_allocator(). Копии таблицы получают тот же allocator
+hm_error_t u_map_init_with_allocator(u_map_t* u_map, size_t capacity,
+                                     size_t key_size,   size_t key_align,
+                                     size_t value_size, size_t value_align,
+                                     key_func_t hash_func, key_cmp_t key_cmp,
+                                     const u_map_opts_t* opts, const u_map_allocator_t* allocator);
+
+// calloc / free
+u_map_allocator_t u_map_default_allocator();
+
 hm_error_t u_map_destroy(u_map_t* u_map);
 
 hm_error_t u_map_smart_copy(u_map_t* target, const u_map_t* source);
 hm_error_t u_map_raw_copy  (u_map_t* target, const u_map_t* source);
 
+// Согласованный снимок только для чтения, закрывается u_map_destroy. С opts.cow_snapshots снимок
+// делит буфер с таблицей: создание — одно mmap, а первая запись таблицы в страницу после снимка
+// сначала делает ядру копию этой страницы для снимка. Читать снимок можно из другого потока,
+// пока таблица меняется. Без opts.cow_snapshots — u_map_raw_copy с пометкой read-only
+hm_error_t u_map_snapshot  (u_map_t* u_map, u_map_t* snapshot_out);
+
 
 //================================================================================
 //                              Базовые функции
@@ -91,13 +257,186 @@ bool    u_map_get_elem   (const u_map_t* u_map, const void* key, void* value_out
 hm_error_t u_map_insert_elem(u_map_t*       u_map, const void* key, const void* value);
 hm_error_t u_map_remove_elem(u_map_t*       u_map, const void* key, void* value_out);
 
+// То же по готовому raw_hash == hash_func(key) — для оберток, которым хэш нужен и самим
+// (u_map_sharded_t выбирает по нему шард). Соль таблица добавляет сама
+bool       u_map_get_elem_hashed   (const u_map_t* u_map, const void* key, size_t raw_hash, void* value_out);
+hm_error_t u_map_insert_elem_hashed(u_map_t*       u_map, const void* key, size_t raw_hash, const void* value);
+hm_error_t u_map_remove_elem_hashed(u_map_t*       u_map, const void* key, size_t raw_hash, void* value_out);
+
+// Указатель на значение внутри таблицы или nullptr, если ключа нет. Действует до следующего
+// изменения таблицы; у таблицы, открытой через u_map_open_mmap, писать по нему нельзя
+void*   u_map_get_ptr    (const u_map_t* u_map, const void* key);
+
+// Поиск со вставкой за один проход. Новый ключ получает value (nullptr — нули), у существующего
+// try_emplace значение не трогает, а upsert перезаписывает. В *value_ptr_out — указатель на
+// значение в таблице (как у u_map_get_ptr), в *inserted_out — был ли ключ вставлен; оба можно nullptr
+hm_error_t u_map_try_emplace(u_map_t* u_map, const void* key, const void* value,
+                             void** value_ptr_out, bool* inserted_out);
+hm_error_t u_map_upsert     (u_map_t* u_map, const void* key, const void* value,
+                             void** value_ptr_out, bool* inserted_out);
+
 
 //================================================================================
 //                              Продвинутые функции
 //================================================================================
 
+// Массив пар {key, value}: значение начинается с key_size, выровненного до value_align.
+// Если ключ повторяется, остается последнее значение
 hm_error_t read_arr_to_u_map(u_map_t* u_map, const void* arr, size_t pair_count);
 
+// То же, но таблица один раз заранее получает нужный размер, все ключи хэшируются за один проход
+// и вставляются по возрастанию домашней позиции. duplicates_out (может быть nullptr) —
+// сколько пар не добавили новый ключ
+hm_error_t u_map_bulk_build(u_map_t* u_map, const void* arr, size_t pair_count, size_t* duplicates_out);
+
+// Готовит таблицу к count элементам без роста при вставках (статическая: HM_ERR_FULL, если не влезет)
+hm_error_t u_map_reserve(u_map_t* u_map, size_t count);
+
+// Наименьшая ёмкость, в которую size элементов влезают без роста, без надгробий и без
+// инкрементального переноса. Для статической таблицы — то же, что u_map_compact
+hm_error_t u_map_shrink_to_fit(u_map_t* u_map);
+
+// Пакетные операции: ключи лежат подряд с шагом key_size, значения — с шагом value_size.
+// Сначала считаются хэши и подтягиваются в кэш домашние позиции нескольких ключей,
+// потом выполняются сами поиски, так что промахи кэша разных ключей перекрываются.
+// values_out / found_out могут быть nullptr. get/remove возвращают число найденных ключей
+size_t     u_map_get_batch   (const u_map_t* u_map, const void* keys, size_t count, void* values_out, bool* found_out);
+hm_error_t u_map_insert_batch(u_map_t*       u_map, const void* keys, const void* values, size_t count);
+size_t     u_map_remove_batch(u_map_t*       u_map, const void* keys, size_t count, void* values_out, bool* found_out);
+
+// Убирает надгробия DELETED на месте, без выделения памяти (в том числе в статической таблице)
+hm_error_t u_map_compact(u_map_t* u_map);
+
+// Инкрементальный рехэш (rehash_step != 0):
+// - вставка и удаление переносят не больше rehash_step слотов старой таблицы, поиск смотрит в обе
+// - u_map_finish_rehash дописывает перенос целиком (например, в простое)
+// - u_map_set_rehash_step меняет шаг на ходу; 0 — следующая операция завершит перенос
+bool       u_map_is_rehashing   (const u_map_t* u_map);
+void       u_map_set_rehash_step(u_map_t* u_map, size_t rehash_step);
+hm_error_t u_map_finish_rehash  (u_map_t* u_map);
+
+// Снимок состояния таблицы. Поля до counters считаются всегда; counters заполнены,
+// только если has_counters (библиотека собрана с HASH_MAP_STATS и таблица не статическая)
+typedef struct u_map_stats_t {
+    size_t   size;
+    size_t   capacity;
+    size_t   tombstones;       // DELETED-слоты (вместе со старой таблицей при переносе)
+    double   load_factor;      // size / capacity
+    double   tombstone_ratio;  // tombstones / capacity
+    size_t   bytes_in_use;     // буферы таблицы, выделенные библиотекой (статический буфер не считается)
+    size_t   flood_events;     // вставки с аномально длинной пробой (см. u_map_flood_t)
+    size_t   reseeds;          // смены соли из-за них
+
+    bool             has_counters;
+    u_map_counters_t counters;
+} u_map_stats_t;
+
+void       u_map_stats      (const u_map_t* u_map, u_map_stats_t* stats_out);
+void       u_map_stats_reset(u_map_t* u_map);
+
+
+//================================================================================
+//                         Ключи переменной длины
+//================================================================================
+
+// Таблица с ключами — байтовыми строками любой длины (строки, blob-ы).
+// В слоте ключ занимает U_MAP_BYTES_KEY_SIZE байт: ключ до U_MAP_BYTES_INLINE_MAX байт лежит
+// в нем целиком, длинный — в арене ключей таблицы (дописывается подряд, при рехэше собирается
+// заново без удаленных), а в слоте остаются указатель, длина и часть хэша: key_cmp сравнивает
+// байты, только если совпали длина и эта часть. Хэш — встроенный, по байтам ключа.
+// С такой таблицей работают только функции *_bytes (и обход, копирование, статистика);
+// статической она быть не может, в файл не сохраняется
+#define U_MAP_BYTES_KEY_SIZE   16
+#define U_MAP_BYTES_INLINE_MAX 15
+
+hm_error_t u_map_init_bytes(u_map_t* u_map, size_t capacity,
+                            size_t value_size, size_t value_align,
+                            const u_map_opts_t* opts);
+
+// len до UINT32_MAX; key может быть nullptr при len == 0
+bool       u_map_get_bytes   (const u_map_t* u_map, const void* key, size_t len, void* value_out);
+hm_error_t u_map_insert_bytes(u_map_t*       u_map, const void* key, size_t len, const void* value);
+hm_error_t u_map_remove_bytes(u_map_t*       u_map, const void* key, size_t len, void* value_out);
+
+// Байты и длина ключа, который вернул обход (it.key / key в u_map_visit_t)
+void       u_map_bytes_key_view(const void* stored_key, const void** data_out, size_t* len_out);
+
+
+//================================================================================
+//                                 Обход
+//================================================================================
+
+// Порядок обхода не определен, в плотной раскладке (opts.dense) — порядок вставки.
+// Обычная раскладка просматривает управляющие байты группами всей ёмкости,
+// плотная — только занятый префикс записей. Любое изменение таблицы делает итератор
+// недействительным; во время инкрементального рехэша обходится и старая таблица
+typedef struct u_map_iter_t {
+    const u_map_t* u_map;
+    const u_map_t* table;   // текущая: сама таблица или ее old_table; nullptr — обход закончен
+    size_t         pos;     // следующий слот (в плотной раскладке — запись)
+    const void*    key;
+    const void*    value;
+} u_map_iter_t;
+
+void u_map_iter_init(const u_map_t* u_map, u_map_iter_t* iter);
+
+// false — элементы закончились; иначе key / value указывают на следующий элемент
+bool u_map_iter_next(u_map_iter_t* iter);
+
+// Возвращает false, чтобы остановить обход
+typedef bool (*u_map_visit_t)(const void* key, const void* value, void* ctx);
+
+// Вызывает visit для каждого элемента, возвращает число посещенных
+size_t u_map_for_each(const u_map_t* u_map, u_map_visit_t visit, void* ctx);
+
+// Параллельный обход на потоках таблицы (opts.threads / opts.executor; без них — в вызывающем).
+// Слоты (в плотной раскладке — записи) делятся на куски по U_MAP_SCAN_CHUNK — кратно кэш-линии,
+// так что потоки не делят линии управляющих байт. visit вызывается на разных потоках сразу;
+// false от visit останавливает все куски. Таблицу во время обхода менять нельзя
+#define U_MAP_SCAN_CHUNK 16384
+
+size_t u_map_parallel_for_each(const u_map_t* u_map, u_map_visit_t visit, void* ctx);
+
+// Свертка: fold добавляет элемент в аккумулятор, combine сливает в acc аккумулятор other
+typedef void (*u_map_fold_t)   (void* acc, const void* key, const void* value, void* ctx);
+typedef void (*u_map_combine_t)(void* acc, const void* other, void* ctx);
+
+// acc (acc_size байт) на входе — нейтральное значение, на выходе — результат. Каждый кусок
+// сворачивается в свою копию acc по порядку слотов, копии сливаются по порядку кусков:
+// куски не зависят от числа потоков, так что результат (и сумма double) одинаков при любом.
+// HM_ERR_MEM_ALLOC — не хватило памяти на копии, acc не тронут
+hm_error_t u_map_parallel_reduce(const u_map_t* u_map, void* acc, size_t acc_size,
+                                 u_map_fold_t fold, u_map_combine_t combine, void* ctx);
+
+
+//================================================================================
+//                           Снимки в файл
+//================================================================================
+
+// Файл: заголовок (версия, параметры, раскладка, контрольные суммы) на отдельной странице
+// и сразу за ним буфер таблицы как есть. Формат зависит от платформы (порядок байт,
+// sizeof(size_t)), открывается только тем же hash_func с одинаковыми на всех машинах значениями
+// (u_map_hash_bytes_portable, не u_map_hash_bytes): хэши не пересчитываются (соль таблицы
+// сохраняется в заголовке, как и пороги u_map_load_policy_t). u_map_open_mmap ищет первый ключ
+// таблицы и без него возвращает HM_ERR_BAD_ARG.
+#define U_MAP_FILE_VERSION 5
+
+// Записывает таблицу во временный файл рядом и переименовывает в path.
+// Во время инкрементального рехэша — HM_ERR_BAD_ARG (сначала u_map_finish_rehash)
+hm_error_t u_map_save(const u_map_t* u_map, const char* path);
+
+enum {
+    U_MAP_OPEN_WRITABLE = 1u << 0, // copy-on-write: таблицу можно менять, файл остается прежним
+    U_MAP_OPEN_VERIFY   = 1u << 1, // проверить контрольную сумму буфера (читает весь файл)
+    U_MAP_OPEN_POPULATE = 1u << 2, // отобразить страницы сразу, а не при первом обращении
+};
+
+// Отображает файл и использует буфер как живую таблицу, без разбора и рехэша.
+// Без U_MAP_OPEN_WRITABLE изменения возвращают HM_ERR_READ_ONLY. Растущая writable-таблица
+// переезжает в обычную память при первом рехэше. Закрывается u_map_destroy
+hm_error_t u_map_open_mmap(u_map_t* u_map, const char* path,
+                           key_func_t hash_func, key_cmp_t key_cmp, unsigned flags);
+
 
 //================================================================================
 //                        Макросы-обертки
@@ -1,102 +1,598 @@
 #include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
 #include <time.h>
+#include <pthread.h>
 
 #include "asserts.h"
 #include "colors.h"
 #include "logger.h"
 
+int logger_level = LOGGER_MODE_DEBUG;
+
 static FILE *output_stream = nullptr;
 static logger_output_type output_type = EXTERNAL_STREAM;
 static int color_enabled = 1;
 
 static const char* logger_mode_string(const logger_mode_type type);
-static void        logger_time_string(char *buff, size_t n);
+static void        logger_time_string(time_t t, char *buff, size_t n);
 static const char* logger_color_on(const logger_mode_type mode);
 
 #if defined(WinV)
     #define localtime_r(T,Tm) (localtime_s(Tm,T) ? nullptr : Tm)
 #endif
 
+//==============================================================================
+//                      Записи и кольца потоков
+//==============================================================================
+
+// Поток, который пишет сообщение, только разбирает формат и кладет аргументы в запись: ни времени
+// в строке, ни printf, ни блокировок. Записи лежат в кольце потока (один писатель, один читатель),
+// разбирает кольца фоновый поток. Кольца всех потоков сливаются по времени записи
+typedef struct logger_record_t {
+    uint64_t    time_ns;
+    const char* file;
+    const char* format;
+    int         line;
+    uint8_t     mode;
+    uint8_t     argc;
+    uint8_t     text_used;
+    uint64_t    args[LOGGER_MAX_ARGS];    // целые, double побитово, смещение строки в text
+    char        text[LOGGER_TEXT_BYTES];
+} logger_record_t;
+
+typedef struct logger_ring_t {
+    logger_record_t       records[LOGGER_RING_RECORDS];
+    alignas(64) size_t    head;           // пишет поток-владелец
+    alignas(64) size_t    tail;           // пишет тот, кто выводит
+    size_t                drain_end;      // head на начало прохода вывода
+    size_t                dropped;        // сообщений не влезло: кольцо было полным
+    int                   closed;         // поток завершился, кольцо уберется пустым
+    struct logger_ring_t* next;
+} logger_ring_t;
+
+static_assert((LOGGER_RING_RECORDS & (LOGGER_RING_RECORDS - 1)) == 0, "ring size must be a power of two");
+
+static const long LOGGER_IDLE_NS = 2 * 1000 * 1000;   // пауза фонового потока, когда писать нечего
+
+static pthread_once_t   logger_once        = PTHREAD_ONCE_INIT;
+static pthread_key_t    logger_ring_key;
+static pthread_mutex_t  logger_rings_mutex = PTHREAD_MUTEX_INITIALIZER;   // список колец
+static pthread_mutex_t  logger_drain_mutex = PTHREAD_MUTEX_INITIALIZER;   // вывод: читатель колец и поток
+static logger_ring_t*   logger_rings       = nullptr;
+static pthread_t        logger_thread;
+static int              logger_running     = 0;
+static int              logger_stopping    = 0;
+
+static thread_local logger_ring_t* thread_ring = nullptr;
+static thread_local bool           thread_ring_closed = false;  // поток завершается, кольцо отдано
+
+//==============================================================================
+//                      Разбор формата
+//==============================================================================
+
+// Как достать аргумент преобразования из va_list и как вернуть его в snprintf
+enum logger_arg_kind {
+    LOGGER_ARG_NONE,       // %%
+    LOGGER_ARG_INT,
+    LOGGER_ARG_LONG,
+    LOGGER_ARG_LLONG,
+    LOGGER_ARG_SIZE,
+    LOGGER_ARG_INTMAX,
+    LOGGER_ARG_PTRDIFF,
+    LOGGER_ARG_DOUBLE,
+    LOGGER_ARG_PTR,
+    LOGGER_ARG_TEXT,
+    LOGGER_ARG_BAD         // не поддерживается (%n, %Lf, %ls...): дальше формат выводится как есть
+};
+
+typedef struct logger_spec_t {
+    const char*     begin;     // '%'
+    const char*     end;       // за буквой преобразования
+    int             stars;     // '*' в ширине и точности — аргументы int перед значением
+    logger_arg_kind kind;
+} logger_spec_t;
+
+static bool logger_is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static logger_arg_kind logger_int_kind(char length) {
+    switch (length) {
+        case 'l': return LOGGER_ARG_LONG;
+        case 'q': return LOGGER_ARG_LLONG;    // ll
+        case 'z': return LOGGER_ARG_SIZE;
+        case 'j': return LOGGER_ARG_INTMAX;
+        case 't': return LOGGER_ARG_PTRDIFF;
+        case 'L': return LOGGER_ARG_BAD;
+        default:  return LOGGER_ARG_INT;      // без модификатора, h, hh
+    }
+}
+
+// Следующее преобразование в строке p; false — больше нет. Писатель и читатель разбирают
+// формат одной функцией, поэтому аргументы в записи всегда совпадают с преобразованиями
+static bool logger_next_spec(const char *p, logger_spec_t *spec) {
+    p = strchr(p, '%');
+    if (p == nullptr) return false;
+
+    spec->begin = p++;
+    spec->stars = 0;
+    if (*p == '%') {
+        spec->end  = p + 1;
+        spec->kind = LOGGER_ARG_NONE;
+        return true;
+    }
+
+    while (*p != '\0' && strchr("-+ #0'", *p) != nullptr) ++p;
+    if (*p == '*') { ++spec->stars; ++p; }
+    while (logger_is_digit(*p)) ++p;
+    if (*p == '.') {
+        ++p;
+        if (*p == '*') { ++spec->stars; ++p; }
+        while (logger_is_digit(*p)) ++p;
+    }
+
+    char length = '\0';
+    if (*p == 'h' || *p == 'l' || *p == 'z' || *p == 'j' || *p == 't' || *p == 'L') {
+        length = *p++;
+        if ((length == 'h' || length == 'l') && *p == length) {
+            if (length == 'l') length = 'q';
+            ++p;
+        }
+    }
+
+    const char conv = *p;
+    spec->end = conv != '\0' ? p + 1 : p;
+    switch (conv) {
+        case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+            spec->kind = logger_int_kind(length);
+            break;
+        case 'c':
+            spec->kind = length == '\0' ? LOGGER_ARG_INT : LOGGER_ARG_BAD;
+            break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            spec->kind = length == '\0' || length == 'l' ? LOGGER_ARG_DOUBLE : LOGGER_ARG_BAD;
+            break;
+        case 's':
+            spec->kind = length == '\0' ? LOGGER_ARG_TEXT : LOGGER_ARG_BAD;
+            break;
+        case 'p':
+            spec->kind = LOGGER_ARG_PTR;
+            break;
+        default:
+            spec->kind = LOGGER_ARG_BAD;
+            break;
+    }
+    return true;
+}
+
+//==============================================================================
+//                      Запись сообщения (горячий путь)
+//==============================================================================
+
+static void logger_capture_text(logger_record_t *rec, const char *text) {
+    if (text == nullptr) text = "(null)";
+
+    const size_t room = LOGGER_TEXT_BYTES - 1u - rec->text_used;
+    size_t len = strlen(text);
+    if (len > room) len = room;
+
+    rec->args[rec->argc++] = rec->text_used;
+    memcpy(rec->text + rec->text_used, text, len);
+    rec->text[rec->text_used + len] = '\0';
+    rec->text_used = (uint8_t)(rec->text_used + (len < room ? len + 1 : len));
+}
+
+static void logger_capture(logger_record_t *rec, const char *format, va_list ap) {
+    rec->argc      = 0;
+    rec->text_used = 0;
+    rec->text[LOGGER_TEXT_BYTES - 1] = '\0';
+
+    logger_spec_t spec = {};
+    for (const char *p = format; logger_next_spec(p, &spec); p = spec.end) {
+        if (spec.kind == LOGGER_ARG_NONE) continue;
+        if (spec.kind == LOGGER_ARG_BAD || rec->argc + spec.stars + 1 > LOGGER_MAX_ARGS) return;
+
+        for (int i = 0; i < spec.stars; ++i) rec->args[rec->argc++] = (uint64_t)(int64_t)va_arg(ap, int);
+
+        uint64_t value = 0;
+        switch (spec.kind) {
+            case LOGGER_ARG_INT:     value = (uint64_t)(int64_t)va_arg(ap, int);        break;
+            case LOGGER_ARG_LONG:    value = (uint64_t)va_arg(ap, long);                break;
+            case LOGGER_ARG_LLONG:   value = (uint64_t)va_arg(ap, long long);           break;
+            case LOGGER_ARG_SIZE:    value = (uint64_t)va_arg(ap, size_t);              break;
+            case LOGGER_ARG_INTMAX:  value = (uint64_t)va_arg(ap, intmax_t);            break;
+            case LOGGER_ARG_PTRDIFF: value = (uint64_t)va_arg(ap, ptrdiff_t);           break;
+            case LOGGER_ARG_PTR:     value = (uint64_t)(uintptr_t)va_arg(ap, void *);   break;
+            case LOGGER_ARG_DOUBLE: {
+                const double d = va_arg(ap, double);
+                memcpy(&value, &d, sizeof(value));
+                break;
+            }
+            case LOGGER_ARG_TEXT:
+                logger_capture_text(rec, va_arg(ap, const char *));
+                continue;
+            case LOGGER_ARG_NONE:
+            case LOGGER_ARG_BAD:
+            default:
+                return;
+        }
+        rec->args[rec->argc++] = value;
+    }
+}
+
+static uint64_t logger_now_ns() {
+    struct timespec ts = {};
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+//==============================================================================
+//                      Вывод (фоновый поток)
+//==============================================================================
+
+// Значение одного преобразования: звездочки подставляются в копию спецификации числами,
+// так что snprintf всегда получает ровно один аргумент нужного типа
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+static int logger_format_arg(char *out, size_t n, const logger_spec_t *spec,
+                             const logger_record_t *rec, size_t *arg) {
+    char   fmt[32] = "";
+    size_t len     = 0;
+    for (const char *c = spec->begin; c < spec->end; ++c) {
+        if (*c == '*') {
+            const int w = snprintf(fmt + len, sizeof(fmt) - len, "%d", (int)(int64_t)rec->args[(*arg)++]);
+            if (w < 0 || (size_t)w >= sizeof(fmt) - len) return -1;
+            len += (size_t)w;
+        } else {
+            if (len + 1 >= sizeof(fmt)) return -1;
+            fmt[len++] = *c;
+        }
+    }
+    fmt[len] = '\0';
+
+    const uint64_t value = rec->args[(*arg)++];
+    switch (spec->kind) {
+        case LOGGER_ARG_INT:     return snprintf(out, n, fmt, (int)(int64_t)value);
+        case LOGGER_ARG_LONG:    return snprintf(out, n, fmt, (long)value);
+        case LOGGER_ARG_LLONG:   return snprintf(out, n, fmt, (long long)value);
+        case LOGGER_ARG_SIZE:    return snprintf(out, n, fmt, (size_t)value);
+        case LOGGER_ARG_INTMAX:  return snprintf(out, n, fmt, (intmax_t)value);
+        case LOGGER_ARG_PTRDIFF: return snprintf(out, n, fmt, (ptrdiff_t)value);
+        case LOGGER_ARG_PTR:     return snprintf(out, n, fmt, (void *)(uintptr_t)value);
+        case LOGGER_ARG_TEXT:    return snprintf(out, n, fmt, rec->text + value);
+        case LOGGER_ARG_DOUBLE: {
+            double d = 0;
+            memcpy(&d, &value, sizeof(d));
+            return snprintf(out, n, fmt, d);
+        }
+        case LOGGER_ARG_NONE:
+        case LOGGER_ARG_BAD:
+        default:
+            return -1;
+    }
+}
+#pragma GCC diagnostic pop
+
+static void logger_append(char *out, size_t n, size_t *pos, const char *s, size_t len) {
+    if (len > n - 1 - *pos) len = n - 1 - *pos;
+    memcpy(out + *pos, s, len);
+    *pos += len;
+    out[*pos] = '\0';
+}
+
+static void logger_format_message(const logger_record_t *rec, char *out, size_t n) {
+    size_t pos = 0;
+    size_t arg = 0;
+    out[0] = '\0';
+
+    const char   *p    = rec->format;
+    logger_spec_t spec = {};
+    while (logger_next_spec(p, &spec)) {
+        logger_append(out, n, &pos, p, (size_t)(spec.begin - p));
+        if (spec.kind == LOGGER_ARG_NONE) {
+            logger_append(out, n, &pos, "%", 1);
+            p = spec.end;
+            continue;
+        }
+        // Писатель здесь остановился: остаток формата — как есть
+        p = spec.begin;
+        if (spec.kind == LOGGER_ARG_BAD || arg + (size_t)spec.stars + 1 > rec->argc) break;
+
+        const int w = logger_format_arg(out + pos, n - pos, &spec, rec, &arg);
+        if (w < 0) break;
+        pos += (size_t)w < n - pos ? (size_t)w : n - 1 - pos;
+        p = spec.end;
+    }
+    logger_append(out, n, &pos, p, strlen(p));
+}
+
+static void logger_write_line(const logger_mode_type mode, time_t sec, const char *file, int line,
+                              const char *message) {
+    if (!output_stream) {
+        color_enabled = 0;
+        output_stream = stderr;
+    }
+    char Time[32] = "";
+    logger_time_string(sec, Time, sizeof Time);
+    if(output_type != EXTERNAL_STREAM) {
+        fprintf(output_stream, "%s. %s:%d. %s. ",
+            Time, file, line, logger_mode_string(mode));
+    } else {
+        const char *color_on  = logger_color_on(mode);
+        fprintf(output_stream, "[%s] %s:%d. %s%s%s. ",
+            Time, file, line, color_on, logger_mode_string(mode), RESET_CONSOLE);
+    }
+    fputs(message, output_stream);
+    fputc('\n', output_stream);
+}
+
+static void logger_write_record(const logger_record_t *rec) {
+    char message[512] = "";
+    logger_format_message(rec, message, sizeof message);
+    logger_write_line((logger_mode_type)rec->mode, (time_t)(rec->time_ns / 1000000000ull),
+                      rec->file, rec->line, message);
+}
+
+// Выводит все, что лежало в кольцах на момент вызова, по времени записи. Вызывается под
+// logger_drain_mutex: кто его держит, тот и единственный читатель колец
+static size_t logger_drain() {
+    pthread_mutex_lock(&logger_rings_mutex);
+    logger_ring_t **link = &logger_rings;
+    while (*link != nullptr) {
+        logger_ring_t *ring = *link;
+        ring->drain_end = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE) && ring->tail == ring->drain_end &&
+            __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED) == 0) {
+            *link = ring->next;
+            free(ring);
+        } else {
+            link = &ring->next;
+        }
+    }
+    logger_ring_t *rings = logger_rings;
+    pthread_mutex_unlock(&logger_rings_mutex);
+
+    // Новые кольца встают в голову списка, поэтому хвост с rings дальше не меняется
+    size_t written = 0;
+    for (;;) {
+        logger_ring_t *oldest = nullptr;
+        for (logger_ring_t *ring = rings; ring != nullptr; ring = ring->next) {
+            if (ring->tail == ring->drain_end) continue;
+            const logger_record_t *rec = &ring->records[ring->tail & (LOGGER_RING_RECORDS - 1)];
+            if (oldest == nullptr ||
+                rec->time_ns < oldest->records[oldest->tail & (LOGGER_RING_RECORDS - 1)].time_ns) {
+                oldest = ring;
+            }
+        }
+        if (oldest == nullptr) break;
+
+        logger_write_record(&oldest->records[oldest->tail & (LOGGER_RING_RECORDS - 1)]);
+        __atomic_store_n(&oldest->tail, oldest->tail + 1, __ATOMIC_RELEASE);
+        ++written;
+    }
+
+    for (logger_ring_t *ring = rings; ring != nullptr; ring = ring->next) {
+        const size_t dropped = __atomic_exchange_n(&ring->dropped, 0, __ATOMIC_RELAXED);
+        if (dropped == 0) continue;
+        char message[64] = "";
+        snprintf(message, sizeof message, "logger: %zu messages dropped, ring was full", dropped);
+        logger_write_line(LOGGER_MODE_WARNING, time(nullptr), __FILE__, __LINE__, message);
+        ++written;
+    }
+
+    if (written != 0 && output_stream) fflush(output_stream);
+    return written;
+}
+
+static void *logger_thread_main(void *) {
+    const struct timespec idle = {0, LOGGER_IDLE_NS};
+    while (!__atomic_load_n(&logger_stopping, __ATOMIC_ACQUIRE)) {
+        pthread_mutex_lock(&logger_drain_mutex);
+        const size_t written = logger_drain();
+        pthread_mutex_unlock(&logger_drain_mutex);
+        if (written == 0) nanosleep(&idle, nullptr);
+    }
+    return nullptr;
+}
+
+//==============================================================================
+//                      Запуск и остановка
+//==============================================================================
+
+// Закрытое кольцо фоновый поток освобождает, как только разберет. Сообщения из деструкторов,
+// которые сработают позже этого (другие ключи pthread, thread_local), идут в обход колец
+static void logger_ring_detach(void *ring) {
+    thread_ring        = nullptr;
+    thread_ring_closed = true;
+    __atomic_store_n(&((logger_ring_t *)ring)->closed, 1, __ATOMIC_RELEASE);
+}
+
+static void logger_stop() {
+    if (__atomic_load_n(&logger_running, __ATOMIC_ACQUIRE)) {
+        __atomic_store_n(&logger_stopping, 1, __ATOMIC_RELEASE);
+        pthread_join(logger_thread, nullptr);
+        __atomic_store_n(&logger_running, 0, __ATOMIC_RELEASE);
+    }
+    logger_flush();
+}
+
+static void logger_start() {
+    const char *level = getenv("HASH_MAP_LOG_LEVEL");
+    if (level != nullptr) {
+        static const char *const names[] = {"debug", "info", "warning", "error", "off"};
+        for (int i = LOGGER_MODE_DEBUG; i <= LOGGER_MODE_OFF; ++i) {
+            if (strcasecmp(level, names[i]) == 0) __atomic_store_n(&logger_level, i, __ATOMIC_RELAXED);
+        }
+    }
+
+    pthread_key_create(&logger_ring_key, logger_ring_detach);
+    if (pthread_create(&logger_thread, nullptr, logger_thread_main, nullptr) == 0) {
+        __atomic_store_n(&logger_running, 1, __ATOMIC_RELEASE);
+    }
+    // Сообщения последних мгновений перед exit тоже выводятся
+    atexit(logger_stop);
+}
+
+// Кольцо потока; nullptr — нет памяти или поток уже завершается, сообщение выводится сразу
+static logger_ring_t *logger_thread_ring() {
+    if (thread_ring != nullptr) return thread_ring;
+    if (thread_ring_closed)     return nullptr;
+
+    const size_t bytes = (sizeof(logger_ring_t) + 63) & ~(size_t)63;
+    logger_ring_t *ring = (logger_ring_t *)aligned_alloc(64, bytes);
+    if (ring == nullptr) return nullptr;
+    memset(ring, 0, sizeof(*ring));
+
+    pthread_setspecific(logger_ring_key, ring);
+    pthread_mutex_lock(&logger_rings_mutex);
+    ring->next   = logger_rings;
+    logger_rings = ring;
+    pthread_mutex_unlock(&logger_rings_mutex);
+
+    thread_ring = ring;
+    return ring;
+}
+
+//==============================================================================
+//                      Интерфейс
+//==============================================================================
+
 static const char* logger_mode_string(const logger_mode_type type) {
     switch (type) {
         case LOGGER_MODE_DEBUG:                   return "DEBUG";
         case LOGGER_MODE_INFO:                    return "INFO";
         case LOGGER_MODE_WARNING:                 return "WARNING";
         case LOGGER_MODE_ERROR:                   return "ERROR";
+        case LOGGER_MODE_OFF:
         default: SOFT_ASSERT(false, "WRONG MODE");return "?";
     }
 }
 
-static void logger_time_string(char *buff, size_t n) {
+// Время одной секунды форматируется один раз: localtime_r и strftime — не на каждую строку
+static void logger_time_string(time_t t, char *buff, size_t n) {
     HARD_ASSERT(buff != nullptr, "buff is nullptr");
-    time_t t = time(nullptr);
-    struct tm tmv;
-    localtime_r(&t, &tmv);
-    if(!strftime(buff, n, "%H:%M:%S:%Y-%m-%d", &tmv)) {
-        SOFT_ASSERT(false, "Invalid time input");
+    static time_t cached_time = (time_t)-1;
+    static char   cached[32]  = "";
+    if (t != cached_time) {
+        struct tm tmv;
+        localtime_r(&t, &tmv);
+        if(!strftime(cached, sizeof cached, "%H:%M:%S:%Y-%m-%d", &tmv)) {
+            SOFT_ASSERT(false, "Invalid time input");
+        }
+        cached_time = t;
     }
+    snprintf(buff, n, "%s", cached);
 }
 
 static const char* logger_color_on(const logger_mode_type mode) {
     if (!color_enabled) return "";
     switch (mode) {
         case LOGGER_MODE_DEBUG:   return CYAN_CONSOLE;
-        case LOGGER_MODE_INFO:    return BLUE_CONSOLE; 
+        case LOGGER_MODE_INFO:    return BLUE_CONSOLE;
         case LOGGER_MODE_WARNING: return YELLOW_CONSOLE;
         case LOGGER_MODE_ERROR:   return RED_CONSOLE;
 
+        case LOGGER_MODE_OFF:
         default:                  return "";
     }
 }
 
 void logger_initialize_stream(FILE *stream) {
+    pthread_mutex_lock(&logger_drain_mutex);
+    logger_drain();
     if (output_type == OWNED_FILE && output_stream) {
         fclose(output_stream);
     }
     output_stream = stream ? stream : stderr;
     output_type = EXTERNAL_STREAM;
+    pthread_mutex_unlock(&logger_drain_mutex);
 }
 
 int logger_initialize_file(const char *path) {
     HARD_ASSERT(path != nullptr, "File path is empty");
     FILE *f = fopen(path, "a");
-    HARD_ASSERT(path != nullptr, "Incorrect read of logger file");
+    if (f == nullptr) return -1;
 
+    pthread_mutex_lock(&logger_drain_mutex);
+    logger_drain();
     if (output_type == OWNED_FILE && output_stream) {
         fclose(output_stream);
     }
     output_stream = f;
     output_type = OWNED_FILE;
+    pthread_mutex_unlock(&logger_drain_mutex);
     return 0;
 }
 
+// Останавливает фоновый поток; сообщения после этого выводятся сразу в вызывающем потоке
 void logger_close() {
+    logger_stop();
+
+    pthread_mutex_lock(&logger_drain_mutex);
     if (output_type == OWNED_FILE && output_stream) fclose(output_stream);
+    output_stream = nullptr;
+    output_type = EXTERNAL_STREAM;
+    pthread_mutex_unlock(&logger_drain_mutex);
+}
+
+void logger_set_level(logger_mode_type mode) {
+    pthread_once(&logger_once, logger_start);
+    __atomic_store_n(&logger_level, (int)mode, __ATOMIC_RELAXED);
+}
+
+logger_mode_type logger_get_level() {
+    pthread_once(&logger_once, logger_start);
+    return (logger_mode_type)__atomic_load_n(&logger_level, __ATOMIC_RELAXED);
+}
+
+void logger_flush() {
+    pthread_mutex_lock(&logger_drain_mutex);
+    logger_drain();
+    pthread_mutex_unlock(&logger_drain_mutex);
 }
 
 void logger_log_message(const logger_mode_type mode,
                         const char *file, int line,
                         const char *format, ...) {
-    if (!output_stream) {
-        color_enabled = 0;
-        output_stream = stderr;
-    }
-    char Time[32] = "";
-    logger_time_string(Time, sizeof Time);
-    if(output_type != EXTERNAL_STREAM) {
-        fprintf(output_stream, "%s. %s:%d. %s. ",
-            Time, file, line, logger_mode_string(mode));
-    } else {
-        const char *color_on  = logger_color_on(mode);
-        fprintf(output_stream, "[%s] %s:%d. %s%s%s. ",
-            Time, file, line, color_on, logger_mode_string(mode), RESET_CONSOLE);
+    pthread_once(&logger_once, logger_start);
+    if (!logger_enabled(mode)) return;   // порог мог прийти из окружения при запуске
+
+    logger_ring_t *ring = logger_thread_ring();
+    logger_record_t local = {};
+    logger_record_t *rec = &local;
+    size_t head = 0;
+    if (ring != nullptr) {
+        head = ring->head;
+        if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == LOGGER_RING_RECORDS) {
+            __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        rec = &ring->records[head & (LOGGER_RING_RECORDS - 1)];
     }
 
+    rec->time_ns = logger_now_ns();
+    rec->file    = file;
+    rec->format  = format;
+    rec->line    = line;
+    rec->mode    = (uint8_t)mode;
+
     va_list ap;
     va_start(ap, format);
-    vfprintf(output_stream, format, ap);
+    logger_capture(rec, format, ap);
     va_end(ap);
-    
-    fputc('\n', output_stream);
-}
 
+    if (ring != nullptr) {
+        __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+        if (!__atomic_load_n(&logger_running, __ATOMIC_ACQUIRE)) logger_flush();
+    } else {
+        pthread_mutex_lock(&logger_drain_mutex);
+        logger_drain();
+        logger_write_record(rec);
+        if (output_stream) fflush(output_stream);
+        pthread_mutex_unlock(&logger_drain_mutex);
+    }
+}
@@ -0,0 +1,148 @@
+#include "u_map_alloc.h"
+#include "asserts.h"
+#include "logger.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+//================================================================================
+//                        Помошники
+//================================================================================
+
+static size_t align_up(size_t x, size_t align) {
+    return (x + align - 1) & ~(align - 1);
+}
+
+//================================================================================
+//                              Арена
+//================================================================================
+
+static void* arena_alloc(void* ctx, size_t size, size_t align) {
+    u_map_arena_t* arena = (u_map_arena_t*)ctx;
+    HARD_ASSERT(arena != nullptr, "arena is nullptr");
+
+    const uintptr_t base  = (uintptr_t)arena->base;
+    const size_t    start = (size_t)(align_up(base + arena->used, align) - base);
+    if (start > arena->capacity || size > arena->capacity - start) {
+        LOGGER_WARNING("u_map_arena: %zu bytes requested, %zu left", size, arena->capacity - arena->used);
+        return nullptr;
+    }
+
+    arena->last = start;
+    arena->used = start + size;
+    return arena->base + start;
+}
+
+static bool arena_is_last(const u_map_arena_t* arena, const void* ptr, size_t size) {
+    return ptr == arena->base + arena->last && arena->last + size == arena->used;
+}
+
+static void arena_free(void* ctx, void* ptr, size_t size) {
+    u_map_arena_t* arena = (u_map_arena_t*)ctx;
+    HARD_ASSERT(arena != nullptr, "arena is nullptr");
+
+    if (arena_is_last(arena, ptr, size)) arena->used = arena->last;
+}
+
+void u_map_arena_init(u_map_arena_t* arena, void* buffer, size_t size) {
+    HARD_ASSERT(arena  != nullptr, "arena is nullptr");
+    HARD_ASSERT(buffer != nullptr || size == 0, "buffer is nullptr");
+
+    arena->base     = (unsigned char*)buffer;
+    arena->capacity = size;
+    arena->used     = 0;
+    arena->last     = 0;
+}
+
+void u_map_arena_reset(u_map_arena_t* arena) {
+    HARD_ASSERT(arena != nullptr, "arena is nullptr");
+
+    arena->used = 0;
+    arena->last = 0;
+}
+
+u_map_allocator_t u_map_arena_allocator(u_map_arena_t* arena) {
+    HARD_ASSERT(arena != nullptr, "arena is nullptr");
+
+    u_map_allocator_t allocator = {};
+    allocator.alloc   = arena_alloc;
+    allocator.free    = arena_free;
+    allocator.ctx     = arena;
+    return allocator;
+}
+
+//================================================================================
+//                        mmap + huge pages
+//================================================================================
+
+// Флаги хранятся прямо в ctx: состояния у аллокатора нет
+static unsigned mmap_flags(void* ctx) {
+    return (unsigned)(uintptr_t)ctx;
+}
+
+// Заранее отображает страницы, чтобы первое обращение не падало в ядро
+static void mmap_populate(void* ptr, size_t len) {
+#ifdef MADV_POPULATE_WRITE
+    if (madvise(ptr, len, MADV_POPULATE_WRITE) == 0) return;
+#endif
+    const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    volatile unsigned char* bytes = (volatile unsigned char*)ptr;
+    for (size_t off = 0; off < len; off += page) bytes[off] = 0;
+}
+
+static void* mmap_alloc(void* ctx, size_t size, size_t align) {
+    const unsigned flags = mmap_flags(ctx);
+    HARD_ASSERT(align <= U_MAP_HUGE_PAGE_SIZE, "align is larger than a huge page");
+
+    if (size < U_MAP_HUGE_PAGE_SIZE) {
+        if (align < sizeof(void*)) align = sizeof(void*);
+        void* ptr = nullptr;
+        return posix_memalign(&ptr, align, size) == 0 ? ptr : nullptr;
+    }
+
+    const size_t len = align_up(size, U_MAP_HUGE_PAGE_SIZE);
+
+    if (flags & U_MAP_MMAP_HUGETLB) {
+        const int populate = (flags & U_MAP_MMAP_POPULATE) ? MAP_POPULATE : 0;
+        void* ptr = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | populate, -1, 0);
+        if (ptr != MAP_FAILED) return ptr;
+        LOGGER_INFO("u_map_mmap: no reserved huge pages for %zu bytes, using transparent ones", len);
+    }
+
+    // Лишние 2 МБ, чтобы вырезать из отображения выровненный кусок: THP собирает
+    // huge page только из выровненного диапазона
+    unsigned char* raw = (unsigned char*)mmap(nullptr, len + U_MAP_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if ((void*)raw == MAP_FAILED) return nullptr;
+
+    unsigned char* ptr  = (unsigned char*)align_up((uintptr_t)raw, U_MAP_HUGE_PAGE_SIZE);
+    const size_t   head = (size_t)(ptr - raw);
+    if (head != 0)                         munmap(raw, head);
+    if (head != U_MAP_HUGE_PAGE_SIZE)      munmap(ptr + len, U_MAP_HUGE_PAGE_SIZE - head);
+
+    madvise(ptr, len, MADV_HUGEPAGE);
+    if (flags & U_MAP_MMAP_POPULATE) mmap_populate(ptr, len);
+
+    return ptr;
+}
+
+static void mmap_free(void* ctx, void* ptr, size_t size) {
+    (void)ctx;
+
+    if (size < U_MAP_HUGE_PAGE_SIZE) {
+        free(ptr);
+        return;
+    }
+    munmap(ptr, align_up(size, U_MAP_HUGE_PAGE_SIZE));
+}
+
+u_map_allocator_t u_map_mmap_allocator(unsigned flags) {
+    u_map_allocator_t allocator = {};
+    allocator.alloc   = mmap_alloc;
+    allocator.free    = mmap_free;
+    allocator.ctx     = (void*)(uintptr_t)flags;
+    return allocator;
+}
@@ -0,0 +1,206 @@
+#include "u_map_hash.h"
+#include "asserts.h"
+
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+//================================================================================
+//                        Помошники
+//================================================================================
+
+// Константы wyhash: нечетные, с равным числом единиц в каждом байте
+static const uint64_t HASH_P0 = 0xa0761d6478bd642fULL;
+static const uint64_t HASH_P1 = 0xe7037ed1a0b428dbULL;
+static const uint64_t HASH_P2 = 0x8ebc6af09c88c6e3ULL;
+static const uint64_t HASH_P3 = 0x589965cc75374cc3ULL;
+
+static inline uint64_t read_u64(const unsigned char* ptr) {
+    uint64_t x = 0;
+    memcpy(&x, ptr, sizeof(x));
+    return x;
+}
+
+static inline uint64_t read_u32(const unsigned char* ptr) {
+    uint32_t x = 0;
+    memcpy(&x, ptr, sizeof(x));
+    return x;
+}
+
+// 1..3 байта: первый, средний и последний
+static inline uint64_t read_small(const unsigned char* ptr, size_t len) {
+    return ((uint64_t)ptr[0] << 16) | ((uint64_t)ptr[len >> 1] << 8) | ptr[len - 1];
+}
+
+// Полное произведение 64x64->128: младшая половина в *a, старшая в *b
+static inline void mul_128(uint64_t* a, uint64_t* b) {
+#if defined(__SIZEOF_INT128__)
+    const unsigned __int128 r = (unsigned __int128)*a * *b;
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+#else
+    const uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b;
+    const uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    const uint64_t t  = rl + (rm0 << 32);
+    const uint64_t lo = t + (rm1 << 32);
+    const uint64_t c  = (uint64_t)(t < rl) + (uint64_t)(lo < t);
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+// Умножение со сверткой: каждый бит результата зависит от всех битов обоих множителей
+static inline uint64_t mul_fold(uint64_t a, uint64_t b) {
+    mul_128(&a, &b);
+    return a ^ b;
+}
+
+// То же, но произведение XOR-ится обратно в множители (вариант wyhash «condom»). Слово ключа,
+// равное константе, обнуляет свой множитель, и простое произведение потеряло бы второй целиком:
+// такие ключи давали бы одинаковый хэш при любой соли. Здесь оба множителя остаются в результате
+static inline void mul_128_keep(uint64_t* a, uint64_t* b) {
+    uint64_t lo = *a;
+    uint64_t hi = *b;
+    mul_128(&lo, &hi);
+    *a ^= lo;
+    *b ^= hi;
+}
+
+static inline uint64_t mul_fold_keep(uint64_t a, uint64_t b) {
+    mul_128_keep(&a, &b);
+    return a ^ b;
+}
+
+//================================================================================
+//                        Целые ключи
+//================================================================================
+
+// Умножение на константу оставляет почти детерминированные пары бит вход/выход
+// (лавинное смещение 0.49), поэтому оба множителя зависят от ключа, и произведение
+// еще раз сворачивается. Цепочка все равно короче, чем splitmix64 поверх тождества
+static inline size_t hash_word(uint64_t x) {
+    uint64_t a = x ^ HASH_P0;
+    uint64_t b = x ^ HASH_P1;
+    mul_128(&a, &b);
+    return (size_t)mul_fold(a ^ HASH_P0, b ^ HASH_P1);
+}
+
+size_t u_map_hash_u32(const void* key) {
+    HARD_ASSERT(key != nullptr, "key is nullptr");
+    return hash_word(read_u32((const unsigned char*)key));
+}
+
+size_t u_map_hash_u64(const void* key) {
+    HARD_ASSERT(key != nullptr, "key is nullptr");
+    return hash_word(read_u64((const unsigned char*)key));
+}
+
+//================================================================================
+//                        Байтовые строки
+//================================================================================
+
+size_t u_map_hash_bytes_portable(const void* data, size_t len, uint64_t seed) {
+    HARD_ASSERT(data != nullptr || len == 0, "data is nullptr");
+
+    const unsigned char* ptr = (const unsigned char*)data;
+    seed ^= mul_fold(seed ^ HASH_P0, HASH_P1);
+
+    uint64_t a = 0;
+    uint64_t b = 0;
+    if (len <= 16) {
+        if (len >= 4) {
+            // Два перекрывающихся окна по 8 байт, собранных из четверок
+            const size_t shift = (len >> 3) << 2;
+            a = (read_u32(ptr) << 32) | read_u32(ptr + shift);
+            b = (read_u32(ptr + len - 4) << 32) | read_u32(ptr + len - 4 - shift);
+        } else if (len > 0) {
+            a = read_small(ptr, len);
+        }
+    } else {
+        size_t left = len;
+        if (left > 48) {
+            uint64_t lane1 = seed;
+            uint64_t lane2 = seed;
+            do {
+                seed  = mul_fold_keep(read_u64(ptr)      ^ HASH_P1, read_u64(ptr + 8)  ^ seed);
+                lane1 = mul_fold_keep(read_u64(ptr + 16) ^ HASH_P2, read_u64(ptr + 24) ^ lane1);
+                lane2 = mul_fold_keep(read_u64(ptr + 32) ^ HASH_P3, read_u64(ptr + 40) ^ lane2);
+                ptr  += 48;
+                left -= 48;
+            } while (left > 48);
+            seed ^= lane1 ^ lane2;
+        }
+        while (left > 16) {
+            seed  = mul_fold_keep(read_u64(ptr) ^ HASH_P1, read_u64(ptr + 8) ^ seed);
+            ptr  += 16;
+            left -= 16;
+        }
+        // Последние 16 байт строки, возможно внахлест с уже прочитанными
+        a = read_u64(ptr + left - 16);
+        b = read_u64(ptr + left - 8);
+    }
+
+    a ^= HASH_P1;
+    b ^= seed;
+    mul_128_keep(&a, &b);
+    return (size_t)mul_fold_keep(a ^ HASH_P0 ^ (uint64_t)len, b ^ HASH_P1);
+}
+
+#if defined(__x86_64__)
+
+// Четыре независимые дорожки: блок входа служит ключом раунда, так что за такт идет
+// несколько aesenc, а не цепочка зависимых. Хвост — последние 64 байта внахлест
+__attribute__((target("aes,sse2")))
+static size_t hash_bytes_aes(const unsigned char* ptr, size_t len, uint64_t seed) {
+    const __m128i key = _mm_set_epi64x((long long)(seed ^ HASH_P0), (long long)((uint64_t)len ^ HASH_P1));
+
+    __m128i lane0 = _mm_xor_si128(key, _mm_set_epi64x((long long)HASH_P2, (long long)HASH_P3));
+    __m128i lane1 = _mm_xor_si128(key, _mm_set_epi64x((long long)HASH_P3, (long long)HASH_P2));
+    __m128i lane2 = _mm_xor_si128(key, _mm_set_epi64x((long long)HASH_P1, (long long)HASH_P0));
+    __m128i lane3 = _mm_xor_si128(key, _mm_set_epi64x((long long)HASH_P0, (long long)HASH_P1));
+
+    const unsigned char* end = ptr + len - 64;
+    for (; ptr < end; ptr += 64) {
+        lane0 = _mm_aesenc_si128(lane0, _mm_loadu_si128((const __m128i*)(const void*)(ptr)));
+        lane1 = _mm_aesenc_si128(lane1, _mm_loadu_si128((const __m128i*)(const void*)(ptr + 16)));
+        lane2 = _mm_aesenc_si128(lane2, _mm_loadu_si128((const __m128i*)(const void*)(ptr + 32)));
+        lane3 = _mm_aesenc_si128(lane3, _mm_loadu_si128((const __m128i*)(const void*)(ptr + 48)));
+    }
+    lane0 = _mm_aesenc_si128(lane0, _mm_loadu_si128((const __m128i*)(const void*)(end)));
+    lane1 = _mm_aesenc_si128(lane1, _mm_loadu_si128((const __m128i*)(const void*)(end + 16)));
+    lane2 = _mm_aesenc_si128(lane2, _mm_loadu_si128((const __m128i*)(const void*)(end + 32)));
+    lane3 = _mm_aesenc_si128(lane3, _mm_loadu_si128((const __m128i*)(const void*)(end + 48)));
+
+    // Дорожки сводятся попарно, затем еще два раунда на перемешивание последнего блока
+    __m128i acc = _mm_aesenc_si128(_mm_aesenc_si128(lane0, lane1), _mm_aesenc_si128(lane2, lane3));
+    acc = _mm_aesenc_si128(acc, key);
+    acc = _mm_aesenc_si128(acc, key);
+
+    uint64_t a = (uint64_t)_mm_cvtsi128_si64(acc);
+    uint64_t b = (uint64_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(acc, acc));
+    return (size_t)mul_fold(a ^ HASH_P2, b ^ HASH_P3);
+}
+
+static bool cpu_has_aes() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("aes");
+}
+
+#endif
+
+size_t u_map_hash_bytes(const void* data, size_t len, uint64_t seed) {
+#if defined(__x86_64__)
+    if (len >= U_MAP_HASH_AES_MIN_LEN) {
+        static const bool has_aes = cpu_has_aes();
+        if (has_aes) return hash_bytes_aes((const unsigned char*)data, len, seed);
+    }
+#endif
+    return u_map_hash_bytes_portable(data, len, seed);
+}
+
+bool u_map_hash_is_strong(key_func_t hash_func) {
+    return hash_func == u_map_hash_u32 || hash_func == u_map_hash_u64;
+}
@@ -0,0 +1,437 @@
+#include "u_map_rcu.h"
+#include "u_map_group.h"
+#include "asserts.h"
+#include "error_handler.h"
+#include "logger.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const double MAX_LOAD_FACTOR = 0.7;
+
+//================================================================================
+//                        Помошники
+//================================================================================
+
+static inline const unsigned char* rcu_key(const u_map_t* map, size_t idx) {
+    return (const unsigned char*)map->data_keys + idx * map->key_stride;
+}
+
+static inline const unsigned char* rcu_value(const u_map_t* map, size_t idx) {
+    return (const unsigned char*)map->data_values + idx * map->value_stride;
+}
+
+static inline size_t rcu_groups_mask(const u_map_t* map) {
+    return map->capacity / U_MAP_GROUP_WIDTH - 1;
+}
+
+static inline size_t rcu_hash_key(const u_map_t* map, const void* key) {
+    return u_map_finish_hash(map, map->hash_func(key));
+}
+
+static inline void rcu_cpu_relax() {
+#if defined(__SSE2__)
+    _mm_pause();
+#endif
+}
+
+//================================================================================
+//                        Версии групп (seqlock)
+//================================================================================
+
+// Писатель: версия становится нечетной до первой записи в группу и четной после последней
+static inline void rcu_write_begin(uint32_t* version) {
+    __atomic_store_n(version, *version + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void rcu_write_end(uint32_t* version) {
+    __atomic_store_n(version, *version + 1, __ATOMIC_RELEASE);
+}
+
+//================================================================================
+//                        Таблицы и эпохи
+//================================================================================
+
+static void rcu_table_free(u_map_rcu_table_t* table) {
+    if (table == nullptr) return;
+
+    u_map_destroy(&table->map);
+    free(table->versions);
+    free(table);
+}
+
+// Новая, еще не опубликованная таблица под count элементов
+static hm_error_t rcu_table_create(u_map_rcu_table_t** table_out, size_t count,
+                                   size_t key_size,   size_t key_align,
+                                   size_t value_size, size_t value_align,
+                                   key_func_t hash_func, key_cmp_t key_cmp) {
+    HARD_ASSERT(table_out != nullptr, "table_out is nullptr");
+
+    u_map_rcu_table_t* table = (u_map_rcu_table_t*)calloc(1, sizeof(u_map_rcu_table_t));
+    if (table == nullptr) return HM_ERR_MEM_ALLOC;
+
+    hm_error_t err = u_map_init(&table->map, 0, key_size, key_align, value_size, value_align, hash_func, key_cmp);
+    RETURN_IF_ERROR(err, free(table));
+
+    err = u_map_reserve(&table->map, count);
+    RETURN_IF_ERROR(err, rcu_table_free(table));
+
+    table->versions = (uint32_t*)calloc(rcu_groups_mask(&table->map) + 1, sizeof(uint32_t));
+    if (table->versions == nullptr) {
+        rcu_table_free(table);
+        return HM_ERR_MEM_ALLOC;
+    }
+
+    *table_out = table;
+    return HM_ERR_OK;
+}
+
+// Читатель объявляет эпоху до того, как взять таблицу: писатель, увидевший эту эпоху,
+// не освободит таблицы, снятые с публикации позже нее
+static const u_map_rcu_table_t* rcu_read_enter(const u_map_rcu_t* u_map, u_map_rcu_reader_t* reader) {
+    const uint64_t epoch = __atomic_load_n(&u_map->epoch, __ATOMIC_ACQUIRE);
+    __atomic_store_n(&reader->epoch, epoch, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return __atomic_load_n(&u_map->current, __ATOMIC_ACQUIRE);
+}
+
+static void rcu_read_exit(u_map_rcu_reader_t* reader) {
+    __atomic_store_n(&reader->epoch, 0, __ATOMIC_RELEASE);
+}
+
+static bool rcu_table_in_use(const u_map_rcu_t* u_map, const u_map_rcu_table_t* table) {
+    for (size_t i = 0; i < U_MAP_RCU_MAX_READERS; ++i) {
+        const uint64_t epoch = __atomic_load_n(&u_map->readers[i].epoch, __ATOMIC_ACQUIRE);
+        if (epoch != 0 && epoch < table->retire_epoch) return true;
+    }
+    return false;
+}
+
+static void rcu_reclaim_locked(u_map_rcu_t* u_map) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    u_map_rcu_table_t** link = &u_map->retired;
+    while (*link != nullptr) {
+        u_map_rcu_table_t* table = *link;
+        if (rcu_table_in_use(u_map, table)) {
+            link = &table->next_retired;
+            continue;
+        }
+        *link = table->next_retired;
+        rcu_table_free(table);
+    }
+}
+
+// Переносит все элементы в новую таблицу под count элементов и публикует ее
+static hm_error_t rcu_rebuild(u_map_rcu_t* u_map, size_t count) {
+    u_map_rcu_table_t* old_table = u_map->current;
+    const u_map_t*     old_map   = &old_table->map;
+
+    LOGGER_DEBUG("u_map_rcu: rebuilding for %zu elements", count);
+
+    u_map_rcu_table_t* table = nullptr;
+    hm_error_t err = rcu_table_create(&table, count,
+                                      old_map->key_size,   old_map->key_align,
+                                      old_map->value_size, old_map->value_align,
+                                      old_map->hash_func,  old_map->key_cmp);
+    RETURN_IF_ERROR(err);
+
+    for (size_t idx = 0; idx < old_map->capacity; ++idx) {
+        if (!u_map_ctrl_is_full(old_map->data_states[idx])) continue;
+        err = u_map_insert_elem(&table->map, rcu_key(old_map, idx), rcu_value(old_map, idx));
+        RETURN_IF_ERROR(err, rcu_table_free(table));
+    }
+
+    __atomic_store_n(&u_map->current, table, __ATOMIC_RELEASE);
+
+    old_table->retire_epoch = __atomic_add_fetch(&u_map->epoch, 1, __ATOMIC_SEQ_CST);
+    old_table->next_retired = u_map->retired;
+    u_map->retired          = old_table;
+
+    rcu_reclaim_locked(u_map);
+    return HM_ERR_OK;
+}
+
+//================================================================================
+//                        Проход (писатель)
+//================================================================================
+
+static bool rcu_find_slot(const u_map_t* map, const void* key, size_t hash, size_t* idx_out) {
+    const uint8_t h2 = u_map_hash_h2(hash);
+    u_map_probe_seq_t seq = u_map_probe_seq_start(hash, rcu_groups_mask(map));
+    do {
+        const size_t   base = seq.group * U_MAP_GROUP_WIDTH;
+        const uint8_t* ctrl = map->data_states + base;
+
+        for (u_map_group_mask_t match = u_map_group_match(ctrl, h2); match != 0; match &= match - 1) {
+            const size_t idx = base + u_map_mask_lowest_bit(match);
+            if (map->key_cmp(rcu_key(map, idx), key)) {
+                *idx_out = idx;
+                return true;
+            }
+        }
+
+        if (u_map_group_match_empty(ctrl) != 0) return false;
+    } while (u_map_probe_seq_next(&seq));
+
+    return false;
+}
+
+static bool rcu_find_free_slot(const u_map_t* map, size_t hash, size_t* idx_out) {
+    u_map_probe_seq_t seq = u_map_probe_seq_start(hash, rcu_groups_mask(map));
+    do {
+        const size_t base = seq.group * U_MAP_GROUP_WIDTH;
+        const u_map_group_mask_t free_mask = u_map_group_match_empty_or_deleted(map->data_states + base);
+        if (free_mask != 0) {
+            *idx_out = base + u_map_mask_lowest_bit(free_mask);
+            return true;
+        }
+    } while (u_map_probe_seq_next(&seq));
+
+    return false;
+}
+
+//================================================================================
+//                       Конструкторы / Деструкторы
+//================================================================================
+
+hm_error_t u_map_rcu_init(u_map_rcu_t* u_map, size_t capacity,
+                          size_t key_size,   size_t key_align,
+                          size_t value_size, size_t value_align,
+                          key_func_t hash_func, key_cmp_t key_cmp) {
+    HARD_ASSERT(u_map     != nullptr, "u_map is nullptr");
+    HARD_ASSERT(hash_func != nullptr, "hash_func is nullptr");
+    HARD_ASSERT(key_cmp   != nullptr, "key_cmp is nullptr");
+
+    LOGGER_DEBUG("u_map_rcu_init started");
+
+    memset((void*)u_map, 0, sizeof(*u_map));
+
+    u_map_rcu_table_t* table = nullptr;
+    const size_t count = (size_t)((double)capacity * MAX_LOAD_FACTOR);
+    hm_error_t err = rcu_table_create(&table, count, key_size, key_align, value_size, value_align,
+                                      hash_func, key_cmp);
+    RETURN_IF_ERROR(err);
+
+    if (pthread_mutex_init(&u_map->writer_lock, nullptr) != 0) {
+        rcu_table_free(table);
+        return HM_ERR_INTERNAL;
+    }
+
+    u_map->current = table;
+    u_map->epoch   = 1;
+    return HM_ERR_OK;
+}
+
+hm_error_t u_map_rcu_destroy(u_map_rcu_t* u_map) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+
+    LOGGER_DEBUG("u_map_rcu_destroy started");
+
+    while (u_map->retired != nullptr) {
+        u_map_rcu_table_t* next = u_map->retired->next_retired;
+        rcu_table_free(u_map->retired);
+        u_map->retired = next;
+    }
+    rcu_table_free(u_map->current);
+    pthread_mutex_destroy(&u_map->writer_lock);
+
+    memset((void*)u_map, 0, sizeof(*u_map));
+    return HM_ERR_OK;
+}
+
+u_map_rcu_reader_t* u_map_rcu_register_reader(u_map_rcu_t* u_map) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+
+    for (size_t i = 0; i < U_MAP_RCU_MAX_READERS; ++i) {
+        bool expected = false;
+        if (__atomic_compare_exchange_n(&u_map->readers[i].in_use, &expected, true, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            return &u_map->readers[i];
+        }
+    }
+
+    LOGGER_WARNING("u_map_rcu: all %d reader slots are taken", U_MAP_RCU_MAX_READERS);
+    return nullptr;
+}
+
+void u_map_rcu_unregister_reader(u_map_rcu_t* u_map, u_map_rcu_reader_t* reader) {
+    HARD_ASSERT(u_map  != nullptr, "u_map is nullptr");
+    HARD_ASSERT(reader != nullptr, "reader is nullptr");
+    HARD_ASSERT(reader >= u_map->readers && reader < u_map->readers + U_MAP_RCU_MAX_READERS,
+                "reader is registered in another map");
+    (void)u_map;
+
+    __atomic_store_n(&reader->epoch,  0,     __ATOMIC_RELEASE);
+    __atomic_store_n(&reader->in_use, false, __ATOMIC_RELEASE);
+}
+
+//================================================================================
+//                              Чтение
+//================================================================================
+
+bool u_map_rcu_get(const u_map_rcu_t* u_map, u_map_rcu_reader_t* reader, const void* key, void* value_out) {
+    HARD_ASSERT(u_map  != nullptr, "u_map is nullptr");
+    HARD_ASSERT(reader != nullptr, "reader is nullptr");
+    HARD_ASSERT(key    != nullptr, "key is nullptr");
+
+    const u_map_rcu_table_t* table = rcu_read_enter(u_map, reader);
+    const u_map_t*           map   = &table->map;
+
+    const size_t  hash = rcu_hash_key(map, key);
+    const uint8_t h2   = u_map_hash_h2(hash);
+
+    // Группа читается целиком между двумя одинаковыми четными версиями;
+    // key_cmp при этом может увидеть недописанный ключ — результат такого чтения отбрасывается
+    bool is_found = false;
+    bool is_done  = false;
+    u_map_probe_seq_t seq = u_map_probe_seq_start(hash, rcu_groups_mask(map));
+    do {
+        const size_t base    = seq.group * U_MAP_GROUP_WIDTH;
+        uint32_t*    version = &table->versions[seq.group];
+
+        for (;;) {
+            const uint32_t before = __atomic_load_n(version, __ATOMIC_ACQUIRE);
+            if (before & 1) {
+                rcu_cpu_relax();
+                continue;
+            }
+
+            uint8_t ctrl[U_MAP_GROUP_WIDTH];
+            memcpy(ctrl, map->data_states + base, sizeof(ctrl));
+
+            is_found = false;
+            for (u_map_group_mask_t match = u_map_group_match(ctrl, h2); match != 0; match &= match - 1) {
+                const size_t idx = base + u_map_mask_lowest_bit(match);
+                if (map->key_cmp(rcu_key(map, idx), key)) {
+                    if (value_out != nullptr) memcpy(value_out, rcu_value(map, idx), map->value_size);
+                    is_found = true;
+                    break;
+                }
+            }
+            is_done = is_found || u_map_group_match_empty(ctrl) != 0;
+
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(version, __ATOMIC_RELAXED) == before) break;
+        }
+    } while (!is_done && u_map_probe_seq_next(&seq));
+
+    rcu_read_exit(reader);
+    return is_found;
+}
+
+size_t u_map_rcu_size(const u_map_rcu_t* u_map) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+    return __atomic_load_n(&u_map->size, __ATOMIC_RELAXED);
+}
+
+//================================================================================
+//                              Запись
+//================================================================================
+
+static hm_error_t rcu_insert_locked(u_map_rcu_t* u_map, const void* key, const void* value) {
+    u_map_t* map = &u_map->current->map;
+    size_t hash  = rcu_hash_key(map, key);
+    size_t idx   = 0;
+
+    if (rcu_find_slot(map, key, hash, &idx)) {
+        uint32_t* version = &u_map->current->versions[idx / U_MAP_GROUP_WIDTH];
+        rcu_write_begin(version);
+        memcpy((unsigned char*)map->data_values + idx * map->value_stride, value, map->value_size);
+        rcu_write_end(version);
+        return HM_ERR_OK;
+    }
+
+    // Место под новый ключ (с учетом надгробий) — иначе новая таблица по живым элементам
+    if ((double)(map->occupied + 1) > (double)map->capacity * MAX_LOAD_FACTOR) {
+        hm_error_t err = rcu_rebuild(u_map, (map->size + 1) * 2);
+        RETURN_IF_ERROR(err);
+        map = &u_map->current->map;
+    }
+
+    if (!rcu_find_free_slot(map, hash, &idx)) return HM_ERR_FULL;
+
+    uint32_t* version = &u_map->current->versions[idx / U_MAP_GROUP_WIDTH];
+    rcu_write_begin(version);
+    memcpy((unsigned char*)map->data_keys   + idx * map->key_stride,   key,   map->key_size);
+    memcpy((unsigned char*)map->data_values + idx * map->value_stride, value, map->value_size);
+    if (map->data_states[idx] == EMPTY) map->occupied++;
+    map->data_states[idx] = u_map_hash_h2(hash);
+    map->size++;
+    rcu_write_end(version);
+
+    __atomic_store_n(&u_map->size, map->size, __ATOMIC_RELAXED);
+    return HM_ERR_OK;
+}
+
+hm_error_t u_map_rcu_insert(u_map_rcu_t* u_map, const void* key, const void* value) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+    HARD_ASSERT(key   != nullptr, "key is nullptr");
+    HARD_ASSERT(value != nullptr, "value is nullptr");
+
+    pthread_mutex_lock(&u_map->writer_lock);
+    const hm_error_t err = rcu_insert_locked(u_map, key, value);
+    pthread_mutex_unlock(&u_map->writer_lock);
+
+    return err;
+}
+
+static hm_error_t rcu_remove_locked(u_map_rcu_t* u_map, const void* key, void* value_out) {
+    u_map_t* map = &u_map->current->map;
+
+    size_t idx = 0;
+    if (!rcu_find_slot(map, key, rcu_hash_key(map, key), &idx)) return HM_ERR_NOT_FOUND;
+
+    if (value_out != nullptr) memcpy(value_out, rcu_value(map, idx), map->value_size);
+
+    // Как в u_map_erase_slot: надгробие нужно, только если в группе нет EMPTY
+    const size_t base = (idx / U_MAP_GROUP_WIDTH) * U_MAP_GROUP_WIDTH;
+    uint32_t* version = &u_map->current->versions[idx / U_MAP_GROUP_WIDTH];
+    rcu_write_begin(version);
+    if (u_map_group_match_empty(map->data_states + base) != 0) {
+        map->data_states[idx] = EMPTY;
+        map->occupied--;
+    } else {
+        map->data_states[idx] = DELETED;
+    }
+    map->size--;
+    rcu_write_end(version);
+
+    __atomic_store_n(&u_map->size, map->size, __ATOMIC_RELAXED);
+    return HM_ERR_OK;
+}
+
+hm_error_t u_map_rcu_remove(u_map_rcu_t* u_map, const void* key, void* value_out) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+    HARD_ASSERT(key   != nullptr, "key is nullptr");
+
+    pthread_mutex_lock(&u_map->writer_lock);
+    const hm_error_t err = rcu_remove_locked(u_map, key, value_out);
+    pthread_mutex_unlock(&u_map->writer_lock);
+
+    return err;
+}
+
+hm_error_t u_map_rcu_reserve(u_map_rcu_t* u_map, size_t count) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+
+    pthread_mutex_lock(&u_map->writer_lock);
+
+    hm_error_t err = HM_ERR_OK;
+    const u_map_t* map = &u_map->current->map;
+    if ((double)count > (double)map->capacity * MAX_LOAD_FACTOR) {
+        err = rcu_rebuild(u_map, count);
+    }
+
+    pthread_mutex_unlock(&u_map->writer_lock);
+    return err;
+}
+
+void u_map_rcu_reclaim(u_map_rcu_t* u_map) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+
+    pthread_mutex_lock(&u_map->writer_lock);
+    rcu_reclaim_locked(u_map);
+    pthread_mutex_unlock(&u_map->writer_lock);
+}
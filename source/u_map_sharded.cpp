@@ -0,0 +1,163 @@
+#include "u_map_sharded.h"
+#include "u_map_group.h"
+#include "asserts.h"
+#include "error_handler.h"
+#include "logger.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+//================================================================================
+//                        Помошники
+//================================================================================
+
+static size_t round_up_pow2(size_t n) {
+    size_t p2 = 1;
+    while (p2 < n) p2 <<= 1;
+    return p2;
+}
+
+// Шард по старшим битам: внутри шарда группу выбирают младшие биты h1,
+// так что распределения по шардам и внутри шарда не зависят друг от друга.
+// Хэш шарда посолен: без соли ключи, подобранные под u_map_mix_hash, легли бы в один шард.
+// raw_hash — результат hash_func: шард досаливает его сам, второй раз hash_func не зовется
+static u_map_shard_t* u_map_sharded_pick(const u_map_sharded_t* u_map, size_t raw_hash) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+
+    if (u_map->shard_count == 1) return u_map->shards;
+
+    const size_t hash = u_map->seed == 0 && u_map->strong_hash ? raw_hash
+                                                               : u_map_mix_hash(raw_hash ^ (size_t)u_map->seed);
+    return u_map->shards + (hash >> u_map->shard_shift);
+}
+
+//================================================================================
+//                       Конструкторы / Деструкторы
+//================================================================================
+
+hm_error_t u_map_sharded_init(u_map_sharded_t* u_map, size_t shard_count, size_t capacity,
+                              size_t key_size,   size_t key_align,
+                              size_t value_size, size_t value_align,
+                              key_func_t hash_func, key_cmp_t key_cmp,
+                              const u_map_opts_t* opts) {
+    HARD_ASSERT(u_map     != nullptr, "u_map is nullptr");
+    HARD_ASSERT(hash_func != nullptr, "hash_func is nullptr");
+    HARD_ASSERT(key_cmp   != nullptr, "key_cmp is nullptr");
+
+    LOGGER_DEBUG("u_map_sharded_init started");
+
+    memset(u_map, 0, sizeof(*u_map));
+
+    shard_count = round_up_pow2(shard_count == 0 ? U_MAP_DEFAULT_SHARDS : shard_count);
+
+    unsigned bits = 0;
+    while (((size_t)1 << bits) < shard_count) bits++;
+
+    u_map_shard_t* shards = (u_map_shard_t*)aligned_alloc(U_MAP_CACHE_LINE, shard_count * sizeof(u_map_shard_t));
+    if (shards == nullptr) return HM_ERR_MEM_ALLOC;
+    memset((void*)shards, 0, shard_count * sizeof(u_map_shard_t));
+
+    const size_t shard_capacity = capacity / shard_count;
+    for (size_t i = 0; i < shard_count; ++i) {
+        hm_error_t err = HM_ERR_OK;
+        if (pthread_rwlock_init(&shards[i].lock, nullptr) != 0) {
+            err = HM_ERR_INTERNAL;
+        } else {
+            err = u_map_init_ex(&shards[i].map, shard_capacity, key_size, key_align, value_size, value_align,
+                                hash_func, key_cmp, opts);
+            if (err != HM_ERR_OK) pthread_rwlock_destroy(&shards[i].lock);
+        }
+
+        if (err != HM_ERR_OK) {
+            for (size_t j = 0; j < i; ++j) {
+                u_map_destroy(&shards[j].map);
+                pthread_rwlock_destroy(&shards[j].lock);
+            }
+            free(shards);
+            RETURN_IF_ERROR(err);
+        }
+    }
+
+    u_map->shards      = shards;
+    u_map->shard_count = shard_count;
+    u_map->shard_shift = (unsigned)(sizeof(size_t) * 8) - bits;
+    u_map->hash_func   = hash_func;
+    // Соль шардов не меняется: ключи уже разложены. С random_seed — случайная соль первого шарда
+    u_map->seed        = shards[0].map.seed;
+    u_map->strong_hash = shards[0].map.strong_hash;
+
+    return HM_ERR_OK;
+}
+
+hm_error_t u_map_sharded_destroy(u_map_sharded_t* u_map) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+
+    LOGGER_DEBUG("u_map_sharded_destroy started");
+
+    for (size_t i = 0; i < u_map->shard_count; ++i) {
+        u_map_destroy(&u_map->shards[i].map);
+        pthread_rwlock_destroy(&u_map->shards[i].lock);
+    }
+    free(u_map->shards);
+
+    memset(u_map, 0, sizeof(*u_map));
+    return HM_ERR_OK;
+}
+
+//================================================================================
+//                              Базовые функции
+//================================================================================
+
+bool u_map_sharded_get(u_map_sharded_t* u_map, const void* key, void* value_out) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+    HARD_ASSERT(key   != nullptr, "key is nullptr");
+
+    const size_t raw_hash = u_map->hash_func(key);
+    u_map_shard_t* shard  = u_map_sharded_pick(u_map, raw_hash);
+
+    pthread_rwlock_rdlock(&shard->lock);
+    const bool is_found = u_map_get_elem_hashed(&shard->map, key, raw_hash, value_out);
+    pthread_rwlock_unlock(&shard->lock);
+
+    return is_found;
+}
+
+hm_error_t u_map_sharded_insert(u_map_sharded_t* u_map, const void* key, const void* value) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+    HARD_ASSERT(key   != nullptr, "key is nullptr");
+
+    const size_t raw_hash = u_map->hash_func(key);
+    u_map_shard_t* shard  = u_map_sharded_pick(u_map, raw_hash);
+
+    pthread_rwlock_wrlock(&shard->lock);
+    const hm_error_t err = u_map_insert_elem_hashed(&shard->map, key, raw_hash, value);
+    pthread_rwlock_unlock(&shard->lock);
+
+    return err;
+}
+
+hm_error_t u_map_sharded_remove(u_map_sharded_t* u_map, const void* key, void* value_out) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+    HARD_ASSERT(key   != nullptr, "key is nullptr");
+
+    const size_t raw_hash = u_map->hash_func(key);
+    u_map_shard_t* shard  = u_map_sharded_pick(u_map, raw_hash);
+
+    pthread_rwlock_wrlock(&shard->lock);
+    const hm_error_t err = u_map_remove_elem_hashed(&shard->map, key, raw_hash, value_out);
+    pthread_rwlock_unlock(&shard->lock);
+
+    return err;
+}
+
+size_t u_map_sharded_size(u_map_sharded_t* u_map) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+
+    size_t size = 0;
+    for (size_t i = 0; i < u_map->shard_count; ++i) {
+        pthread_rwlock_rdlock(&u_map->shards[i].lock);
+        size += u_map_size(&u_map->shards[i].map);
+        pthread_rwlock_unlock(&u_map->shards[i].lock);
+    }
+    return size;
+}
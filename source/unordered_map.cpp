@@ -1,20 +1,32 @@
 #include "unordered_map.h"
+#include "u_map_group.h"
+#include "u_map_hash.h"
 #include "asserts.h"
 #include "error_handler.h"
 #include "logger.h"
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
 #include <stdint.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/random.h>
+#include <pthread.h>
 
 static const size_t INITIAL_CAPACITY        = 32;
+
+// Пороги по умолчанию (нули в u_map_load_policy_t); порог сжатия — max_load / 4
 static const double MAX_LOAD_FACTOR         = 0.7;
-static const double MIN_LOAD_FACTOR         = MAX_LOAD_FACTOR / 4.0;
 static const double MAX_GARBAGE_LOAD_FACTOR = 0.25;
 
-static const uint64_t GOLD_64               = 0x9e3779b97f4a7c15ULL;
-static const uint64_t BIG_RANDOM_EVEN_NUM_1 = 0xbf58476d1ce4e5b9ULL;
-static const uint64_t BIG_RANDOM_EVEN_NUM_2 = 0x94d049bb133111ebULL;
+// Расстояние от домашнего слота в robin hood режиме хранится в 7 битах;
+// RH_MAX_DIST означает «не меньше RH_MAX_DIST», точное значение тогда считается по хэшу
+static const uint8_t RH_MAX_DIST            = 0x7F;
 
 //================================================================================
 //                        Помошники
@@ -49,543 +61,3669 @@ static size_t max_size_t(size_t a, size_t b) {
     return a > b ? a : b; 
 }
 
-static void u_map_calc_layout(size_t  capacity,
-                              size_t  key_size,          size_t key_align,
-                              size_t  value_size,        size_t value_align,
-                              size_t* key_stride_out,    size_t* value_stride_out,
-                              size_t* values_offset_out, size_t* states_offset_out,
-                              size_t* total_bytes_out) {
-    HARD_ASSERT(key_stride_out    != nullptr, "key_stride_out is nullptr");
-    HARD_ASSERT(value_stride_out  != nullptr, "value_stride_out is nullptr");
-    HARD_ASSERT(values_offset_out != nullptr, "values_offset_out is nullptr");
-    HARD_ASSERT(states_offset_out != nullptr, "states_offset_out is nullptr");
-    HARD_ASSERT(total_bytes_out   != nullptr, "total_bytes_out is nullptr");
-
-    const size_t key_stride   = round_up_to(key_size,   key_align);
-    const size_t value_stride = round_up_to(value_size, value_align);
-
-    const size_t keys_bytes    = capacity * key_stride;
-    const size_t values_offset = round_up_to(keys_bytes, value_align);
-    const size_t values_bytes  = values_offset + capacity * value_stride;
- 
-    const size_t states_offset = round_up_to(values_bytes, alignof(elem_state_t));
-    const size_t total_bytes   = states_offset + capacity * sizeof(elem_state_t);
-
-    *key_stride_out    = key_stride;
-    *value_stride_out  = value_stride;
-    *values_offset_out = values_offset;
-    *states_offset_out = states_offset;
-    *total_bytes_out   = total_bytes;
+// Раскладка буфера таблицы: [keys][values][hashes (опционально)][index][alive][states].
+// index и alive есть только в плотной раскладке; записей там столько же, сколько слотов
+typedef struct u_map_layout_t {
+    size_t key_stride;
+    size_t value_stride;
+    size_t values_offset;
+    size_t hashes_offset;   // == index_offset, если хэши не хранятся
+    size_t index_offset;    // == states_offset, если раскладка обычная
+    size_t alive_offset;
+    size_t states_offset;
+    size_t total_bytes;
+} u_map_layout_t;
+
+static u_map_layout_t u_map_calc_layout(size_t capacity,
+                                        size_t key_size,   size_t key_align,
+                                        size_t value_size, size_t value_align,
+                                        bool   store_hashes, bool dense) {
+    u_map_layout_t layout = {};
+
+    layout.key_stride   = round_up_to(key_size,   key_align);
+    layout.value_stride = round_up_to(value_size, value_align);
+
+    const size_t keys_bytes = capacity * layout.key_stride;
+    layout.values_offset    = round_up_to(keys_bytes, value_align);
+    const size_t values_end = layout.values_offset + capacity * layout.value_stride;
+
+    layout.hashes_offset = store_hashes ? round_up_to(values_end, alignof(size_t)) : values_end;
+    const size_t hashes_end = layout.hashes_offset + (store_hashes ? capacity * sizeof(size_t) : 0);
+
+    layout.index_offset  = dense ? round_up_to(hashes_end, alignof(uint32_t)) : hashes_end;
+    layout.alive_offset  = layout.index_offset + (dense ? capacity * sizeof(uint32_t) : 0);
+    layout.states_offset = layout.alive_offset + (dense ? capacity : 0);
+    layout.total_bytes   = layout.states_offset + max_size_t(capacity, U_MAP_GROUP_WIDTH);
+
+    return layout;
 }
 
 size_t u_map_required_bytes(size_t capacity,
                             size_t key_size,   size_t key_align,
                             size_t value_size, size_t value_align) {
+    return u_map_required_bytes_ex(capacity, key_size, key_align, value_size, value_align, nullptr);
+}
+
+size_t u_map_required_bytes_ex(size_t capacity,
+                               size_t key_size,   size_t key_align,
+                               size_t value_size, size_t value_align,
+                               const u_map_opts_t* opts) {
     capacity = next_pow2_size_t(capacity);
     if (capacity == 0) return 0;
 
-    size_t key_stride = 0, value_stride = 0, values_offset = 0, states_offset = 0, total_bytes = 0;
-    u_map_calc_layout(capacity, key_size, key_align, value_size, value_align,
-                      &key_stride, &value_stride, &values_offset, &states_offset, &total_bytes);
-    return total_bytes;
+    const bool store_hashes = opts != nullptr && opts->store_hashes;
+    const bool dense        = opts != nullptr && opts->dense;
+    return u_map_calc_layout(capacity, key_size, key_align, value_size, value_align, store_hashes, dense).total_bytes;
 }
 
-static inline void* get_key(const u_map_t* u_map, size_t index) {
+// Запись, которая лежит в слоте: в обычной раскладке это сам слот
+static inline size_t slot_entry(const u_map_t* u_map, size_t index) {
+    return u_map->data_index != nullptr ? u_map->data_index[index] : index;
+}
+
+static inline void* entry_key(const u_map_t* u_map, size_t entry) {
     HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
     HARD_ASSERT(u_map->data_keys != nullptr, "data_keys is nullptr");
-    return (void*)((unsigned char*)u_map->data_keys + index * u_map->key_stride);
+    return (void*)((unsigned char*)u_map->data_keys + entry * u_map->key_stride);
 }
 
-static inline void* get_value(const u_map_t* u_map, size_t index) {
+static inline void* entry_value(const u_map_t* u_map, size_t entry) {
     HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
     HARD_ASSERT(u_map->data_values != nullptr, "data_values is nullptr");
-    return (void*)((unsigned char*)u_map->data_values + index * u_map->value_stride);
+    return (void*)((unsigned char*)u_map->data_values + entry * u_map->value_stride);
 }
 
-//================================================================================
-//                        Хэишрование и проход
-//================================================================================
+static inline void* get_key(const u_map_t* u_map, size_t index) {
+    return entry_key(u_map, slot_entry(u_map, index));
+}
 
-static size_t mix_hash(size_t x) { // splitmix64
-    if (sizeof(size_t) != 8) {
-        LOGGER_WARNING("size_t is not 64 bits; hashing quality may degrade");
-    }
-    x += (size_t)GOLD_64;
-    x = (x ^ (x >> 30)) * (size_t)BIG_RANDOM_EVEN_NUM_1;
-    x = (x ^ (x >> 27)) * (size_t)BIG_RANDOM_EVEN_NUM_2;
-    x = x ^ (x >> 31);
-    return x;
+static inline void* get_value(const u_map_t* u_map, size_t index) {
+    return entry_value(u_map, slot_entry(u_map, index));
 }
 
-static size_t get_index_and_step(const u_map_t* u_map, const void* key, size_t* step_out) {
-    HARD_ASSERT(u_map    != nullptr, "u_map is nullptr");
-    HARD_ASSERT(key      != nullptr, "key is nullptr");
-    HARD_ASSERT(step_out != nullptr, "step_out is nullptr");
-    HARD_ASSERT(u_map->capacity != 0, "capacity is 0");
+static u_map_opts_t u_map_default_opts() {
+    u_map_opts_t opts = {};
+    opts.probe        = U_MAP_PROBE_SWISS;
+    opts.store_hashes = false;
+    opts.rehash_step  = 0;
+    opts.dense        = false;
+    opts.bytes_keys   = false;
+    opts.strong_hash  = false;
+    opts.seed         = 0;
+    opts.random_seed  = false;
+    opts.no_reseed    = false;
+    opts.threads      = 0;
+    opts.executor.run = nullptr;
+    opts.executor.ctx = nullptr;
+    opts.cow_snapshots = false;
+    return opts;
+}
 
-    size_t raw_hash = u_map->hash_func(key);
-    size_t h1 = mix_hash(raw_hash);
-    size_t h2 = mix_hash(raw_hash ^ (size_t)GOLD_64);
+// Нули в политике заменяются значениями по умолчанию
+static u_map_load_policy_t u_map_resolve_load_policy(const u_map_load_policy_t* policy) {
+    HARD_ASSERT(policy != nullptr, "policy is nullptr");
 
-    size_t mod = u_map->capacity;
-    if (mod > 1) *step_out = ((h2 % (mod - 1)) + 1) | 1;  // [1..mod-1], odd
-    else         *step_out = 1;
+    u_map_load_policy_t used = *policy;
+    if (used.max_load     <= 0.0) used.max_load     = MAX_LOAD_FACTOR;
+    if (used.shrink_load  <= 0.0) used.shrink_load  = used.max_load / 4.0;
+    if (used.garbage_load <= 0.0) used.garbage_load = MAX_GARBAGE_LOAD_FACTOR;
+    return used;
+}
 
-    return h1 % mod;
+static bool load_share_is_valid(double share) {
+    return share >= 0.0 && share < 1.0;
 }
 
-static bool u_map_find_slot(const u_map_t* u_map, const void* key, size_t* idx_out) {
-    HARD_ASSERT(u_map   != nullptr, "u_map is nullptr");
-    HARD_ASSERT(key     != nullptr, "key is nullptr");
-    HARD_ASSERT(idx_out != nullptr, "idx_out is nullptr");
+// Доли в [0, 1) и зазор между порогами сжатия и роста (см. u_map_load_policy_t)
+static hm_error_t u_map_check_load_policy(const u_map_load_policy_t* policy) {
+    HARD_ASSERT(policy != nullptr, "policy is nullptr");
 
-    if (u_map->capacity == 0) return false;
+    const u_map_load_policy_t used = u_map_resolve_load_policy(policy);
+    if (load_share_is_valid(policy->max_load) && load_share_is_valid(policy->shrink_load) &&
+        load_share_is_valid(policy->garbage_load) && used.shrink_load * 4.0 <= used.max_load) {
+        return HM_ERR_OK;
+    }
 
-    size_t step = 0;
-    size_t start = get_index_and_step(u_map, key, &step);
-    size_t idx = start;
+    LOGGER_ERROR("bad load policy: max_load %g, shrink_load %g, garbage_load %g",
+                 policy->max_load, policy->shrink_load, policy->garbage_load);
+    return HM_ERR_BAD_ARG;
+}
 
-    while (u_map->data_states[idx] != EMPTY) {
-        if (u_map->data_states[idx] == USED &&
-            u_map->key_cmp(get_key(u_map, idx), key)) {
-            *idx_out = idx;
-            return true;
-        }
+// Параметры, с которыми была создана таблица, — для пересоздания при рехэше и копировании
+static u_map_opts_t u_map_opts_of(const u_map_t* u_map) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
 
-        idx = (idx + step) % u_map->capacity;
-        if (idx == start) break;
+    u_map_opts_t opts = u_map_default_opts();
+    opts.probe        = u_map->probe;
+    opts.store_hashes = u_map->data_hashes != nullptr;
+    opts.rehash_step  = u_map->rehash_step;
+    opts.dense        = u_map->data_index != nullptr;
+    opts.bytes_keys   = u_map->key_arena  != nullptr;
+    opts.strong_hash  = u_map->strong_hash;
+    opts.load         = u_map->load;
+    opts.seed         = u_map->seed;
+    opts.no_reseed    = u_map->no_reseed;
+    opts.threads      = u_map->threads;
+    opts.executor     = u_map->executor;
+    opts.cow_snapshots = u_map->cow != nullptr;
+    return opts;
+}
+
+// Соль из getrandom; если его нет — из времени и адреса стека. Никогда не 0 («без соли»)
+static uint64_t u_map_random_seed() {
+    uint64_t seed = 0;
+    if (getrandom(&seed, sizeof(seed), GRND_NONBLOCK) != (ssize_t)sizeof(seed)) {
+        static uint64_t calls = 0;
+        struct timespec ts = {};
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        seed = (uint64_t)u_map_mix_hash((size_t)((uint64_t)ts.tv_nsec ^ ((uint64_t)ts.tv_sec << 32) ^
+                                                 (uint64_t)(uintptr_t)&seed ^
+                                                 __atomic_add_fetch(&calls, U_MAP_GOLD_64, __ATOMIC_RELAXED)));
     }
+    return seed | 1;
+}
 
-    return false;
+static size_t u_map_ctrl_bytes(const u_map_t* u_map) {
+    return max_size_t(u_map->capacity, U_MAP_GROUP_WIDTH);
 }
 
-static bool u_map_find_insert_slot(u_map_t* u_map, const void* key, size_t* idx_out, bool* is_new_out) {
-    HARD_ASSERT(u_map      != nullptr, "u_map is nullptr");
-    HARD_ASSERT(key        != nullptr, "key is nullptr");
-    HARD_ASSERT(idx_out    != nullptr, "idx_out is nullptr");
-    HARD_ASSERT(is_new_out != nullptr, "is_new_out is nullptr");
+static void u_map_reset_states(u_map_t* u_map) {
+    HARD_ASSERT(u_map              != nullptr, "u_map is nullptr");
+    HARD_ASSERT(u_map->data_states != nullptr, "data_states is nullptr");
 
-    if (u_map->capacity == 0) return false;
+    memset(u_map->data_states, EMPTY, u_map->capacity);
+    if (u_map->capacity < U_MAP_GROUP_WIDTH) {
+        memset(u_map->data_states + u_map->capacity, SENTINEL, U_MAP_GROUP_WIDTH - u_map->capacity);
+    }
+}
 
-    size_t step = 0;
-    size_t start = get_index_and_step(u_map, key, &step);
-    size_t idx = start;
-    size_t first_deleted = (size_t)-1;
+//================================================================================
+//                   Снимки: копирование страниц при записи
+//================================================================================
 
-    while (u_map->data_states[idx] != EMPTY) {
-        if (u_map->data_states[idx] == USED &&
-            u_map->key_cmp(get_key(u_map, idx), key)) {
-            *idx_out = idx;
-            *is_new_out = false;
-            return true;
-        }
+// Буфер таблицы с opts.cow_snapshots лежит в memfd и отображен MAP_SHARED, снимок — MAP_PRIVATE
+// отображение того же memfd. Пока снимок не писал в страницу, он видит общую страницу кэша, а с ней
+// и все записи таблицы. Поэтому перед первой записью таблицы в страницу после снимка в ту же страницу
+// снимка пишется ее же байт: ядро отдает снимку личную копию с содержимым до записи. Снимок стоит
+// одно mmap и по странице памяти на каждую измененную после него страницу.
+//
+// Закрыть снимок можно из любого потока, а список снимков ведет только таблица, поэтому отображение
+// снимает тот, кто отпускает его вторым. Снимок помечает себя RELEASED, и таблица уберет его при
+// следующей записи или снимке. Таблица при смене буфера помечает снимки DETACHED, и каждый уберет себя сам
+enum { COW_ATTACHED = 0, COW_RELEASED = 1, COW_DETACHED = 2 };
+
+typedef struct u_map_cow_view_t {
+    struct u_map_cow_view_t* next;
+    unsigned char*           view;
+    size_t                   bytes;
+    uint64_t*                saved;       // бит страницы: у снимка уже своя копия
+    int                      state;
+} u_map_cow_view_t;
+
+typedef struct u_map_cow_t {
+    int                      fd;
+    unsigned char*           base;        // == data таблицы
+    size_t                   bytes;       // кратно странице
+    unsigned                 page_shift;
+    u_map_cow_view_t*        views;
+} u_map_cow_t;
+
+static hm_error_t u_map_cow_create(size_t bytes, u_map_cow_t** cow_out) {
+    const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+
+    u_map_cow_t* cow = (u_map_cow_t*)calloc(1, sizeof(u_map_cow_t));
+    if (cow == nullptr) return HM_ERR_MEM_ALLOC;
+    cow->bytes      = round_up_to(bytes, page);
+    cow->page_shift = (unsigned)__builtin_ctzl(page);
+
+    cow->fd = memfd_create("u_map", MFD_CLOEXEC);
+    if (cow->fd < 0) {
+        free(cow);
+        return HM_ERR_MEM_ALLOC;
+    }
 
-        if (u_map->data_states[idx] == DELETED && first_deleted == (size_t)-1) {
-            first_deleted = idx;
-        }
+    void* base = MAP_FAILED;
+    if (ftruncate(cow->fd, (off_t)cow->bytes) == 0) {
+        base = mmap(nullptr, cow->bytes, PROT_READ | PROT_WRITE, MAP_SHARED, cow->fd, 0);
+    }
+    if (base == MAP_FAILED) {
+        close(cow->fd);
+        free(cow);
+        return HM_ERR_MEM_ALLOC;
+    }
+
+    cow->base = (unsigned char*)base;
+    *cow_out  = cow;
+    return HM_ERR_OK;
+}
+
+static void u_map_cow_view_free(u_map_cow_view_t* view) {
+    munmap(view->view, view->bytes);
+    free(view->saved);
+    free(view);
+}
 
-        idx = (idx + step) % u_map->capacity;
-        if (idx == start) break;
+// Снимок закрыт; если таблица еще пишет в его буфер, отображение снимет она
+static void u_map_cow_view_release(u_map_cow_view_t* view) {
+    int expected = COW_ATTACHED;
+    if (__atomic_compare_exchange_n(&view->state, &expected, COW_RELEASED, false,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        return;
     }
+    u_map_cow_view_free(view);
+}
 
-    if (u_map->data_states[idx] == EMPTY) {
-        *idx_out = (first_deleted != (size_t)-1) ? first_deleted : idx;
-        *is_new_out = true;
-        return true;
+// Убирает из списка закрытые снимки
+static void u_map_cow_sweep(u_map_cow_t* cow) {
+    u_map_cow_view_t** link = &cow->views;
+    while (*link != nullptr) {
+        u_map_cow_view_t* view = *link;
+        if (__atomic_load_n(&view->state, __ATOMIC_ACQUIRE) == COW_RELEASED) {
+            *link = view->next;
+            u_map_cow_view_free(view);
+        } else {
+            link = &view->next;
+        }
+    }
+}
+
+// Таблица больше не пишет в этот буфер (рехэш, destroy): открытые снимки живут дальше сами
+static void u_map_cow_free(u_map_cow_t* cow) {
+    for (u_map_cow_view_t* view = cow->views; view != nullptr;) {
+        u_map_cow_view_t* next = view->next;
+        int expected = COW_ATTACHED;
+        if (!__atomic_compare_exchange_n(&view->state, &expected, COW_DETACHED, false,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            u_map_cow_view_free(view);
+        }
+        view = next;
     }
 
+    munmap(cow->base, cow->bytes);
+    close(cow->fd);
+    free(cow);
+}
 
-    if (first_deleted != (size_t)-1) {
-        *idx_out = first_deleted;
-        *is_new_out = true;
-        return true;
+// Страницы [ptr, ptr + len) получают копию в каждом снимке, где ее еще нет. Запись того же байта
+// безопасна для потоков, читающих снимок: до копии и после они видят одно и то же. Байт берется
+// из общего отображения (таблица эту страницу еще не меняла) — у снимка одна ошибка страницы, а не две
+static void u_map_cow_save_range(u_map_cow_t* cow, const void* ptr, size_t len) {
+    if (len == 0) return;
+
+    const size_t offset = (size_t)((const unsigned char*)ptr - cow->base);
+    const size_t first  = offset >> cow->page_shift;
+    const size_t last   = (offset + len - 1) >> cow->page_shift;
+
+    for (u_map_cow_view_t* view = cow->views; view != nullptr; view = view->next) {
+        for (size_t page = first; page <= last; ++page) {
+            uint64_t*      word = view->saved + page / 64;
+            const uint64_t bit  = (uint64_t)1 << (page % 64);
+            if (*word & bit) continue;
+
+            const size_t at = page << cow->page_shift;
+            *(volatile unsigned char*)(view->view + at) = cow->base[at];
+            *word |= bit;
+        }
     }
+}
 
-    return false;
+static inline bool u_map_cow_active(const u_map_t* u_map) {
+    return u_map->cow != nullptr && u_map->cow->views != nullptr;
 }
 
-//================================================================================
-//                        Рехэш и нормализация
-//================================================================================
+static void u_map_cow_save_entry_slow(const u_map_t* u_map, size_t entry) {
+    u_map_cow_t* cow = u_map->cow;
+    u_map_cow_save_range(cow, entry_key  (u_map, entry), u_map->key_size);
+    u_map_cow_save_range(cow, entry_value(u_map, entry), u_map->value_size);
+    if (u_map->data_hashes != nullptr) u_map_cow_save_range(cow, u_map->data_hashes + entry, sizeof(size_t));
+    if (u_map->data_alive  != nullptr) u_map_cow_save_range(cow, u_map->data_alive  + entry, 1);
+}
 
-static hm_error_t u_map_rehash(u_map_t* u_map, size_t new_capacity) {
-    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+static void u_map_cow_save_slot_slow(const u_map_t* u_map, size_t idx) {
+    u_map_cow_sweep(u_map->cow);
+    if (u_map->cow->views == nullptr) return;
 
-    if (u_map->is_static) return HM_ERR_OK;
+    u_map_cow_save_range(u_map->cow, u_map->data_states + idx, 1);
+    if (u_map->data_index == nullptr) {
+        u_map_cow_save_entry_slow(u_map, idx);
+        return;
+    }
 
-    if (new_capacity < INITIAL_CAPACITY)
-        new_capacity = INITIAL_CAPACITY;
+    u_map_cow_save_range(u_map->cow, u_map->data_index + idx, sizeof(uint32_t));
+    if (u_map_ctrl_is_full(u_map->data_states[idx])) u_map_cow_save_entry_slow(u_map, u_map->data_index[idx]);
+}
 
-    new_capacity = next_pow2_size_t(new_capacity);
+// Перед любой записью в слот: его управляющий байт и все, что к нему относится
+// (в плотной раскладке — номер записи и сама запись, если слот занят)
+static inline void u_map_cow_save_slot(const u_map_t* u_map, size_t idx) {
+    if (u_map_cow_active(u_map)) u_map_cow_save_slot_slow(u_map, idx);
+}
 
-    u_map_t new_map;
-    memset(&new_map, 0, sizeof(new_map));
-    hm_error_t err = u_map_init(&new_map, new_capacity,
-                             u_map->key_size,   u_map->key_align,
-                             u_map->value_size, u_map->value_align,
-                             u_map->hash_func, u_map->key_cmp);
-    RETURN_IF_ERROR(err);
+// Плотная раскладка: новая запись в конце, слот ее еще не знает
+static inline void u_map_cow_save_entry(const u_map_t* u_map, size_t entry) {
+    if (u_map_cow_active(u_map)) u_map_cow_save_entry_slow(u_map, entry);
+}
 
-    for (size_t i = 0; i < u_map->capacity; ++i) {
-        if (u_map->data_states[i] != USED) continue;
+// Перед перестройкой буфера на месте
+static void u_map_cow_save_all(const u_map_t* u_map) {
+    if (!u_map_cow_active(u_map)) return;
+    u_map_cow_sweep(u_map->cow);
+    if (u_map->cow->views != nullptr) u_map_cow_save_range(u_map->cow, u_map->cow->base, u_map->cow->bytes);
+}
 
-        const void* key   = get_key(u_map, i);
-        const void* value = get_value(u_map, i);
+//================================================================================
+//                        Память
+//================================================================================
 
-        bool is_new = false;
-        size_t idx = 0;
-        bool is_not_full = u_map_find_insert_slot(&new_map, key, &idx, &is_new);
-        if (!is_not_full) {
-            u_map_destroy(&new_map);
-            return HM_ERR_FULL;
-        }
+static void* default_alloc(void* ctx, size_t size, size_t align) {
+    (void)ctx;
+    if (align <= alignof(max_align_t)) return calloc(1, size);
 
-        new_map.data_states[idx] = USED;
-        memcpy(get_key  (&new_map, idx), key,   u_map->key_size);
-        memcpy(get_value(&new_map, idx), value, u_map->value_size);
-        new_map.size++;
-        new_map.occupied++;
-    }
+    void* ptr = aligned_alloc(align, round_up_to(size, align));
+    if (ptr != nullptr) memset(ptr, 0, size);
+    return ptr;
+}
 
-    free(u_map->data);
-    *u_map = new_map;
-    return HM_ERR_OK;
+static void default_free(void* ctx, void* ptr, size_t size) {
+    (void)ctx;
+    (void)size;
+    free(ptr);
 }
 
-static hm_error_t normalize_capacity(u_map_t* u_map) {
-    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
-    HARD_ASSERT(u_map->occupied >= u_map->size, "Ocupied elems less than elems");
+u_map_allocator_t u_map_default_allocator() {
+    u_map_allocator_t allocator = {};
+    allocator.alloc   = default_alloc;
+    allocator.free    = default_free;
+    allocator.ctx     = nullptr;
+    return allocator;
+}
 
-    if (u_map->is_static || u_map->capacity == 0)
-        return HM_ERR_OK;
+static inline void* u_map_mem_alloc(const u_map_t* u_map, size_t size, size_t align) {
+    return u_map->allocator.alloc(u_map->allocator.ctx, size, align);
+}
 
-    const double load_occupied = (double)u_map->occupied                 / (double)u_map->capacity;
-    const double load_real     = (double)u_map->size                     / (double)u_map->capacity;
-    const double load_garbage  = (double)(u_map->occupied - u_map->size) / (double)u_map->capacity;
-    size_t new_capacity = u_map->capacity;
-    bool need_rehash = false;
+static inline void u_map_mem_free(const u_map_t* u_map, void* ptr, size_t size) {
+    if (ptr != nullptr) u_map->allocator.free(u_map->allocator.ctx, ptr, size);
+}
 
-    if (u_map->capacity > INITIAL_CAPACITY && load_real < MIN_LOAD_FACTOR) {
-        new_capacity = u_map->capacity / 2;
-        if (new_capacity < INITIAL_CAPACITY)
-            new_capacity = INITIAL_CAPACITY;
-        need_rehash = true;
-    }
-    else if (load_occupied > MAX_LOAD_FACTOR) {
-        if (load_real < MAX_LOAD_FACTOR && (load_garbage > MAX_GARBAGE_LOAD_FACTOR)) {
-            new_capacity = u_map->capacity;
-            need_rehash = true;
-        } else {
-            new_capacity = u_map->capacity * 2;
-            need_rehash = true;
-        }
-    }
+// Выравнивание буфера таблицы: ключи, значения, сохраненные хэши, номера записей
+static size_t u_map_data_align(size_t key_align, size_t value_align, const u_map_opts_t* opts) {
+    size_t align = max_size_t(key_align, value_align);
+    if (opts->store_hashes) align = max_size_t(align, alignof(size_t));
+    if (opts->dense)        align = max_size_t(align, alignof(uint32_t));
+    return align;
+}
 
-    if (!need_rehash)
-        return HM_ERR_OK;
+// Сколько байт библиотека выделила под буфер таблицы
+static size_t u_map_table_bytes(const u_map_t* u_map) {
+    if (u_map->is_static || u_map->data == nullptr) return 0;
 
-    if (new_capacity == u_map->capacity) {
-        LOGGER_DEBUG("Rehashing capacity %zu (cleaning tombstones)", u_map->capacity);
+    const u_map_opts_t opts = u_map_opts_of(u_map);
+    return u_map_required_bytes_ex(u_map->capacity, u_map->key_size, u_map->key_align,
+                                   u_map->value_size, u_map->value_align, &opts);
+}
+
+// Буфер таблицы возвращается туда, откуда взят: аллокатору или отображению файла
+static void u_map_free_data(u_map_t* u_map) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+
+    if (u_map->is_static || u_map->data == nullptr) return;
+
+    if (u_map->cow != nullptr) {
+        u_map_cow_free(u_map->cow);
+        u_map->cow = nullptr;
+    } else if (u_map->cow_view != nullptr) {
+        u_map_cow_view_release(u_map->cow_view);
+        u_map->cow_view = nullptr;
+    } else if (u_map->mapping != nullptr) {
+        munmap(u_map->mapping, u_map->mapping_bytes);
+        u_map->mapping       = nullptr;
+        u_map->mapping_bytes = 0;
     } else {
-        LOGGER_DEBUG("Changing capacity from %zu to %zu", u_map->capacity, new_capacity);
+        u_map_mem_free(u_map, u_map->data, u_map_table_bytes(u_map));
     }
-
-    return u_map_rehash(u_map, new_capacity);
+    u_map->data = nullptr;
 }
 
-
 //================================================================================
-//                       Конструкторы / Деструкторы / Копировальщики
+//                        Статистика (HASH_MAP_STATS)
 //================================================================================
 
-hm_error_t u_map_init(u_map_t* u_map, size_t capacity,
-                   size_t key_size,   size_t key_align,
-                   size_t value_size, size_t value_align,
-                   key_func_t hash_func, key_cmp_t key_cmp) {
-
-    HARD_ASSERT(u_map      != nullptr, "u_map is nullptr");
-    HARD_ASSERT(hash_func  != nullptr, "hash_func is nullptr");
-    HARD_ASSERT(key_cmp    != nullptr, "key_cmp is nullptr");
-
-    LOGGER_DEBUG("u_map_init started");
-
-    if (capacity < INITIAL_CAPACITY) capacity = INITIAL_CAPACITY;
-    capacity = next_pow2_size_t(capacity);
+// Без HASH_MAP_STATS помощники пустые и исчезают при компиляции, а counters всегда nullptr.
+// Поиск идет и под разделяемой блокировкой (u_map_sharded_t), поэтому счетчики
+// меняются атомарно, но без упорядочивания
+
+typedef enum stat_probe_kind_t {
+    STAT_PROBE_HIT,
+    STAT_PROBE_MISS,
+    STAT_PROBE_INSERT,
+} stat_probe_kind_t;
+
+static const size_t STAT_WORDS = sizeof(u_map_counters_t) / sizeof(uint64_t);
+static_assert(sizeof(u_map_counters_t) % sizeof(uint64_t) == 0, "counters must consist of uint64_t");
+
+static inline void stat_count(const u_map_t* u_map, uint64_t u_map_counters_t::* counter, uint64_t n) {
+#ifdef HASH_MAP_STATS
+    if (u_map->counters != nullptr) __atomic_fetch_add(&(u_map->counters->*counter), n, __ATOMIC_RELAXED);
+#else
+    (void)u_map; (void)counter; (void)n;
+#endif
+}
 
-    size_t key_stride = 0, value_stride = 0, values_offset = 0, states_offset = 0, total_bytes = 0;
-    u_map_calc_layout(capacity, key_size, key_align, value_size, value_align,
-                      &key_stride, &value_stride, &values_offset, &states_offset, &total_bytes);
+static inline void stat_probe(const u_map_t* u_map, stat_probe_kind_t kind, size_t probes) {
+#ifdef HASH_MAP_STATS
+    if (u_map->counters == nullptr) return;
 
-    void* data = calloc(1, total_bytes);
-    if (!data) return HM_ERR_MEM_ALLOC;
+    uint64_t* hist = nullptr;
+    switch (kind) {
+        case STAT_PROBE_HIT:    hist = u_map->counters->hit_probes;    break;
+        case STAT_PROBE_MISS:   hist = u_map->counters->miss_probes;   break;
+        case STAT_PROBE_INSERT: hist = u_map->counters->insert_probes; break;
+        default: return;
+    }
+    if (probes >= U_MAP_STATS_PROBE_BUCKETS) probes = U_MAP_STATS_PROBE_BUCKETS - 1;
+    __atomic_fetch_add(&hist[probes], 1, __ATOMIC_RELAXED);
+#else
+    (void)u_map; (void)kind; (void)probes;
+#endif
+}
 
-    u_map->data        = data;
-    u_map->data_keys   = data;
-    u_map->data_values = (void*)((unsigned char*)data + values_offset);
-    u_map->data_states = (elem_state_t*)((unsigned char*)data + states_offset);
+static inline uint64_t stat_clock() {
+#ifdef HASH_MAP_STATS
+    struct timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#else
+    return 0;
+#endif
+}
 
-    u_map->size      = 0;
-    u_map->occupied  = 0;
-    u_map->capacity  = capacity;
+static inline void stat_time(const u_map_t* u_map, uint64_t started) {
+#ifdef HASH_MAP_STATS
+    stat_count(u_map, &u_map_counters_t::rehash_ns, stat_clock() - started);
+#else
+    (void)u_map; (void)started;
+#endif
+}
 
-    u_map->key_size   = key_size;
-    u_map->key_align  = key_align;
-    u_map->key_stride = key_stride;
+static hm_error_t u_map_counters_create(u_map_t* u_map) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
 
-    u_map->value_size   = value_size;
-    u_map->value_align  = value_align;
-    u_map->value_stride = value_stride;
+    u_map->counters = nullptr;
+#ifdef HASH_MAP_STATS
+    u_map->counters = (u_map_counters_t*)u_map_mem_alloc(u_map, sizeof(u_map_counters_t), alignof(u_map_counters_t));
+    if (u_map->counters == nullptr) return HM_ERR_MEM_ALLOC;
+    memset(u_map->counters, 0, sizeof(u_map_counters_t));
+#endif
+    return HM_ERR_OK;
+}
 
-    u_map->hash_func = hash_func;
-    u_map->key_cmp   = key_cmp;
+// Новая таблица рехэша продолжает счетчики старой
+static void u_map_counters_move(u_map_t* target, u_map_t* source) {
+    u_map_mem_free(target, target->counters, sizeof(u_map_counters_t));
+    target->counters = source->counters;
+    source->counters = nullptr;
+}
 
-    u_map->is_static = false;
+//================================================================================
+//                   Байтовые ключи: запись в слоте и арена
+//================================================================================
 
-    return HM_ERR_OK;
+// Запись ключа в слоте (U_MAP_BYTES_KEY_SIZE байт):
+// - короткий: байты ключа, дополненные нулями, последний байт — длина (0..15),
+//   так что короткие ключи сравниваются одним memcmp записи
+// - длинный:  [0..7] указатель на байты, [8..11] длина, [12..14] 24 бита хэша, [15] BYTES_LONG_TAG
+typedef struct bytes_key_t {
+    alignas(8) unsigned char bytes[U_MAP_BYTES_KEY_SIZE];
+} bytes_key_t;
+
+static const uint8_t BYTES_LONG_TAG   = 0xFF;
+static const size_t  BYTES_LEN_OFFSET = 8;
+static const size_t  BYTES_MATCH_LEN  = 7;   // длина и часть хэша
+static const size_t  BYTES_TAG_OFFSET = U_MAP_BYTES_KEY_SIZE - 1;
+
+static_assert(sizeof(void*) <= BYTES_LEN_OFFSET, "pointer must fit the key record");
+static_assert(U_MAP_BYTES_INLINE_MAX < BYTES_LONG_TAG, "inline length must differ from the long tag");
+
+// Итоговый хэш байтов ключа в таблице. Соль таблицы идет в сам u_map_hash_bytes, а не только
+// поверх готового значения: иначе ключи с полной коллизией хэша байтов не расходились бы при смене соли
+static inline size_t bytes_hash(const u_map_t* u_map, const void* data, size_t len) {
+    return u_map_finish_hash(u_map, u_map_hash_bytes(data, len, u_map->seed));
 }
 
-hm_error_t u_map_static_init(u_map_t* u_map, void* data, size_t capacity,
-                          size_t key_size,   size_t key_align,
-                          size_t value_size, size_t value_align,
-                          key_func_t hash_func, key_cmp_t key_cmp) {
+static void bytes_key_view(const void* stored, const unsigned char** data_out, size_t* len_out) {
+    const unsigned char* rec = (const unsigned char*)stored;
 
-    HARD_ASSERT(u_map      != nullptr, "u_map is nullptr");
-    HARD_ASSERT(data       != nullptr, "data is nullptr");
-    HARD_ASSERT(hash_func  != nullptr, "hash_func is nullptr");
-    HARD_ASSERT(key_cmp    != nullptr, "key_cmp is nullptr");
-    HARD_ASSERT(key_size   > 0,     "key_size must be > 0");
-    HARD_ASSERT(value_size > 0,     "value_size must be > 0");
-    HARD_ASSERT(key_align  > 0,     "key_align must be > 0");
-    HARD_ASSERT(value_align> 0,     "value_align must be > 0");
+    if (rec[BYTES_TAG_OFFSET] != BYTES_LONG_TAG) {
+        *data_out = rec;
+        *len_out  = rec[BYTES_TAG_OFFSET];
+        return;
+    }
 
-    LOGGER_DEBUG("u_map_static_init started");
+    uint32_t len = 0;
+    memcpy(data_out, rec, sizeof(*data_out));
+    memcpy(&len, rec + BYTES_LEN_OFFSET, sizeof(len));
+    *len_out = len;
+}
 
-    capacity = prev_pow2_size_t(capacity);
-    RETURN_IF_ERROR(capacity == 0 ? HM_ERR_BAD_ARG : HM_ERR_OK);
+// Часть хэша в записи длинного ключа: зависит от соли, поэтому при переносе в таблицу с другой
+// солью записывается заново
+static void bytes_key_set_prefix(void* stored, size_t hash) {
+    unsigned char* rec = (unsigned char*)stored;
+    if (rec[BYTES_TAG_OFFSET] != BYTES_LONG_TAG) return;
 
-    size_t key_stride = 0, value_stride = 0, values_offset = 0, states_offset = 0, total_bytes = 0;
-    u_map_calc_layout(capacity, key_size, key_align, value_size, value_align,
-                      &key_stride, &value_stride, &values_offset, &states_offset, &total_bytes);
+    const uint32_t prefix = (uint32_t)((uint64_t)hash >> 40);
+    memcpy(rec + BYTES_LEN_OFFSET + sizeof(uint32_t), &prefix, BYTES_MATCH_LEN - sizeof(uint32_t));
+}
 
-    size_t need_align = max_size_t(max_size_t(key_align, value_align), alignof(elem_state_t));
-    if (((uintptr_t)data % need_align) != 0) {
-        LOGGER_ERROR("static buffer is not aligned to %zu bytes", need_align);
-        return HM_ERR_BAD_ARG;
+// Заполняет запись ключа; stored — где лежат байты длинного ключа (у пользователя или в арене).
+// Возвращает итоговый хэш ключа в u_map
+static size_t bytes_key_init(const u_map_t* u_map, bytes_key_t* rec, const void* key, size_t len,
+                             const void* stored) {
+    const size_t hash = bytes_hash(u_map, key, len);
+    memset(rec->bytes, 0, sizeof(rec->bytes));
+
+    if (len <= U_MAP_BYTES_INLINE_MAX) {
+        if (len != 0) memcpy(rec->bytes, key, len);
+        rec->bytes[BYTES_TAG_OFFSET] = (unsigned char)len;
+        return hash;
     }
 
-    memset((unsigned char*)data + states_offset, 0, capacity * sizeof(elem_state_t));
+    const uint32_t len32 = (uint32_t)len;
+    memcpy(rec->bytes, &stored, sizeof(stored));
+    memcpy(rec->bytes + BYTES_LEN_OFFSET, &len32, sizeof(len32));
+    rec->bytes[BYTES_TAG_OFFSET] = BYTES_LONG_TAG;
+    bytes_key_set_prefix(rec->bytes, hash);
+    return hash;
+}
 
-    u_map->data        = data;
-    u_map->data_keys   = data;
-    u_map->data_values = (void*)((unsigned char*)data + values_offset);
-    u_map->data_states = (elem_state_t*)((unsigned char*)data + states_offset);
+// hash_func / key_cmp байтовой таблицы: обе стороны — записи. Сама таблица хэширует записи
+// через bytes_hash со своей солью (u_map_hash_key), hash_func только помечает байтовую таблицу
+static size_t bytes_key_hash(const void* key) {
+    const unsigned char* data = nullptr;
+    size_t len = 0;
+    bytes_key_view(key, &data, &len);
+    return u_map_hash_bytes(data, len, 0);
+}
 
-    u_map->size     = 0;
-    u_map->occupied = 0;
-    u_map->capacity = capacity;
+static bool bytes_key_eq(const void* a, const void* b) {
+    const unsigned char* x = (const unsigned char*)a;
+    const unsigned char* y = (const unsigned char*)b;
 
-    u_map->key_size   = key_size;
-    u_map->key_align  = key_align;
-    u_map->key_stride = key_stride;
+    if (x[BYTES_TAG_OFFSET] != BYTES_LONG_TAG) return memcmp(x, y, U_MAP_BYTES_KEY_SIZE) == 0;
+    if (y[BYTES_TAG_OFFSET] != BYTES_LONG_TAG ||
+        memcmp(x + BYTES_LEN_OFFSET, y + BYTES_LEN_OFFSET, BYTES_MATCH_LEN) != 0) return false;
 
-    u_map->value_size   = value_size;
-    u_map->value_align  = value_align;
-    u_map->value_stride = value_stride;
+    const unsigned char* x_data = nullptr;
+    const unsigned char* y_data = nullptr;
+    size_t len = 0;
+    bytes_key_view(x, &x_data, &len);
+    bytes_key_view(y, &y_data, &len);
+    return memcmp(x_data, y_data, len) == 0;
+}
 
-    u_map->hash_func = hash_func;
-    u_map->key_cmp   = key_cmp;
+// Арена длинных ключей: цепочка блоков, память только дописывается, так что указатели
+// в записях живут до рехэша — он переносит живые ключи в новую арену, удаленные остаются в старой
+typedef struct u_map_key_chunk_t {
+    struct u_map_key_chunk_t* next;
+    size_t capacity;
+    size_t used;
+} u_map_key_chunk_t;   // байты блока идут сразу за заголовком
+
+struct u_map_key_arena_t {
+    u_map_key_chunk_t* head;  // текущий блок, самый новый
+    size_t bytes;             // выделено под блоки вместе с заголовками
+    size_t live;              // байты живых ключей
+    size_t dead;              // байты удаленных: возвращаются только рехэшем
+};
+
+static const size_t KEY_CHUNK_MIN = (size_t)64 << 10;
+static const size_t KEY_CHUNK_MAX = (size_t)16 << 20;
+
+static hm_error_t u_map_key_arena_create(u_map_t* u_map) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
 
-    u_map->is_static = true;
+    u_map_key_arena_t* arena = (u_map_key_arena_t*)u_map_mem_alloc(u_map, sizeof(u_map_key_arena_t),
+                                                                    alignof(u_map_key_arena_t));
+    if (arena == nullptr) return HM_ERR_MEM_ALLOC;
+    memset(arena, 0, sizeof(*arena));
 
+    u_map->key_arena = arena;
     return HM_ERR_OK;
 }
 
-hm_error_t u_map_destroy(u_map_t* u_map) {
+static void u_map_key_arena_free(u_map_t* u_map) {
     HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
 
-    LOGGER_DEBUG("u_map_dest started");
+    u_map_key_arena_t* arena = u_map->key_arena;
+    if (arena == nullptr) return;
+
+    for (u_map_key_chunk_t* chunk = arena->head; chunk != nullptr;) {
+        u_map_key_chunk_t* next = chunk->next;
+        u_map_mem_free(u_map, chunk, sizeof(u_map_key_chunk_t) + chunk->capacity);
+        chunk = next;
+    }
+    u_map_mem_free(u_map, arena, sizeof(u_map_key_arena_t));
+    u_map->key_arena = nullptr;
+}
 
-    if (!u_map->is_static && u_map->data != nullptr) {
-        free(u_map->data);
+static unsigned char* u_map_key_arena_alloc(u_map_t* u_map, size_t len) {
+    u_map_key_arena_t* arena = u_map->key_arena;
+    HARD_ASSERT(arena != nullptr, "u_map has no key arena");
+
+    u_map_key_chunk_t* chunk = arena->head;
+    if (chunk == nullptr || chunk->capacity - chunk->used < len) {
+        size_t capacity = chunk != nullptr ? chunk->capacity * 2 : KEY_CHUNK_MIN;
+        if (capacity > KEY_CHUNK_MAX) capacity = KEY_CHUNK_MAX;
+        if (capacity < len)           capacity = len;
+
+        const size_t bytes = sizeof(u_map_key_chunk_t) + capacity;
+        u_map_key_chunk_t* fresh = (u_map_key_chunk_t*)u_map_mem_alloc(u_map, bytes, alignof(u_map_key_chunk_t));
+        if (fresh == nullptr) return nullptr;
+
+        fresh->next     = chunk;
+        fresh->capacity = capacity;
+        fresh->used     = 0;
+        arena->head   = fresh;
+        arena->bytes += bytes;
+        chunk = fresh;
     }
 
-    memset(u_map, 0, sizeof(*u_map));
-    return HM_ERR_OK;
+    unsigned char* ptr = (unsigned char*)(chunk + 1) + chunk->used;
+    chunk->used += len;
+    return ptr;
 }
 
-hm_error_t u_map_smart_copy(u_map_t* target, const u_map_t* source) {
-    HARD_ASSERT(target != nullptr, "target is nullptr");
-    HARD_ASSERT(source != nullptr, "source is nullptr");
+// Откатывает последнее выделение (ключ так и не попал в таблицу)
+static void u_map_key_arena_pop(u_map_t* u_map, size_t len) {
+    u_map_key_chunk_t* chunk = u_map->key_arena->head;
+    HARD_ASSERT(chunk != nullptr && chunk->used >= len, "pop without a matching alloc");
+    chunk->used -= len;
+}
 
-    LOGGER_DEBUG("u_map_smart_copy started");
+// Запись out — копия key, длинный ключ которой скопирован в арену u_map
+static bool u_map_key_arena_adopt(u_map_t* u_map, const void* key, bytes_key_t* out) {
+    memcpy(out->bytes, key, U_MAP_BYTES_KEY_SIZE);
+    if (out->bytes[BYTES_TAG_OFFSET] != BYTES_LONG_TAG) return true;
 
-    hm_error_t err = u_map_init(target, source->capacity,
-                             source->key_size,   source->key_align,
-                             source->value_size, source->value_align,
-                             source->hash_func, source->key_cmp);
-    RETURN_IF_ERROR(err);
+    const unsigned char* data = nullptr;
+    size_t len = 0;
+    bytes_key_view(key, &data, &len);
 
-    for (size_t i = 0; i < source->capacity; ++i) {
-        if (source->data_states[i] != USED) continue;
+    unsigned char* copy = u_map_key_arena_alloc(u_map, len);
+    if (copy == nullptr) return false;
+    memcpy(copy, data, len);
+    memcpy(out->bytes, &copy, sizeof(copy));
 
-        const void* key   = get_key(source, i);
-        const void* value = get_value(source, i);
+    u_map->key_arena->live += len;
+    return true;
+}
 
-        bool is_new = false;
-        size_t idx = 0;
-        bool is_not_full = u_map_find_insert_slot(target, key, &idx, &is_new);
-        if (!is_not_full) {
-            u_map_destroy(target);
-            return HM_ERR_FULL;
-        }
+// Отменяет u_map_key_arena_adopt, если ключ не удалось положить в таблицу
+static void u_map_key_arena_unadopt(u_map_t* u_map, const bytes_key_t* rec) {
+    if (rec->bytes[BYTES_TAG_OFFSET] != BYTES_LONG_TAG) return;
 
-        target->data_states[idx] = USED;
-        memcpy(get_key  (target, idx), key,   source->key_size);
-        memcpy(get_value(target, idx), value, source->value_size);
-        target->size++;
-        target->occupied++;
-    }
+    const unsigned char* data = nullptr;
+    size_t len = 0;
+    bytes_key_view(rec, &data, &len);
+    u_map_key_arena_pop(u_map, len);
+    u_map->key_arena->live -= len;
+}
 
-    return HM_ERR_OK;
+// Удаленных ключей больше, чем живых: пора переносить таблицу в новую арену
+static bool u_map_key_arena_is_wasteful(const u_map_t* u_map) {
+    const u_map_key_arena_t* arena = u_map->key_arena;
+    return arena != nullptr && arena->dead >= KEY_CHUNK_MIN && arena->dead > arena->live;
 }
 
-hm_error_t u_map_raw_copy(u_map_t* target, const u_map_t* source) {
+// Копия таблицы получает свою арену: записи в ее буфере пока указывают в арену источника
+static hm_error_t u_map_key_arena_clone(u_map_t* target) {
     HARD_ASSERT(target != nullptr, "target is nullptr");
-    HARD_ASSERT(source != nullptr, "source is nullptr");
-
-    LOGGER_DEBUG("u_map_raw_copy started");
 
-    hm_error_t err = u_map_init(target, source->capacity,
-                             source->key_size,   source->key_align,
-                             source->value_size, source->value_align,
-                             source->hash_func, source->key_cmp);
-    RETURN_IF_ERROR(err);
-
-    size_t total_bytes = u_map_required_bytes(source->capacity,
-                                              source->key_size, source->key_align,
-                                              source->value_size, source->value_align);
-    memcpy(target->data, source->data, total_bytes);
+    target->key_arena = nullptr;
+    RETURN_IF_ERROR(u_map_key_arena_create(target));
 
-    target->size     = source->size;
-    target->occupied = source->occupied;
+    const bool   dense = target->data_index != nullptr;
+    const size_t count = dense ? target->entries_used : target->capacity;
+    for (size_t i = 0; i < count; ++i) {
+        if (dense ? !target->data_alive[i] : !u_map_ctrl_is_full(target->data_states[i])) continue;
 
+        void* key = entry_key(target, i);
+        bytes_key_t moved = {};
+        if (!u_map_key_arena_adopt(target, key, &moved)) {
+            u_map_key_arena_free(target);
+            return HM_ERR_MEM_ALLOC;
+        }
+        memcpy(key, moved.bytes, U_MAP_BYTES_KEY_SIZE);
+    }
     return HM_ERR_OK;
 }
 
 //================================================================================
-//                             Базовые функции
+//                        Хэишрование и проход
 //================================================================================
 
-bool u_map_is_empty(const u_map_t* u_map) {
+static size_t u_map_hash_key(const u_map_t* u_map, const void* key) {
     HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
-    return u_map->size == 0;
+    HARD_ASSERT(key   != nullptr, "key is nullptr");
+    if (u_map->key_arena != nullptr) {
+        const unsigned char* data = nullptr;
+        size_t len = 0;
+        bytes_key_view(key, &data, &len);
+        return bytes_hash(u_map, data, len);
+    }
+    return u_map_finish_hash(u_map, u_map->hash_func(key));
 }
 
-size_t u_map_size(const u_map_t* u_map) {
-    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
-    return u_map->size;
+// Хэш записи: сохраненный, если есть, иначе считается заново
+static inline size_t entry_hash(const u_map_t* u_map, size_t entry) {
+    if (u_map->data_hashes != nullptr) return u_map->data_hashes[entry];
+    return u_map_hash_key(u_map, entry_key(u_map, entry));
 }
 
-size_t u_map_capacity(const u_map_t* u_map) {
-    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
-    return u_map->capacity;
+static inline size_t slot_hash(const u_map_t* u_map, size_t idx) {
+    return entry_hash(u_map, slot_entry(u_map, idx));
 }
 
-bool u_map_get_elem(const u_map_t* u_map, const void* key, void* value_out) {
-    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
-    HARD_ASSERT(key   != nullptr, "key is nullptr");
+// Дешевая проверка перед key_cmp: без сохраненных хэшей всегда true
+static inline bool slot_hash_matches(const u_map_t* u_map, size_t idx, size_t hash) {
+    return u_map->data_hashes == nullptr || u_map->data_hashes[slot_entry(u_map, idx)] == hash;
+}
 
-    size_t idx = 0;
-    if (!u_map_find_slot(u_map, key, &idx)) {
-        return false;
-    }
+static inline u_map_probe_seq_t probe_start(const u_map_t* u_map, size_t hash) {
+    return u_map_probe_seq_start(hash, u_map_ctrl_bytes(u_map) / U_MAP_GROUP_WIDTH - 1);
+}
 
-    if (value_out != nullptr) {
-        memcpy(value_out, get_value(u_map, idx), u_map->value_size);
-    }
-    return true;
+//================================================================================
+//                        Robin hood (линейное пробирование)
+//================================================================================
+
+static inline size_t rh_home(const u_map_t* u_map, size_t hash) {
+    return u_map_hash_h1(hash) & (u_map->capacity - 1);
 }
 
-hm_error_t u_map_insert_elem(u_map_t* u_map, const void* key, const void* value) {
-    HARD_ASSERT(u_map  != nullptr, "u_map is nullptr");
-    HARD_ASSERT(key    != nullptr, "key is nullptr");
-    HARD_ASSERT(value  != nullptr, "value is nullptr");
+static void u_map_move_slot(u_map_t* u_map, size_t dst, size_t src) {
+    u_map_cow_save_slot(u_map, dst);
+
+    // Плотная раскладка: запись остается на месте, переезжает только ее номер
+    if (u_map->data_index != nullptr) {
+        u_map->data_index[dst] = u_map->data_index[src];
+        return;
+    }
+
+    memcpy(get_key  (u_map, dst), get_key  (u_map, src), u_map->key_size);
+    memcpy(get_value(u_map, dst), get_value(u_map, src), u_map->value_size);
+    if (u_map->data_hashes != nullptr) u_map->data_hashes[dst] = u_map->data_hashes[src];
+}
+
+static inline uint8_t rh_ctrl(size_t dist) {
+    return dist < RH_MAX_DIST ? (uint8_t)dist : RH_MAX_DIST;
+}
+
+// Точное расстояние занятого слота от его домашнего
+static size_t rh_dist(const u_map_t* u_map, size_t idx) {
+    const uint8_t ctrl = u_map->data_states[idx];
+    if (ctrl < RH_MAX_DIST) return ctrl;
+
+    const size_t home = rh_home(u_map, slot_hash(u_map, idx));
+    return (idx - home) & (u_map->capacity - 1);
+}
+
+// Элемент ближе к дому, чем искомый на расстоянии dist: дальше ключа быть не может
+static inline bool rh_is_richer(const u_map_t* u_map, size_t idx, size_t dist) {
+    const uint8_t ctrl = u_map->data_states[idx];
+    if (ctrl < RH_MAX_DIST) return ctrl < dist;
+    return dist > RH_MAX_DIST && rh_dist(u_map, idx) < dist;
+}
+
+// Ключ может совпасть только с элементом на том же расстоянии от дома
+static inline bool rh_same_home(const u_map_t* u_map, size_t idx, size_t dist) {
+    const uint8_t ctrl = u_map->data_states[idx];
+    if (ctrl < RH_MAX_DIST) return ctrl == dist;
+    return dist >= RH_MAX_DIST && rh_dist(u_map, idx) == dist;
+}
+
+static bool rh_find_slot(const u_map_t* u_map, const void* key, size_t hash, size_t* idx_out) {
+    const size_t mask = u_map->capacity - 1;
+    size_t idx = rh_home(u_map, hash);
+
+    for (size_t dist = 0; dist < u_map->capacity; ++dist) {
+        if (u_map->data_states[idx] == EMPTY || rh_is_richer(u_map, idx, dist)) {
+            stat_probe(u_map, STAT_PROBE_MISS, dist);
+            return false;
+        }
+
+        if (rh_same_home(u_map, idx, dist) && slot_hash_matches(u_map, idx, hash) &&
+            u_map->key_cmp(get_key(u_map, idx), key)) {
+            stat_probe(u_map, STAT_PROBE_HIT, dist);
+            *idx_out = idx;
+            return true;
+        }
+        idx = (idx + 1) & mask;
+    }
+
+    stat_probe(u_map, STAT_PROBE_MISS, u_map->capacity);
+    return false;
+}
+
+// Сдвигает кластер, начинающийся в pos, на один слот вправо и освобождает pos.
+// Не трогает таблицу, если пустого слота нет
+static bool rh_shift_right(u_map_t* u_map, size_t pos) {
+    const size_t mask = u_map->capacity - 1;
+
+    size_t end = pos;
+    for (size_t seen = 0; u_map->data_states[end] != EMPTY; ++seen) {
+        if (seen == u_map->capacity) return false;
+        end = (end + 1) & mask;
+    }
+
+    while (end != pos) {
+        const size_t prev = (end - 1) & mask;
+        u_map_move_slot(u_map, end, prev);
+        u_map->data_states[end] = rh_ctrl((size_t)u_map->data_states[prev] + 1);
+        end = prev;
+    }
+
+    u_map_cow_save_slot(u_map, pos);
+    u_map->data_states[pos] = EMPTY;
+    return true;
+}
+
+// Ищет ключ; если его нет — освобождает под него место (ключ == nullptr: ключ заведомо новый).
+// В *probes_out — расстояние найденного слота от домашнего
+static bool rh_find_insert_slot(u_map_t* u_map, const void* key, size_t hash, size_t* idx_out, bool* is_new_out,
+                                size_t* probes_out) {
+    const size_t mask = u_map->capacity - 1;
+    size_t idx = rh_home(u_map, hash);
+
+    for (size_t dist = 0; dist < u_map->capacity; ++dist) {
+        if (u_map->data_states[idx] == EMPTY) {
+            if (key != nullptr) stat_probe(u_map, STAT_PROBE_INSERT, dist);
+            *idx_out = idx;
+            *is_new_out = true;
+            *probes_out = dist;
+            return true;
+        }
+
+        if (rh_is_richer(u_map, idx, dist)) {
+            if (!rh_shift_right(u_map, idx)) return false;
+            if (key != nullptr) stat_probe(u_map, STAT_PROBE_INSERT, dist);
+            *idx_out = idx;
+            *is_new_out = true;
+            *probes_out = dist;
+            return true;
+        }
+
+        if (key != nullptr && rh_same_home(u_map, idx, dist) && slot_hash_matches(u_map, idx, hash) &&
+            u_map->key_cmp(get_key(u_map, idx), key)) {
+            stat_probe(u_map, STAT_PROBE_INSERT, dist);
+            *idx_out = idx;
+            *is_new_out = false;
+            *probes_out = dist;
+            return true;
+        }
+        idx = (idx + 1) & mask;
+    }
+
+    return false;
+}
+
+// Удаление обратным сдвигом: следующие элементы кластера подтягиваются на слот ближе к дому
+static void rh_erase_slot(u_map_t* u_map, size_t idx) {
+    const size_t mask = u_map->capacity - 1;
+
+    size_t next = (idx + 1) & mask;
+    while (u_map->data_states[next] != EMPTY && u_map->data_states[next] != 0) {
+        const size_t dist = rh_dist(u_map, next);
+        u_map_move_slot(u_map, idx, next);
+        u_map->data_states[idx] = rh_ctrl(dist - 1);
+        idx  = next;
+        next = (next + 1) & mask;
+    }
+
+    u_map_cow_save_slot(u_map, idx);
+    u_map->data_states[idx] = EMPTY;
+}
+
+//================================================================================
+//                        Swiss (группы управляющих байт)
+//================================================================================
+
+// Цикл поиска swiss; dense — константа в месте вызова, чтобы обычная раскладка
+// не платила за косвенность через номер записи
+static inline bool swiss_find_slot(const u_map_t* u_map, const void* key, size_t hash, size_t* idx_out, bool dense) {
+    const uint8_t h2 = u_map_hash_h2(hash);
+    u_map_probe_seq_t seq = probe_start(u_map, hash);
+    do {
+        const size_t   base = seq.group * U_MAP_GROUP_WIDTH;
+        const uint8_t* ctrl = u_map->data_states + base;
+
+        for (u_map_group_mask_t match = u_map_group_match(ctrl, h2); match != 0; match &= match - 1) {
+            const size_t idx   = base + u_map_mask_lowest_bit(match);
+            const size_t entry = dense ? u_map->data_index[idx] : idx;
+            if ((u_map->data_hashes == nullptr || u_map->data_hashes[entry] == hash) &&
+                u_map->key_cmp(entry_key(u_map, entry), key)) {
+                stat_probe(u_map, STAT_PROBE_HIT, seq.index);
+                *idx_out = idx;
+                return true;
+            }
+        }
+
+        if (u_map_group_match_empty(ctrl) != 0) break;
+    } while (u_map_probe_seq_next(&seq));
+
+    stat_probe(u_map, STAT_PROBE_MISS, seq.index);
+    return false;
+}
+
+static bool u_map_find_slot_hashed(const u_map_t* u_map, const void* key, size_t hash, size_t* idx_out) {
+    HARD_ASSERT(u_map   != nullptr, "u_map is nullptr");
+    HARD_ASSERT(key     != nullptr, "key is nullptr");
+    HARD_ASSERT(idx_out != nullptr, "idx_out is nullptr");
+
+    if (u_map->capacity == 0) return false;
+    if (u_map->probe == U_MAP_PROBE_ROBIN_HOOD) return rh_find_slot(u_map, key, hash, idx_out);
+
+    if (u_map->data_index != nullptr) return swiss_find_slot(u_map, key, hash, idx_out, true);
+    return swiss_find_slot(u_map, key, hash, idx_out, false);
+}
+
+// Свободный слот на пути ключа — для ключей, которых заведомо нет в таблице
+static bool u_map_find_free_slot(u_map_t* u_map, size_t hash, size_t* idx_out) {
+    HARD_ASSERT(u_map   != nullptr, "u_map is nullptr");
+    HARD_ASSERT(idx_out != nullptr, "idx_out is nullptr");
+
+    if (u_map->capacity == 0) return false;
+    if (u_map->probe == U_MAP_PROBE_ROBIN_HOOD) {
+        bool is_new = false;
+        size_t probes = 0;
+        return rh_find_insert_slot(u_map, nullptr, hash, idx_out, &is_new, &probes);
+    }
+
+    u_map_probe_seq_t seq = probe_start(u_map, hash);
+    do {
+        const size_t base = seq.group * U_MAP_GROUP_WIDTH;
+        const u_map_group_mask_t free_mask = u_map_group_match_empty_or_deleted(u_map->data_states + base);
+        if (free_mask != 0) {
+            *idx_out = base + u_map_mask_lowest_bit(free_mask);
+            return true;
+        }
+    } while (u_map_probe_seq_next(&seq));
+
+    return false;
+}
+
+// *probes_out — сколько групп (robin hood — слотов) пройдено до найденного слота
+static bool u_map_find_insert_slot(u_map_t* u_map, const void* key, size_t hash, size_t* idx_out, bool* is_new_out,
+                                   size_t* probes_out) {
+    HARD_ASSERT(u_map      != nullptr, "u_map is nullptr");
+    HARD_ASSERT(key        != nullptr, "key is nullptr");
+    HARD_ASSERT(idx_out    != nullptr, "idx_out is nullptr");
+    HARD_ASSERT(is_new_out != nullptr, "is_new_out is nullptr");
+    HARD_ASSERT(probes_out != nullptr, "probes_out is nullptr");
+
+    if (u_map->capacity == 0) return false;
+    if (u_map->probe == U_MAP_PROBE_ROBIN_HOOD) {
+        return rh_find_insert_slot(u_map, key, hash, idx_out, is_new_out, probes_out);
+    }
+
+    const uint8_t h2 = u_map_hash_h2(hash);
+    size_t first_free = (size_t)-1;
+    size_t free_probes = 0;
+    u_map_probe_seq_t seq = probe_start(u_map, hash);
+    do {
+        const size_t   base = seq.group * U_MAP_GROUP_WIDTH;
+        const uint8_t* ctrl = u_map->data_states + base;
+
+        for (u_map_group_mask_t match = u_map_group_match(ctrl, h2); match != 0; match &= match - 1) {
+            const size_t idx = base + u_map_mask_lowest_bit(match);
+            if (slot_hash_matches(u_map, idx, hash) && u_map->key_cmp(get_key(u_map, idx), key)) {
+                stat_probe(u_map, STAT_PROBE_INSERT, seq.index);
+                *idx_out = idx;
+                *is_new_out = false;
+                *probes_out = seq.index;
+                return true;
+            }
+        }
+
+        if (first_free == (size_t)-1) {
+            const u_map_group_mask_t free_mask = u_map_group_match_empty_or_deleted(ctrl);
+            if (free_mask != 0) {
+                first_free  = base + u_map_mask_lowest_bit(free_mask);
+                free_probes = seq.index;
+            }
+        }
+
+        if (u_map_group_match_empty(ctrl) != 0) break;
+    } while (u_map_probe_seq_next(&seq));
+
+    if (first_free == (size_t)-1) return false;
+
+    stat_probe(u_map, STAT_PROBE_INSERT, free_probes);
+    *idx_out = first_free;
+    *is_new_out = true;
+    *probes_out = free_probes;
+    return true;
+}
+
+// Сохраненный хэш и управляющий байт занятого слота, без счетчиков
+static inline void u_map_mark_slot(u_map_t* u_map, size_t idx, size_t entry, size_t hash) {
+    if (u_map->data_hashes != nullptr) u_map->data_hashes[entry] = hash;
+
+    if (u_map->probe == U_MAP_PROBE_ROBIN_HOOD) {
+        u_map->data_states[idx] = rh_ctrl((idx - rh_home(u_map, hash)) & (u_map->capacity - 1));
+    } else {
+        u_map->data_states[idx] = u_map_hash_h2(hash);
+    }
+}
+
+// Помечает свободный слот занятым и обновляет счетчики
+static void u_map_occupy_slot(u_map_t* u_map, size_t idx, size_t hash) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+    HARD_ASSERT(idx < u_map->capacity, "idx out of range");
+    HARD_ASSERT(!u_map_ctrl_is_full(u_map->data_states[idx]), "slot is already used");
+
+    u_map_cow_save_slot(u_map, idx);
+    if (u_map->data_index != nullptr) u_map_cow_save_entry(u_map, u_map->entries_used);
+
+    if (u_map->data_states[idx] == EMPTY) u_map->occupied++;
+    u_map->size++;
+
+    // Плотная раскладка: новая запись дописывается в конец
+    size_t entry = idx;
+    if (u_map->data_index != nullptr) {
+        HARD_ASSERT(u_map->entries_used < u_map->capacity, "no free entries");
+        entry = u_map->entries_used++;
+        u_map->data_index[idx]   = (uint32_t)entry;
+        u_map->data_alive[entry] = 1;
+    }
+
+    u_map_mark_slot(u_map, idx, entry, hash);
+}
+
+// Освобождает занятый слот и обновляет счетчики
+static void u_map_erase_slot(u_map_t* u_map, size_t idx) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+    HARD_ASSERT(idx < u_map->capacity, "idx out of range");
+    HARD_ASSERT(u_map_ctrl_is_full(u_map->data_states[idx]), "slot is not used");
+
+    u_map_cow_save_slot(u_map, idx);
+    u_map->size--;
+    if (u_map->data_index != nullptr) u_map->data_alive[u_map->data_index[idx]] = 0;
+
+    if (u_map->probe == U_MAP_PROBE_ROBIN_HOOD) {
+        rh_erase_slot(u_map, idx);
+        u_map->occupied--;
+        return;
+    }
+
+    // Если в группе уже есть EMPTY, поиск через неё все равно остановится — надгробие не нужно
+    const uint8_t* group = u_map->data_states + (idx / U_MAP_GROUP_WIDTH) * U_MAP_GROUP_WIDTH;
+    if (u_map_group_match_empty(group) != 0) {
+        u_map->data_states[idx] = EMPTY;
+        u_map->occupied--;
+    } else {
+        u_map->data_states[idx] = DELETED;
+    }
+}
+
+//================================================================================
+//                        Параллельное заполнение
+//================================================================================
+
+// Рехэш, копия и bulk_build больших таблиц при threads > 1:
+//  1. куски входа параллельно считают хэши и сколько элементов попадает в каждую часть таблицы —
+//     непрерывный диапазон домашних групп (robin hood — слотов);
+//  2. номера элементов раскладываются по частям с сохранением порядка входа;
+//  3. каждую часть заполняет один поток без блокировок: элемент кладется, только если весь его
+//     путь проб лежит внутри части, иначе откладывается;
+//  4. отложенных при обычной загрузке доли процента — их вставляет вызывающий поток обычным путем.
+// Счетчики статистики в параллельной части не ведутся: они общие на всю таблицу
+static const size_t PAR_MIN_ITEMS         = (size_t)1 << 16;
+static const size_t PAR_MAX_THREADS       = 64;
+static const size_t PAR_CHUNKS_PER_THREAD = 4;  // сглаживают разную скорость потоков
+static const size_t PAR_PARTS_PER_THREAD  = 8;  // сглаживают разное число элементов в частях
+
+typedef struct par_pool_t {
+    u_map_task_t task;
+    void*        task_ctx;
+    size_t       count;
+    size_t       next;
+} par_pool_t;
+
+static void par_pool_drain(par_pool_t* pool) {
+    for (size_t i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED); i < pool->count;
+         i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED)) {
+        pool->task(pool->task_ctx, i);
+    }
+}
+
+static void* par_pool_worker(void* arg) {
+    par_pool_drain((par_pool_t*)arg);
+    return nullptr;
+}
+
+// Встроенный исполнитель: потоки живут одну фазу, вызывающий работает наравне с ними.
+// Не создавшийся поток не ошибка — его задачи разберут остальные
+static void par_run_threads(size_t threads, u_map_task_t task, void* task_ctx, size_t count) {
+    if (threads > count)           threads = count;
+    if (threads > PAR_MAX_THREADS) threads = PAR_MAX_THREADS;
+
+    par_pool_t pool = {task, task_ctx, count, 0};
+    pthread_t workers[PAR_MAX_THREADS];
+    size_t started = 0;
+    while (started + 1 < threads && pthread_create(&workers[started], nullptr, par_pool_worker, &pool) == 0) {
+        ++started;
+    }
+
+    par_pool_drain(&pool);
+    for (size_t t = 0; t < started; ++t) pthread_join(workers[t], nullptr);
+}
+
+static void u_map_par_run(const u_map_t* u_map, u_map_task_t task, void* task_ctx, size_t count) {
+    if (u_map->executor.run != nullptr) u_map->executor.run(u_map->executor.ctx, task, task_ctx, count);
+    else                                par_run_threads(u_map->threads, task, task_ctx, count);
+}
+
+typedef struct par_part_t {
+    size_t begin;       // кусок order[begin, end) — элементы части в порядке входа
+    size_t end;
+    size_t deferred;    // отложенные сдвинуты в начало куска
+    size_t added;       // новых ключей
+    size_t occupied;    // из них легли в EMPTY
+    size_t duplicates;  // ключ уже был: значение перезаписано
+} par_part_t;
+
+typedef struct par_fill_t {
+    u_map_t*             target;
+    const u_map_t*       src;          // вход — занятые слоты src
+    const unsigned char* pairs;        // или пары в раскладке u_map_bulk_build
+    size_t               pair_stride;
+    size_t               value_off;
+    size_t               items;        // src->capacity или число пар
+    bool                 rehash;       // хэш по соли target, а не сохраненный у src
+    bool                 upsert;       // ключи могут повторяться и уже лежать в target
+
+    size_t               chunks;
+    size_t               parts;
+    unsigned             part_shift;   // домашняя позиция >> part_shift — номер части
+    size_t*              hashes;       // [items]
+    size_t*              offsets;      // [chunks * parts]: сначала счетчики, потом места в order
+    size_t*              order;        // [items]
+    par_part_t*          part;         // [parts]
+} par_fill_t;
+
+static size_t u_map_home_pos(const u_map_t* u_map, size_t hash) {
+    if (u_map->probe == U_MAP_PROBE_ROBIN_HOOD) return rh_home(u_map, hash);
+    return probe_start(u_map, hash).group;
+}
+
+static inline bool par_item_live(const par_fill_t* fill, size_t i) {
+    return fill->src == nullptr || u_map_ctrl_is_full(fill->src->data_states[i]);
+}
+
+static inline const void* par_item_key(const par_fill_t* fill, size_t i) {
+    if (fill->src != nullptr) return get_key(fill->src, i);
+    return fill->pairs + i * fill->pair_stride;
+}
+
+static inline const void* par_item_value(const par_fill_t* fill, size_t i) {
+    if (fill->src != nullptr) return get_value(fill->src, i);
+    return fill->pairs + i * fill->pair_stride + fill->value_off;
+}
+
+static inline size_t par_item_part(const par_fill_t* fill, size_t hash) {
+    return u_map_home_pos(fill->target, hash) >> fill->part_shift;
+}
+
+static void par_chunk_range(const par_fill_t* fill, size_t chunk, size_t* begin_out, size_t* end_out) {
+    const size_t per_chunk = (fill->items + fill->chunks - 1) / fill->chunks;
+    *begin_out = chunk * per_chunk < fill->items ? chunk * per_chunk : fill->items;
+    *end_out   = *begin_out + per_chunk < fill->items ? *begin_out + per_chunk : fill->items;
+}
+
+// Фаза 1: хэши и счетчики по частям; у каждого куска своя строка offsets
+static void par_count_task(void* task_ctx, size_t chunk) {
+    par_fill_t* fill   = (par_fill_t*)task_ctx;
+    size_t*     counts = fill->offsets + chunk * fill->parts;
+
+    size_t begin = 0, end = 0;
+    par_chunk_range(fill, chunk, &begin, &end);
+    for (size_t i = begin; i < end; ++i) {
+        if (!par_item_live(fill, i)) continue;
+
+        const size_t hash = fill->src != nullptr && !fill->rehash ? slot_hash(fill->src, i)
+                                                                  : u_map_hash_key(fill->target, par_item_key(fill, i));
+        fill->hashes[i] = hash;
+        counts[par_item_part(fill, hash)]++;
+    }
+}
+
+// Фаза 2: номера элементов по своим местам в order
+static void par_scatter_task(void* task_ctx, size_t chunk) {
+    par_fill_t* fill = (par_fill_t*)task_ctx;
+    size_t*     next = fill->offsets + chunk * fill->parts;
+
+    size_t begin = 0, end = 0;
+    par_chunk_range(fill, chunk, &begin, &end);
+    for (size_t i = begin; i < end; ++i) {
+        if (par_item_live(fill, i)) fill->order[next[par_item_part(fill, fill->hashes[i])]++] = i;
+    }
+}
+
+// Слот на пути проб swiss, не выходящем из групп [lo, hi); false — путь выходит из части.
+// key == nullptr: ключ заведомо новый
+static bool par_swiss_place(const u_map_t* u_map, const void* key, size_t hash, size_t lo, size_t hi,
+                            size_t* idx_out, bool* is_new_out) {
+    const uint8_t h2 = u_map_hash_h2(hash);
+    size_t first_free = (size_t)-1;
+    u_map_probe_seq_t seq = probe_start(u_map, hash);
+    do {
+        if (seq.group < lo || seq.group >= hi) return false;
+
+        const size_t   base = seq.group * U_MAP_GROUP_WIDTH;
+        const uint8_t* ctrl = u_map->data_states + base;
+
+        if (key != nullptr) {
+            for (u_map_group_mask_t match = u_map_group_match(ctrl, h2); match != 0; match &= match - 1) {
+                const size_t idx = base + u_map_mask_lowest_bit(match);
+                if (slot_hash_matches(u_map, idx, hash) && u_map->key_cmp(get_key(u_map, idx), key)) {
+                    *idx_out    = idx;
+                    *is_new_out = false;
+                    return true;
+                }
+            }
+        }
+
+        if (first_free == (size_t)-1) {
+            const u_map_group_mask_t free_mask = u_map_group_match_empty_or_deleted(ctrl);
+            if (free_mask != 0) first_free = base + u_map_mask_lowest_bit(free_mask);
+        }
+
+        if (first_free != (size_t)-1 && (key == nullptr || u_map_group_match_empty(ctrl) != 0)) {
+            *idx_out    = first_free;
+            *is_new_out = true;
+            return true;
+        }
+    } while (u_map_probe_seq_next(&seq));
+
+    return false;
+}
+
+// То же для robin hood: поиск и сдвиг кластера не заходят за слот hi (домашний слот уже в части)
+static bool par_rh_place(u_map_t* u_map, const void* key, size_t hash, size_t hi, size_t* idx_out, bool* is_new_out) {
+    size_t idx = rh_home(u_map, hash);
+    for (size_t dist = 0; idx < hi; ++dist, ++idx) {
+        if (u_map->data_states[idx] == EMPTY) {
+            *idx_out    = idx;
+            *is_new_out = true;
+            return true;
+        }
+
+        if (rh_is_richer(u_map, idx, dist)) {
+            size_t end = idx;
+            while (end < hi && u_map->data_states[end] != EMPTY) ++end;
+            if (end == hi) return false;
+
+            rh_shift_right(u_map, idx);
+            *idx_out    = idx;
+            *is_new_out = true;
+            return true;
+        }
+
+        if (key != nullptr && rh_same_home(u_map, idx, dist) && slot_hash_matches(u_map, idx, hash) &&
+            u_map->key_cmp(get_key(u_map, idx), key)) {
+            *idx_out    = idx;
+            *is_new_out = false;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Фаза 3: часть заполняется своим потоком; отложенным элементам место в начале куска order
+// освобождают уже пройденные. Повторы ключа попадают в одну часть и идут в порядке входа,
+// а раз путь ключа вышел из части, он выйдет и у следующих его повторов — последнее значение побеждает
+static void par_place_task(void* task_ctx, size_t p) {
+    par_fill_t* fill   = (par_fill_t*)task_ctx;
+    u_map_t*    target = fill->target;
+    par_part_t  part   = fill->part[p];
+
+    const size_t lo = p << fill->part_shift;
+    const size_t hi = (p + 1) << fill->part_shift;
+
+    for (size_t n = part.begin; n < part.end; ++n) {
+        const size_t i    = fill->order[n];
+        const size_t hash = fill->hashes[i];
+        const void*  key  = par_item_key(fill, i);
+
+        size_t idx = 0;
+        bool is_new = false;
+        const bool placed = target->probe == U_MAP_PROBE_ROBIN_HOOD
+                          ? par_rh_place(target, fill->upsert ? key : nullptr, hash, hi, &idx, &is_new)
+                          : par_swiss_place(target, fill->upsert ? key : nullptr, hash, lo, hi, &idx, &is_new);
+        if (!placed) {
+            fill->order[part.begin + part.deferred++] = i;
+            continue;
+        }
+
+        if (is_new) {
+            if (target->data_states[idx] == EMPTY) part.occupied++;
+            part.added++;
+            u_map_mark_slot(target, idx, idx, hash);
+            memcpy(get_key(target, idx), key, target->key_size);
+        } else {
+            part.duplicates++;
+        }
+        memcpy(get_value(target, idx), par_item_value(fill, i), target->value_size);
+    }
+
+    fill->part[p] = part;
+}
+
+// Параллельная часть стоит своих накладных расходов только на больших объемах.
+// В буфер, который делят снимки, пишет только вызывающий поток: список копий страниц не разделяется
+static bool u_map_par_eligible(const u_map_t* target, size_t items) {
+    return target->threads > 1 && items >= PAR_MIN_ITEMS && target->capacity != 0 && !target->is_static &&
+           target->data_index == nullptr && target->key_arena == nullptr && !u_map_cow_active(target);
+}
+
+static void par_fill_free(par_fill_t* fill) {
+    free(fill->hashes);
+    free(fill->offsets);
+    free(fill->order);
+    free(fill->part);
+}
+
+// Раскладывает вход по target, кроме отложенных: их вызывающий вставляет сам, пройдя части
+// по порядку. HM_ERR_MEM_ALLOC — target не тронута
+static hm_error_t u_map_par_fill(par_fill_t* fill) {
+    u_map_t* target = fill->target;
+
+    const size_t threads   = target->threads < PAR_MAX_THREADS ? target->threads : PAR_MAX_THREADS;
+    const size_t positions = target->probe == U_MAP_PROBE_ROBIN_HOOD ? target->capacity
+                                                                     : u_map_ctrl_bytes(target) / U_MAP_GROUP_WIDTH;
+    fill->parts = next_pow2_size_t(threads * PAR_PARTS_PER_THREAD);
+    if (fill->parts > positions) fill->parts = positions;
+    fill->part_shift = 0;
+    while ((positions >> fill->part_shift) > fill->parts) fill->part_shift++;
+    fill->chunks = threads * PAR_CHUNKS_PER_THREAD;
+
+    fill->hashes  = (size_t*)    calloc(fill->items,                sizeof(size_t));
+    fill->offsets = (size_t*)    calloc(fill->chunks * fill->parts, sizeof(size_t));
+    fill->order   = (size_t*)    calloc(fill->items,                sizeof(size_t));
+    fill->part    = (par_part_t*)calloc(fill->parts,                sizeof(par_part_t));
+    if (!fill->hashes || !fill->offsets || !fill->order || !fill->part) {
+        par_fill_free(fill);
+        return HM_ERR_MEM_ALLOC;
+    }
+
+    u_map_par_run(target, par_count_task, fill, fill->chunks);
+
+    size_t next = 0;
+    for (size_t p = 0; p < fill->parts; ++p) {
+        fill->part[p].begin = next;
+        for (size_t c = 0; c < fill->chunks; ++c) {
+            size_t* offset = fill->offsets + c * fill->parts + p;
+            const size_t count = *offset;
+            *offset = next;
+            next += count;
+        }
+        fill->part[p].end = next;
+    }
+
+    u_map_par_run(target, par_scatter_task, fill, fill->chunks);
+    u_map_par_run(target, par_place_task,   fill, fill->parts);
+
+    for (size_t p = 0; p < fill->parts; ++p) {
+        target->size     += fill->part[p].added;
+        target->occupied += fill->part[p].occupied;
+    }
+    return HM_ERR_OK;
+}
+
+//================================================================================
+//                        Рехэш и нормализация
+//================================================================================
+
+// Кладет пару в target, где этого ключа заведомо нет
+static bool u_map_transfer(u_map_t* target, const void* key, const void* value, size_t hash) {
+    HARD_ASSERT(target != nullptr, "target is nullptr");
+
+    // Длинный байтовый ключ переезжает в арену target до поиска слота: robin hood
+    // при поиске уже сдвигает кластер, и отказ арены после него было бы не откатить
+    bytes_key_t moved = {};
+    if (target->key_arena != nullptr) {
+        if (!u_map_key_arena_adopt(target, key, &moved)) return false;
+        bytes_key_set_prefix(moved.bytes, hash);
+        key = &moved;
+    }
+
+    size_t idx = 0;
+    if (!u_map_find_free_slot(target, hash, &idx)) {
+        if (target->key_arena != nullptr) u_map_key_arena_unadopt(target, &moved);
+        return false;
+    }
+
+    u_map_occupy_slot(target, idx, hash);
+    memcpy(get_key  (target, idx), key,   target->key_size);
+    memcpy(get_value(target, idx), value, target->value_size);
+    return true;
+}
+
+// Переносит занятый слот src_idx таблицы src в target
+static bool u_map_transfer_slot(u_map_t* target, const u_map_t* src, size_t src_idx) {
+    HARD_ASSERT(src != nullptr, "src is nullptr");
+    return u_map_transfer(target, get_key(src, src_idx), get_value(src, src_idx), slot_hash(src, src_idx));
+}
+
+// Перенос всех элементов src по частям на threads потоков; HM_ERR_MEM_ALLOC — target не тронута
+static hm_error_t u_map_par_transfer(u_map_t* target, const u_map_t* src, bool rehash) {
+    par_fill_t fill;
+    memset(&fill, 0, sizeof(fill));
+    fill.target = target;
+    fill.src    = src;
+    fill.items  = src->capacity;
+    fill.rehash = rehash;
+
+    hm_error_t err = u_map_par_fill(&fill);
+    RETURN_IF_ERROR(err);
+
+    for (size_t p = 0; p < fill.parts && err == HM_ERR_OK; ++p) {
+        for (size_t n = 0; n < fill.part[p].deferred; ++n) {
+            const size_t i = fill.order[fill.part[p].begin + n];
+            if (!u_map_transfer(target, get_key(src, i), get_value(src, i), fill.hashes[i])) {
+                err = HM_ERR_FULL;
+                break;
+            }
+        }
+    }
+
+    par_fill_free(&fill);
+    return err;
+}
+
+// Переносит все элементы src в target; плотная раскладка — по записям, сохраняя порядок вставки.
+// rehash — считать хэши заново по соли target, а не брать у src
+static bool u_map_transfer_all(u_map_t* target, const u_map_t* src, bool rehash) {
+    HARD_ASSERT(src != nullptr, "src is nullptr");
+
+    if (src->data_index == nullptr && u_map_par_eligible(target, src->size)) {
+        const hm_error_t err = u_map_par_transfer(target, src, rehash);
+        if (err != HM_ERR_MEM_ALLOC) return err == HM_ERR_OK;
+        LOGGER_WARNING("No memory for parallel transfer, transferring in one thread");
+    }
+
+    const size_t count = src->data_index != nullptr ? src->entries_used : src->capacity;
+    for (size_t i = 0; i < count; ++i) {
+        const bool is_live = src->data_index != nullptr ? src->data_alive[i] != 0
+                                                        : u_map_ctrl_is_full(src->data_states[i]);
+        if (!is_live) continue;
+
+        const void*  key  = entry_key(src, i);
+        const size_t hash = rehash ? u_map_hash_key(target, key) : entry_hash(src, i);
+        if (!u_map_transfer(target, key, entry_value(src, i), hash)) return false;
+    }
+    return true;
+}
+
+static void u_map_free_old_table(u_map_t* u_map) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+
+    u_map_t* old = u_map->old_table;
+    if (old == nullptr) return;
+
+    u_map_free_data(old);
+    u_map_key_arena_free(old);
+    u_map_mem_free(u_map, old->counters, sizeof(u_map_counters_t));
+    u_map_mem_free(u_map, old,           sizeof(u_map_t));
+    u_map->old_table   = nullptr;
+    u_map->migrate_pos = 0;
+}
+
+// Переносит из старой таблицы не больше budget слотов (считаются и пустые)
+static hm_error_t u_map_migrate(u_map_t* u_map, size_t budget) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+
+    u_map_t* old = u_map->old_table;
+    if (old == nullptr) return HM_ERR_OK;
+
+    const size_t mask = old->capacity - 1;
+    for (; budget > 0 && old->size > 0; --budget) {
+        const size_t idx = u_map->migrate_pos;
+        if (u_map_ctrl_is_full(old->data_states[idx])) {
+            if (!u_map_transfer_slot(u_map, old, idx)) return HM_ERR_FULL;
+            u_map_erase_slot(old, idx);
+        }
+
+        // Обратный сдвиг robin hood мог подтянуть в idx следующий элемент — тогда остаемся на месте
+        if (!u_map_ctrl_is_full(old->data_states[idx])) u_map->migrate_pos = (idx + 1) & mask;
+    }
+
+    if (old->size == 0) {
+        LOGGER_DEBUG("Incremental rehash to capacity %zu finished", u_map->capacity);
+        u_map_free_old_table(u_map);
+    }
+    return HM_ERR_OK;
+}
+
+// Обмен содержимым без выделения памяти: ключи и значения бывают любого размера
+static void swap_bytes(void* a, void* b, size_t n) {
+    unsigned char* pa = (unsigned char*)a;
+    unsigned char* pb = (unsigned char*)b;
+    unsigned char  tmp[64];
+
+    while (n > 0) {
+        const size_t chunk = n < sizeof(tmp) ? n : sizeof(tmp);
+        memcpy(tmp, pa, chunk);
+        memcpy(pa,  pb, chunk);
+        memcpy(pb, tmp, chunk);
+        pa += chunk;
+        pb += chunk;
+        n  -= chunk;
+    }
+}
+
+static void u_map_swap_slots(u_map_t* u_map, size_t a, size_t b) {
+    if (u_map->data_index != nullptr) {
+        const uint32_t tmp = u_map->data_index[a];
+        u_map->data_index[a] = u_map->data_index[b];
+        u_map->data_index[b] = tmp;
+        return;
+    }
+
+    swap_bytes(get_key  (u_map, a), get_key  (u_map, b), u_map->key_size);
+    swap_bytes(get_value(u_map, a), get_value(u_map, b), u_map->value_size);
+    if (u_map->data_hashes != nullptr) {
+        const size_t tmp = u_map->data_hashes[a];
+        u_map->data_hashes[a] = u_map->data_hashes[b];
+        u_map->data_hashes[b] = tmp;
+    }
+}
+
+// Плотная раскладка: живые записи сдвигаются к началу с сохранением порядка,
+// потом слоты заполняются заново (так и для swiss, и для robin hood)
+static void u_map_compact_dense(u_map_t* u_map) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+
+    u_map_cow_save_all(u_map);
+
+    size_t live = 0;
+    for (size_t e = 0; e < u_map->entries_used; ++e) {
+        if (!u_map->data_alive[e]) continue;
+        if (e != live) {
+            memcpy(entry_key  (u_map, live), entry_key  (u_map, e), u_map->key_size);
+            memcpy(entry_value(u_map, live), entry_value(u_map, e), u_map->value_size);
+            if (u_map->data_hashes != nullptr) u_map->data_hashes[live] = u_map->data_hashes[e];
+        }
+        live++;
+    }
+    HARD_ASSERT(live == u_map->size, "alive entries must match size");
+
+    memset(u_map->data_alive, 0, u_map->entries_used);
+    u_map_reset_states(u_map);
+    u_map->size         = 0;
+    u_map->occupied     = 0;
+    u_map->entries_used = 0;
+
+    // occupy_slot выдает записи по порядку, так что запись e снова получает номер e
+    for (size_t e = 0; e < live; ++e) {
+        const size_t hash = entry_hash(u_map, e);
+        size_t idx = 0;
+        bool is_found = u_map_find_free_slot(u_map, hash, &idx);
+        HARD_ASSERT(is_found, "compacted table must have room");
+        (void)is_found;
+        u_map_occupy_slot(u_map, idx, hash);
+    }
+}
+
+// Рехэш на той же ёмкости внутри текущего буфера (swiss):
+// 1) DELETED -> EMPTY, занятые -> DELETED («еще не размещены»)
+// 2) каждый неразмещенный элемент уезжает в первый свободный слот своего пути;
+//    если там лежит другой неразмещенный элемент — они меняются местами
+static void u_map_compact_in_place(u_map_t* u_map) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+
+    if (u_map->data_index != nullptr) {
+        if (u_map->entries_used != u_map->size || u_map->occupied != u_map->size) u_map_compact_dense(u_map);
+        return;
+    }
+
+    if (u_map->probe == U_MAP_PROBE_ROBIN_HOOD || u_map->occupied == u_map->size) return;
+
+    u_map_cow_save_all(u_map);
+
+    uint8_t* states = u_map->data_states;
+    for (size_t i = 0; i < u_map->capacity; ++i) {
+        states[i] = u_map_ctrl_is_full(states[i]) ? (uint8_t)DELETED : (uint8_t)EMPTY;
+    }
+
+    size_t i = 0;
+    while (i < u_map->capacity) {
+        if (states[i] != DELETED) {
+            ++i;
+            continue;
+        }
+
+        const size_t hash = slot_hash(u_map, i);
+        size_t target = 0;
+        bool is_found = u_map_find_free_slot(u_map, hash, &target);
+        HARD_ASSERT(is_found, "slot i itself must be on the probe path");
+        (void)is_found;
+
+        if (target / U_MAP_GROUP_WIDTH == i / U_MAP_GROUP_WIDTH) {
+            states[i] = u_map_hash_h2(hash);
+            ++i;
+        } else if (states[target] == EMPTY) {
+            u_map_move_slot(u_map, target, i);
+            states[target] = u_map_hash_h2(hash);
+            states[i]      = EMPTY;
+            ++i;
+        } else {
+            u_map_swap_slots(u_map, i, target);
+            states[target] = u_map_hash_h2(hash);
+        }
+    }
+
+    u_map->occupied = u_map->size;
+}
+
+static hm_error_t u_map_rehash_table(u_map_t* u_map, size_t new_capacity) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+
+    hm_error_t err = u_map_finish_rehash(u_map);
+    RETURN_IF_ERROR(err);
+
+    // Статическая таблица может только почистить надгробия на месте
+    if (u_map->is_static) {
+        if (new_capacity == u_map->capacity) u_map_compact_in_place(u_map);
+        return HM_ERR_OK;
+    }
+
+    if (new_capacity < INITIAL_CAPACITY)
+        new_capacity = INITIAL_CAPACITY;
+
+    new_capacity = next_pow2_size_t(new_capacity);
+
+    // Чистка на месте не возвращает память удаленных байтовых ключей — для этого нужна новая арена
+    if (new_capacity == u_map->capacity && u_map->rehash_step == 0 && !u_map_key_arena_is_wasteful(u_map)) {
+        u_map_compact_in_place(u_map);
+        return HM_ERR_OK;
+    }
+
+    u_map_t new_map;
+    memset(&new_map, 0, sizeof(new_map));
+    const u_map_opts_t opts = u_map_opts_of(u_map);
+    err = u_map_init_with_allocator(&new_map, new_capacity,
+                                    u_map->key_size,   u_map->key_align,
+                                    u_map->value_size, u_map->value_align,
+                                    u_map->hash_func, u_map->key_cmp, &opts, &u_map->allocator);
+    RETURN_IF_ERROR(err);
+
+    // Инкрементальный режим: старая таблица остается рядом и переносится по rehash_step слотов за операцию
+    if (u_map->rehash_step != 0 && u_map->size > u_map->rehash_step) {
+        u_map_t* old = (u_map_t*)u_map_mem_alloc(u_map, sizeof(u_map_t), alignof(u_map_t));
+        if (old != nullptr) {
+            u_map_counters_move(&new_map, u_map);
+            new_map.flood = u_map->flood;
+            *old = *u_map;
+            *u_map = new_map;
+            u_map->old_table   = old;
+            u_map->migrate_pos = 0;
+            return u_map_migrate(u_map, u_map->rehash_step);
+        }
+        LOGGER_WARNING("No memory for incremental rehash, rehashing at once");
+    }
+
+    if (!u_map_transfer_all(&new_map, u_map, false)) {
+        u_map_destroy(&new_map);
+        return HM_ERR_FULL;
+    }
+
+    u_map_free_data(u_map);
+    u_map_key_arena_free(u_map);
+    u_map_counters_move(&new_map, u_map);
+    new_map.flood = u_map->flood;
+    *u_map = new_map;
+    return HM_ERR_OK;
+}
+
+// Новая соль и перестройка на той же ёмкости: позиции всех ключей считаются заново,
+// так что подобранные под старую соль коллизии расходятся
+static hm_error_t u_map_reseed(u_map_t* u_map) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+
+    hm_error_t err = u_map_finish_rehash(u_map);
+    RETURN_IF_ERROR(err);
+
+    const uint64_t started = stat_clock();
+
+    u_map_opts_t opts = u_map_opts_of(u_map);
+    opts.seed = u_map_random_seed();
+
+    u_map_t new_map;
+    memset(&new_map, 0, sizeof(new_map));
+    err = u_map_init_with_allocator(&new_map, u_map->capacity,
+                                    u_map->key_size,   u_map->key_align,
+                                    u_map->value_size, u_map->value_align,
+                                    u_map->hash_func, u_map->key_cmp, &opts, &u_map->allocator);
+    RETURN_IF_ERROR(err, stat_time(u_map, started));
+
+    if (!u_map_transfer_all(&new_map, u_map, true)) {
+        u_map_destroy(&new_map);
+        stat_time(u_map, started);
+        return HM_ERR_FULL;
+    }
+
+    stat_count(u_map, &u_map_counters_t::rehash_cleanup, 1);
+    stat_count(u_map, &u_map_counters_t::bytes_allocated, u_map_table_bytes(&new_map));
+    stat_time(u_map, started);
+
+    u_map_free_data(u_map);
+    u_map_key_arena_free(u_map);
+    u_map_counters_move(&new_map, u_map);
+    new_map.flood = u_map->flood;
+    *u_map = new_map;
+    return HM_ERR_OK;
+}
+
+// Вставка прошла дальше FLOOD_PROBE_* от домашней позиции: при случайном хэше и нормальной
+// загрузке этого не бывает, значит ключи подобраны под соль. Новая соль помогает, только
+// если hash_func не совпадает целиком, поэтому повторная смена — не раньше, чем таблица
+// удвоится: иначе вставки платили бы за перестройку каждый раз
+static const size_t FLOOD_PROBE_GROUPS = 32;
+static const size_t FLOOD_PROBE_SLOTS  = FLOOD_PROBE_GROUPS * U_MAP_GROUP_WIDTH;
+
+static void u_map_note_flood(u_map_t* u_map, size_t probes) {
+    (void)probes; // только для лога
+    u_map_flood_t* flood = &u_map->flood;
+    flood->events++;
+
+    const bool can_reseed = !u_map->is_static && !u_map->no_reseed &&
+                            (flood->reseeds == 0 || u_map->size >= 2 * flood->reseed_size);
+    if (can_reseed) flood->pending = true;
+
+    // Под атакой событие на каждой вставке: в лог — только 1-е, 2-е, 4-е...
+    if ((flood->events & (flood->events - 1)) == 0) {
+        LOGGER_WARNING("u_map: insert probed %zu %s (size %zu, capacity %zu), flood event %zu, %s", probes,
+                       u_map->probe == U_MAP_PROBE_ROBIN_HOOD ? "slots" : "groups", u_map->size, u_map->capacity,
+                       flood->events, can_reseed ? "reseeding" : "not reseeding");
+    }
+}
+
+static hm_error_t u_map_handle_flood(u_map_t* u_map) {
+    u_map->flood.pending = false;
+
+    hm_error_t err = u_map_reseed(u_map);
+    RETURN_IF_ERROR(err);
+
+    u_map->flood.reseeds++;
+    u_map->flood.reseed_size = u_map->size;
+    return HM_ERR_OK;
+}
+
+static hm_error_t u_map_rehash(u_map_t* u_map, size_t new_capacity) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+
+    const uint64_t started      = stat_clock();
+    const size_t   old_capacity = u_map->capacity;
+    const void*    old_data     = u_map->data;
+
+    hm_error_t err = u_map_rehash_table(u_map, new_capacity);
+    RETURN_IF_ERROR(err, stat_time(u_map, started));
+
+    if      (u_map->capacity > old_capacity) stat_count(u_map, &u_map_counters_t::rehash_grow,    1);
+    else if (u_map->capacity < old_capacity) stat_count(u_map, &u_map_counters_t::rehash_shrink,  1);
+    else                                     stat_count(u_map, &u_map_counters_t::rehash_cleanup, 1);
+
+    if (u_map->data != old_data) stat_count(u_map, &u_map_counters_t::bytes_allocated, u_map_table_bytes(u_map));
+
+    stat_time(u_map, started);
+    return HM_ERR_OK;
+}
+
+// Сколько места занято вместе с мусором: слоты с надгробиями, в плотной раскладке — и удаленные записи
+static size_t u_map_used(const u_map_t* u_map) {
+    return max_size_t(u_map->occupied, u_map->entries_used);
+}
+
+// allow_shrink: сжимать ли недогруженную таблицу (вставка не сжимает — иначе теряется u_map_reserve)
+static hm_error_t normalize_capacity(u_map_t* u_map, bool allow_shrink) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+    HARD_ASSERT(u_map->occupied >= u_map->size, "Ocupied elems less than elems");
+
+    if (u_map->capacity == 0)
+        return HM_ERR_OK;
+
+    const u_map_load_policy_t* policy = &u_map->load;
+
+    // Частый случай вставки: рехэш не идет и места хватает — без делений и ветвлений ниже
+    if (!allow_shrink && !u_map->is_static && u_map->old_table == nullptr && !u_map->flood.pending &&
+        (double)u_map_used(u_map) <= policy->max_load * (double)u_map->capacity &&
+        !u_map_key_arena_is_wasteful(u_map))
+        return HM_ERR_OK;
+
+    if (u_map->flood.pending) {
+        hm_error_t err = u_map_handle_flood(u_map);
+        RETURN_IF_ERROR(err);
+    }
+
+    if (u_map->is_static) {
+        const double load_occupied = (double)u_map_used(u_map)                 / (double)u_map->capacity;
+        const double load_garbage  = (double)(u_map_used(u_map) - u_map->size) / (double)u_map->capacity;
+        if (load_occupied > policy->max_load && load_garbage > policy->garbage_load) {
+            LOGGER_DEBUG("Compacting static capacity %zu (cleaning tombstones)", u_map->capacity);
+            u_map_compact_in_place(u_map);
+        }
+        return HM_ERR_OK;
+    }
+
+    if (u_map->old_table != nullptr) {
+        const uint64_t started = stat_clock();
+        hm_error_t err = u_map_migrate(u_map, u_map->rehash_step != 0 ? u_map->rehash_step : SIZE_MAX);
+        stat_time(u_map, started);
+        RETURN_IF_ERROR(err);
+
+        if (u_map->old_table != nullptr) {
+            // Пока идет перенос, новые решения о размере не принимаются, если только
+            // новая таблица вместе с непереносенным остатком не переполнилась
+            const size_t pending = u_map->occupied + u_map->old_table->size;
+            if ((double)pending / (double)u_map->capacity <= policy->max_load)
+                return HM_ERR_OK;
+
+            err = u_map_finish_rehash(u_map);
+            RETURN_IF_ERROR(err);
+        }
+    }
+
+    const double load_occupied = (double)u_map_used(u_map)                 / (double)u_map->capacity;
+    const double load_real     = (double)u_map->size                       / (double)u_map->capacity;
+    const double load_garbage  = (double)(u_map_used(u_map) - u_map->size) / (double)u_map->capacity;
+    size_t new_capacity = u_map->capacity;
+    bool need_rehash = false;
+
+    if (allow_shrink && !policy->no_auto_shrink && u_map->capacity > INITIAL_CAPACITY &&
+        load_real < policy->shrink_load) {
+        new_capacity = u_map->capacity / 2;
+        if (new_capacity < INITIAL_CAPACITY)
+            new_capacity = INITIAL_CAPACITY;
+        need_rehash = true;
+    }
+    else if (load_occupied > policy->max_load) {
+        if (load_real < policy->max_load && (load_garbage > policy->garbage_load)) {
+            new_capacity = u_map->capacity;
+            need_rehash = true;
+        } else {
+            new_capacity = u_map->capacity * 2;
+            need_rehash = true;
+        }
+    }
+    else if (u_map_key_arena_is_wasteful(u_map)) {
+        LOGGER_DEBUG("Rehashing capacity %zu (releasing removed byte keys)", u_map->capacity);
+        need_rehash = true;
+    }
+
+    if (!need_rehash)
+        return HM_ERR_OK;
+
+    if (new_capacity == u_map->capacity) {
+        LOGGER_DEBUG("Rehashing capacity %zu (cleaning tombstones)", u_map->capacity);
+    } else {
+        LOGGER_DEBUG("Changing capacity from %zu to %zu", u_map->capacity, new_capacity);
+    }
+
+    return u_map_rehash(u_map, new_capacity);
+}
+
+
+//================================================================================
+//                       Конструкторы / Деструкторы / Копировальщики
+//================================================================================
+
+// Общая часть конструкторов: привязывает буфер и заполняет поля
+static void u_map_setup(u_map_t* u_map, void* data, size_t capacity, const u_map_layout_t* layout,
+                        size_t key_size,   size_t key_align,
+                        size_t value_size, size_t value_align,
+                        key_func_t hash_func, key_cmp_t key_cmp,
+                        const u_map_opts_t* opts, const u_map_allocator_t* allocator, bool is_static) {
+    HARD_ASSERT(u_map     != nullptr, "u_map is nullptr");
+    HARD_ASSERT(data      != nullptr, "data is nullptr");
+    HARD_ASSERT(layout    != nullptr, "layout is nullptr");
+    HARD_ASSERT(opts      != nullptr, "opts is nullptr");
+    HARD_ASSERT(allocator != nullptr, "allocator is nullptr");
+
+    u_map->data        = data;
+    u_map->data_keys   = data;
+    u_map->data_values = (void*)((unsigned char*)data + layout->values_offset);
+    u_map->data_hashes = opts->store_hashes ? (size_t*)(void*)((unsigned char*)data + layout->hashes_offset)
+                                            : nullptr;
+    u_map->data_states = (uint8_t*)data + layout->states_offset;
+    u_map->data_index  = opts->dense ? (uint32_t*)(void*)((unsigned char*)data + layout->index_offset) : nullptr;
+    u_map->data_alive  = opts->dense ? (uint8_t*)data + layout->alive_offset : nullptr;
+
+    u_map->size         = 0;
+    u_map->occupied     = 0;
+    u_map->entries_used = 0;
+    u_map->capacity     = capacity;
+
+    u_map->key_size   = key_size;
+    u_map->key_align  = key_align;
+    u_map->key_stride = layout->key_stride;
+
+    u_map->value_size   = value_size;
+    u_map->value_align  = value_align;
+    u_map->value_stride = layout->value_stride;
+
+    u_map->hash_func   = hash_func;
+    u_map->key_cmp     = key_cmp;
+    u_map->strong_hash = opts->strong_hash || u_map_hash_is_strong(hash_func);
+    u_map->seed        = opts->random_seed ? u_map_random_seed() : opts->seed;
+    u_map->no_reseed   = opts->no_reseed;
+    memset(&u_map->flood, 0, sizeof(u_map->flood));
+
+    u_map->probe = opts->probe;
+
+    u_map->old_table   = nullptr;
+    u_map->migrate_pos = 0;
+    u_map->rehash_step = is_static || opts->dense ? 0 : opts->rehash_step;
+    u_map->load        = u_map_resolve_load_policy(&opts->load);
+    u_map->threads     = opts->threads;
+    u_map->executor    = opts->executor;
+
+    u_map->counters  = nullptr;
+    u_map->key_arena = nullptr;
+    u_map->allocator = *allocator;
+
+    u_map->mapping       = nullptr;
+    u_map->mapping_bytes = 0;
+    u_map->is_read_only  = false;
+
+    u_map->cow      = nullptr;
+    u_map->cow_view = nullptr;
+
+    u_map->is_static = is_static;
+}
+
+// Номера записей плотной раскладки — uint32_t
+static hm_error_t u_map_check_dense_capacity(size_t capacity, const u_map_opts_t* opts) {
+    if (!opts->dense || (uint64_t)capacity <= (uint64_t)UINT32_MAX + 1) return HM_ERR_OK;
+
+    LOGGER_ERROR("dense u_map capacity %zu does not fit 32-bit entry numbers", capacity);
+    return HM_ERR_BAD_ARG;
+}
+
+hm_error_t u_map_init(u_map_t* u_map, size_t capacity,
+                   size_t key_size,   size_t key_align,
+                   size_t value_size, size_t value_align,
+                   key_func_t hash_func, key_cmp_t key_cmp) {
+    return u_map_init_ex(u_map, capacity, key_size, key_align, value_size, value_align,
+                         hash_func, key_cmp, nullptr);
+}
+
+hm_error_t u_map_init_ex(u_map_t* u_map, size_t capacity,
+                         size_t key_size,   size_t key_align,
+                         size_t value_size, size_t value_align,
+                         key_func_t hash_func, key_cmp_t key_cmp,
+                         const u_map_opts_t* opts) {
+    return u_map_init_with_allocator(u_map, capacity, key_size, key_align, value_size, value_align,
+                                     hash_func, key_cmp, opts, nullptr);
+}
+
+hm_error_t u_map_init_with_allocator(u_map_t* u_map, size_t capacity,
+                                     size_t key_size,   size_t key_align,
+                                     size_t value_size, size_t value_align,
+                                     key_func_t hash_func, key_cmp_t key_cmp,
+                                     const u_map_opts_t* opts, const u_map_allocator_t* allocator) {
+
+    HARD_ASSERT(u_map      != nullptr, "u_map is nullptr");
+    HARD_ASSERT(hash_func  != nullptr, "hash_func is nullptr");
+    HARD_ASSERT(key_cmp    != nullptr, "key_cmp is nullptr");
+    HARD_ASSERT(allocator == nullptr || (allocator->alloc != nullptr && allocator->free != nullptr),
+                "allocator must have alloc and free");
+
+    LOGGER_DEBUG("u_map_init started");
+
+    u_map_opts_t            used_opts      = opts      ? *opts      : u_map_default_opts();
+    const u_map_allocator_t used_allocator = allocator ? *allocator : u_map_default_allocator();
+
+    // Байтовые ключи: в слоте лежит запись ключа, хэш и сравнение встроенные
+    if (used_opts.bytes_keys) {
+        key_size  = U_MAP_BYTES_KEY_SIZE;
+        key_align = alignof(bytes_key_t);
+        hash_func = bytes_key_hash;
+        key_cmp   = bytes_key_eq;
+        used_opts.strong_hash = true;
+    }
+
+    if (capacity < INITIAL_CAPACITY) capacity = INITIAL_CAPACITY;
+    capacity = next_pow2_size_t(capacity);
+    RETURN_IF_ERROR(u_map_check_dense_capacity(capacity, &used_opts));
+    RETURN_IF_ERROR(u_map_check_load_policy(&used_opts.load));
+
+    // Длинные байтовые ключи лежат в арене, которую снимок не видит
+    if (used_opts.cow_snapshots && used_opts.bytes_keys) return HM_ERR_BAD_ARG;
+
+    const u_map_layout_t layout = u_map_calc_layout(capacity, key_size, key_align, value_size, value_align,
+                                                    used_opts.store_hashes, used_opts.dense);
+
+    u_map_cow_t* cow = nullptr;
+    if (used_opts.cow_snapshots && u_map_cow_create(layout.total_bytes, &cow) != HM_ERR_OK) {
+        LOGGER_WARNING("memfd is unavailable, snapshots will copy the table");
+    }
+
+    void* data = cow != nullptr ? cow->base
+                                : used_allocator.alloc(used_allocator.ctx, layout.total_bytes,
+                                                       u_map_data_align(key_align, value_align, &used_opts));
+    if (!data) return HM_ERR_MEM_ALLOC;
+
+    u_map_setup(u_map, data, capacity, &layout, key_size, key_align, value_size, value_align,
+                hash_func, key_cmp, &used_opts, &used_allocator, false);
+    u_map_reset_states(u_map);
+
+    // Снимок делит один буфер: старая таблица инкрементального рехэша была бы вторым
+    if (cow != nullptr) {
+        u_map->cow         = cow;
+        u_map->rehash_step = 0;
+    }
+
+    hm_error_t err = u_map_counters_create(u_map);
+    RETURN_IF_ERROR(err, u_map_free_data(u_map), memset(u_map, 0, sizeof(*u_map)));
+    stat_count(u_map, &u_map_counters_t::bytes_allocated, layout.total_bytes);
+
+    if (used_opts.bytes_keys) {
+        err = u_map_key_arena_create(u_map);
+        RETURN_IF_ERROR(err, u_map_destroy(u_map));
+    }
+
+    return HM_ERR_OK;
+}
+
+hm_error_t u_map_static_init(u_map_t* u_map, void* data, size_t capacity,
+                          size_t key_size,   size_t key_align,
+                          size_t value_size, size_t value_align,
+                          key_func_t hash_func, key_cmp_t key_cmp) {
+    return u_map_static_init_ex(u_map, data, capacity, key_size, key_align, value_size, value_align,
+                                hash_func, key_cmp, nullptr);
+}
+
+hm_error_t u_map_static_init_ex(u_map_t* u_map, void* data, size_t capacity,
+                                size_t key_size,   size_t key_align,
+                                size_t value_size, size_t value_align,
+                                key_func_t hash_func, key_cmp_t key_cmp,
+                                const u_map_opts_t* opts) {
+
+    HARD_ASSERT(u_map      != nullptr, "u_map is nullptr");
+    HARD_ASSERT(data       != nullptr, "data is nullptr");
+    HARD_ASSERT(hash_func  != nullptr, "hash_func is nullptr");
+    HARD_ASSERT(key_cmp    != nullptr, "key_cmp is nullptr");
+    HARD_ASSERT(key_size   > 0,     "key_size must be > 0");
+    HARD_ASSERT(value_size > 0,     "value_size must be > 0");
+    HARD_ASSERT(key_align  > 0,     "key_align must be > 0");
+    HARD_ASSERT(value_align> 0,     "value_align must be > 0");
+
+    LOGGER_DEBUG("u_map_static_init started");
+
+    const u_map_opts_t used_opts = opts ? *opts : u_map_default_opts();
+
+    // Длинным байтовым ключам нужна арена, а статической таблице выделять память нельзя
+    if (used_opts.bytes_keys) {
+        LOGGER_ERROR("static u_map does not support byte keys");
+        return HM_ERR_BAD_ARG;
+    }
+
+    capacity = prev_pow2_size_t(capacity);
+    RETURN_IF_ERROR(capacity == 0 ? HM_ERR_BAD_ARG : HM_ERR_OK);
+    RETURN_IF_ERROR(u_map_check_dense_capacity(capacity, &used_opts));
+    RETURN_IF_ERROR(u_map_check_load_policy(&used_opts.load));
+
+    const u_map_layout_t layout = u_map_calc_layout(capacity, key_size, key_align, value_size, value_align,
+                                                    used_opts.store_hashes, used_opts.dense);
+
+    const size_t need_align = u_map_data_align(key_align, value_align, &used_opts);
+    if (((uintptr_t)data % need_align) != 0) {
+        LOGGER_ERROR("static buffer is not aligned to %zu bytes", need_align);
+        return HM_ERR_BAD_ARG;
+    }
+
+    const u_map_allocator_t allocator = u_map_default_allocator();
+    u_map_setup(u_map, data, capacity, &layout, key_size, key_align, value_size, value_align,
+                hash_func, key_cmp, &used_opts, &allocator, true);
+    u_map_reset_states(u_map);
+
+    return HM_ERR_OK;
+}
+
+hm_error_t u_map_destroy(u_map_t* u_map) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+
+    LOGGER_DEBUG("u_map_dest started");
+
+    u_map_free_data(u_map);
+    u_map_free_old_table(u_map);
+    u_map_key_arena_free(u_map);
+    u_map_mem_free(u_map, u_map->counters, sizeof(u_map_counters_t));
+
+    memset(u_map, 0, sizeof(*u_map));
+    return HM_ERR_OK;
+}
+
+hm_error_t u_map_smart_copy(u_map_t* target, const u_map_t* source) {
+    HARD_ASSERT(target != nullptr, "target is nullptr");
+    HARD_ASSERT(source != nullptr, "source is nullptr");
+
+    LOGGER_DEBUG("u_map_smart_copy started");
+
+    const u_map_opts_t opts = u_map_opts_of(source);
+    hm_error_t err = u_map_init_with_allocator(target, source->capacity,
+                                               source->key_size,   source->key_align,
+                                               source->value_size, source->value_align,
+                                               source->hash_func, source->key_cmp, &opts, &source->allocator);
+    RETURN_IF_ERROR(err);
+
+    // Во время инкрементального рехэша часть элементов еще лежит в старой таблице
+    for (const u_map_t* table = source; table != nullptr; table = table->old_table) {
+        if (!u_map_transfer_all(target, table, false)) {
+            u_map_destroy(target);
+            return HM_ERR_FULL;
+        }
+    }
+
+    return HM_ERR_OK;
+}
+
+// Плотная раскладка копирует только занятый префикс записей, обычная — буфер целиком
+static void u_map_copy_data(void* data, const u_map_t* source, size_t total_bytes) {
+    if (source->data_index == nullptr) {
+        memcpy(data, source->data, total_bytes);
+        return;
+    }
+
+    const unsigned char* base = (const unsigned char*)source->data;
+    unsigned char*       dst  = (unsigned char*)data;
+    const size_t         used = source->entries_used;
+
+    memcpy(dst, base, used * source->key_stride);
+
+    const size_t values_offset = (size_t)((const unsigned char*)source->data_values - base);
+    memcpy(dst + values_offset, base + values_offset, used * source->value_stride);
+
+    if (source->data_hashes != nullptr) {
+        const size_t hashes_offset = (size_t)((const unsigned char*)source->data_hashes - base);
+        memcpy(dst + hashes_offset, base + hashes_offset, used * sizeof(size_t));
+    }
+
+    // Номера, флаги записей и управляющие байты лежат в конце буфера одним куском
+    const size_t index_offset = (size_t)((const unsigned char*)source->data_index - base);
+    memcpy(dst + index_offset, base + index_offset, total_bytes - index_offset);
+}
+
+// Указатели target на массивы внутри data — с теми же смещениями, что у source
+static void u_map_rebase(u_map_t* target, const u_map_t* source, void* data) {
+    const unsigned char* source_base = (const unsigned char*)source->data;
+
+    target->data        = data;
+    target->data_keys   = data;
+    target->data_values = (unsigned char*)data + ((const unsigned char*)source->data_values - source_base);
+    target->data_states = (uint8_t*)data       + ((const unsigned char*)source->data_states - source_base);
+    if (source->data_hashes != nullptr) {
+        target->data_hashes = (size_t*)(void*)((unsigned char*)data +
+                                               ((const unsigned char*)source->data_hashes - source_base));
+    }
+    if (source->data_index != nullptr) {
+        target->data_index = (uint32_t*)(void*)((unsigned char*)data +
+                                                ((const unsigned char*)source->data_index - source_base));
+        target->data_alive = (uint8_t*)data + (source->data_alive - (const uint8_t*)source_base);
+    }
+}
+
+static hm_error_t u_map_raw_copy_table(u_map_t* target, const u_map_t* source) {
+    HARD_ASSERT(target != nullptr, "target is nullptr");
+    HARD_ASSERT(source != nullptr, "source is nullptr");
+
+    // Копия получает ровно ту же ёмкость и раскладку, что и источник (в том числе статический)
+    const u_map_opts_t opts = u_map_opts_of(source);
+    size_t total_bytes = u_map_required_bytes_ex(source->capacity,
+                                                 source->key_size, source->key_align,
+                                                 source->value_size, source->value_align, &opts);
+    void* data = u_map_mem_alloc(source, total_bytes, u_map_data_align(source->key_align, source->value_align, &opts));
+    if (!data) return HM_ERR_MEM_ALLOC;
+    u_map_copy_data(data, source, total_bytes);
+
+    *target = *source;
+    u_map_rebase(target, source, data);
+    target->is_static   = false;
+    target->old_table   = nullptr;
+
+    // Копия снимка — обычная таблица в памяти аллокатора
+    target->mapping       = nullptr;
+    target->mapping_bytes = 0;
+    target->is_read_only  = false;
+    target->cow           = nullptr;
+    target->cow_view      = nullptr;
+
+    // Копия начинает статистику с нуля
+    hm_error_t err = u_map_counters_create(target);
+    RETURN_IF_ERROR(err, u_map_mem_free(source, data, total_bytes), memset(target, 0, sizeof(*target)));
+    stat_count(target, &u_map_counters_t::bytes_allocated, total_bytes);
+
+    if (source->key_arena != nullptr) {
+        err = u_map_key_arena_clone(target);
+        RETURN_IF_ERROR(err, u_map_mem_free(source, target->counters, sizeof(u_map_counters_t)),
+                             u_map_mem_free(source, data, total_bytes), memset(target, 0, sizeof(*target)));
+    }
+
+    return HM_ERR_OK;
+}
+
+hm_error_t u_map_raw_copy(u_map_t* target, const u_map_t* source) {
+    HARD_ASSERT(target != nullptr, "target is nullptr");
+    HARD_ASSERT(source != nullptr, "source is nullptr");
+
+    LOGGER_DEBUG("u_map_raw_copy started");
+
+    hm_error_t err = u_map_raw_copy_table(target, source);
+    RETURN_IF_ERROR(err);
+
+    if (source->old_table == nullptr) return HM_ERR_OK;
+
+    u_map_t* old = (u_map_t*)u_map_mem_alloc(source, sizeof(u_map_t), alignof(u_map_t));
+    if (old == nullptr) {
+        u_map_destroy(target);
+        return HM_ERR_MEM_ALLOC;
+    }
+
+    err = u_map_raw_copy_table(old, source->old_table);
+    RETURN_IF_ERROR(err, u_map_mem_free(source, old, sizeof(u_map_t)), u_map_destroy(target));
+
+    target->old_table = old;
+    return HM_ERR_OK;
+}
+
+// С cow_snapshots — новое отображение того же memfd, страницы копируются при записи в таблицу;
+// без него — u_map_raw_copy. Снимок в обоих случаях только для чтения
+hm_error_t u_map_snapshot(u_map_t* u_map, u_map_t* snapshot_out) {
+    HARD_ASSERT(u_map        != nullptr, "u_map is nullptr");
+    HARD_ASSERT(snapshot_out != nullptr, "snapshot_out is nullptr");
+
+    LOGGER_DEBUG("u_map_snapshot started");
+
+    if (u_map->cow == nullptr) {
+        hm_error_t err = u_map_raw_copy(snapshot_out, u_map);
+        RETURN_IF_ERROR(err);
+        snapshot_out->is_read_only = true;
+        return HM_ERR_OK;
+    }
+
+    u_map_cow_t* cow = u_map->cow;
+    u_map_cow_sweep(cow);
+
+    const size_t pages = cow->bytes >> cow->page_shift;
+    u_map_cow_view_t* view    = (u_map_cow_view_t*)calloc(1, sizeof(u_map_cow_view_t));
+    uint64_t*         saved   = (uint64_t*)calloc((pages + 63) / 64, sizeof(uint64_t));
+    void*             mapping = mmap(nullptr, cow->bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, cow->fd, 0);
+    if (view == nullptr || saved == nullptr || mapping == MAP_FAILED) {
+        if (mapping != MAP_FAILED) munmap(mapping, cow->bytes);
+        free(saved);
+        free(view);
+        return HM_ERR_MEM_ALLOC;
+    }
+    view->view  = (unsigned char*)mapping;
+    view->bytes = cow->bytes;
+    view->saved = saved;
+    view->state = COW_ATTACHED;
+
+    u_map_t snapshot = *u_map;
+    u_map_rebase(&snapshot, u_map, mapping);
+    snapshot.cow          = nullptr;
+    snapshot.cow_view     = view;
+    snapshot.is_read_only = true;
+
+    hm_error_t err = u_map_counters_create(&snapshot);
+    RETURN_IF_ERROR(err, u_map_cow_view_free(view));
+
+    view->next = cow->views;
+    cow->views = view;
+    *snapshot_out = snapshot;
+    return HM_ERR_OK;
+}
+
+// Таблица, открытая из файла только для чтения, отображена без права записи
+static hm_error_t u_map_check_writable(const u_map_t* u_map) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+
+    if (!u_map->is_read_only) return HM_ERR_OK;
+
+    LOGGER_ERROR("u_map is opened read-only");
+    return HM_ERR_READ_ONLY;
+}
+
+//================================================================================
+//                             Базовые функции
+//================================================================================
+
+bool u_map_is_empty(const u_map_t* u_map) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+    return u_map_size(u_map) == 0;
+}
+
+size_t u_map_size(const u_map_t* u_map) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+    return u_map->size + (u_map->old_table != nullptr ? u_map->old_table->size : 0);
+}
+
+size_t u_map_capacity(const u_map_t* u_map) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+    return u_map->capacity;
+}
+
+bool u_map_is_rehashing(const u_map_t* u_map) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+    return u_map->old_table != nullptr;
+}
+
+void u_map_set_rehash_step(u_map_t* u_map, size_t rehash_step) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+    if (u_map->is_static || u_map->data_index != nullptr || u_map->cow != nullptr) return;
+    u_map->rehash_step = rehash_step;
+}
+
+hm_error_t u_map_compact(u_map_t* u_map) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+
+    LOGGER_DEBUG("u_map_compact started");
+
+    RETURN_IF_ERROR(u_map_check_writable(u_map));
+
+    hm_error_t err = u_map_finish_rehash(u_map);
+    RETURN_IF_ERROR(err);
+
+    const uint64_t started = stat_clock();
+    u_map_compact_in_place(u_map);
+    stat_count(u_map, &u_map_counters_t::rehash_cleanup, 1);
+    stat_time(u_map, started);
+    return HM_ERR_OK;
+}
+
+void u_map_stats(const u_map_t* u_map, u_map_stats_t* stats_out) {
+    HARD_ASSERT(u_map     != nullptr, "u_map is nullptr");
+    HARD_ASSERT(stats_out != nullptr, "stats_out is nullptr");
+
+    memset(stats_out, 0, sizeof(*stats_out));
+
+    stats_out->size     = u_map_size(u_map);
+    stats_out->capacity = u_map->capacity;
+    for (const u_map_t* table = u_map; table != nullptr; table = table->old_table) {
+        stats_out->tombstones   += table->occupied - table->size;
+        stats_out->bytes_in_use += u_map_table_bytes(table);
+        if (table->key_arena != nullptr) stats_out->bytes_in_use += table->key_arena->bytes;
+    }
+    stats_out->flood_events = u_map->flood.events;
+    stats_out->reseeds      = u_map->flood.reseeds;
+    if (u_map->capacity != 0) {
+        stats_out->load_factor     = (double)stats_out->size       / (double)u_map->capacity;
+        stats_out->tombstone_ratio = (double)stats_out->tombstones / (double)u_map->capacity;
+    }
+
+    if (u_map->counters == nullptr) return;
+
+    // Поиск может идти параллельно (под разделяемой блокировкой) — читаем по словам атомарно
+    stats_out->has_counters = true;
+    const uint64_t* src = (const uint64_t*)(const void*)u_map->counters;
+    uint64_t*       dst = (uint64_t*)(void*)&stats_out->counters;
+    for (size_t i = 0; i < STAT_WORDS; ++i) {
+        dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+    }
+}
+
+void u_map_stats_reset(u_map_t* u_map) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+
+    if (u_map->counters == nullptr) return;
+
+    uint64_t* words = (uint64_t*)(void*)u_map->counters;
+    for (size_t i = 0; i < STAT_WORDS; ++i) {
+        __atomic_store_n(&words[i], 0, __ATOMIC_RELAXED);
+    }
+}
+
+hm_error_t u_map_finish_rehash(u_map_t* u_map) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+    return u_map_migrate(u_map, SIZE_MAX);
+}
+
+// Ищет ключ в текущей таблице, а во время инкрементального рехэша — и в старой
+static bool u_map_locate(const u_map_t* u_map, const void* key, size_t hash,
+                         const u_map_t** table_out, size_t* idx_out) {
+    HARD_ASSERT(u_map     != nullptr, "u_map is nullptr");
+    HARD_ASSERT(table_out != nullptr, "table_out is nullptr");
+
+    if (u_map_find_slot_hashed(u_map, key, hash, idx_out)) {
+        *table_out = u_map;
+        return true;
+    }
+    if (u_map->old_table != nullptr && u_map_find_slot_hashed(u_map->old_table, key, hash, idx_out)) {
+        *table_out = u_map->old_table;
+        return true;
+    }
+    return false;
+}
+
+static bool u_map_get_hashed(const u_map_t* u_map, const void* key, size_t hash, void* value_out) {
+    const u_map_t* table = nullptr;
+    size_t idx = 0;
+    if (!u_map_locate(u_map, key, hash, &table, &idx)) return false;
+
+    if (value_out != nullptr) {
+        memcpy(value_out, get_value(table, idx), u_map->value_size);
+    }
+    return true;
+}
+
+bool u_map_get_elem(const u_map_t* u_map, const void* key, void* value_out) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+    HARD_ASSERT(key   != nullptr, "key is nullptr");
+
+    if (u_map->capacity == 0) return false;
+
+    return u_map_get_hashed(u_map, key, u_map_hash_key(u_map, key), value_out);
+}
+
+bool u_map_get_elem_hashed(const u_map_t* u_map, const void* key, size_t raw_hash, void* value_out) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+    HARD_ASSERT(key   != nullptr, "key is nullptr");
+    HARD_ASSERT(u_map->key_arena == nullptr, "byte keys go through the *_bytes functions");
+
+    if (u_map->capacity == 0) return false;
+
+    return u_map_get_hashed(u_map, key, u_map_finish_hash(u_map, raw_hash), value_out);
+}
+
+// Находит ключ или занимает под него слот (ключ копируется, значение — нет), без нормализации
+// ёмкости. Слот может оказаться в старой таблице, если ключ еще не перенесен
+static hm_error_t u_map_emplace_hashed(u_map_t* u_map, const void* key, size_t hash,
+                                       u_map_t** table_out, size_t* idx_out, bool* is_new_out) {
+    HARD_ASSERT(u_map      != nullptr, "u_map is nullptr");
+    HARD_ASSERT(key        != nullptr, "key is nullptr");
+    HARD_ASSERT(table_out  != nullptr, "table_out is nullptr");
+    HARD_ASSERT(idx_out    != nullptr, "idx_out is nullptr");
+    HARD_ASSERT(is_new_out != nullptr, "is_new_out is nullptr");
+
+    size_t idx = 0;
+    size_t probes = 0;
+    bool is_new = false;
+
+    // Ключ, еще не перенесенный из старой таблицы, обновляется на месте
+    if (u_map->old_table != nullptr && u_map_find_slot_hashed(u_map->old_table, key, hash, &idx)) {
+        *table_out  = u_map->old_table;
+        *idx_out    = idx;
+        *is_new_out = false;
+        return HM_ERR_OK;
+    }
+
+    // Плотная раскладка: записи кончились раньше слотов — сначала выбрасываем удаленные
+    if (u_map->data_index != nullptr && u_map->entries_used == u_map->capacity) u_map_compact_in_place(u_map);
+
+    if (!u_map_find_insert_slot(u_map, key, hash, &idx, &is_new, &probes)) {
+        // Заполненная статическая таблица еще может освободить место, убрав надгробия
+        if (u_map->occupied == u_map->size) return HM_ERR_FULL;
+
+        u_map_compact_in_place(u_map);
+        if (!u_map_find_insert_slot(u_map, key, hash, &idx, &is_new, &probes)) {
+            return HM_ERR_FULL;
+        }
+    }
+
+    if (is_new) {
+        u_map_occupy_slot(u_map, idx, hash);
+        memcpy(get_key(u_map, idx), key, u_map->key_size);
+
+        const size_t flood_probes = u_map->probe == U_MAP_PROBE_ROBIN_HOOD ? FLOOD_PROBE_SLOTS : FLOOD_PROBE_GROUPS;
+        if (probes >= flood_probes) u_map_note_flood(u_map, probes);
+    } else {
+        // Значение существующего ключа перепишет вызывающий или пользователь по указателю
+        u_map_cow_save_slot(u_map, idx);
+    }
+
+    *table_out  = u_map;
+    *idx_out    = idx;
+    *is_new_out = is_new;
+    return HM_ERR_OK;
+}
+
+// Вставка/обновление по готовому хэшу, без нормализации ёмкости
+static hm_error_t u_map_put_hashed(u_map_t* u_map, const void* key, size_t hash, const void* value,
+                                   bool* is_new_out) {
+    HARD_ASSERT(value != nullptr, "value is nullptr");
+
+    u_map_t* table = nullptr;
+    size_t idx = 0;
+    hm_error_t err = u_map_emplace_hashed(u_map, key, hash, &table, &idx, is_new_out);
+    if (err != HM_ERR_OK) return err;
+
+    memcpy(get_value(table, idx), value, u_map->value_size);
+    return HM_ERR_OK;
+}
+
+hm_error_t u_map_insert_elem(u_map_t* u_map, const void* key, const void* value) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+    HARD_ASSERT(key   != nullptr, "key is nullptr");
+    HARD_ASSERT(u_map->key_arena == nullptr, "byte keys go through the *_bytes functions");
+
+    return u_map_insert_elem_hashed(u_map, key, u_map->hash_func(key), value);
+}
+
+// Соль хэша может смениться в normalize_capacity (смена соли после подбора коллизий),
+// поэтому хэш досаливается только после нее
+hm_error_t u_map_insert_elem_hashed(u_map_t* u_map, const void* key, size_t raw_hash, const void* value) {
+    HARD_ASSERT(u_map  != nullptr, "u_map is nullptr");
+    HARD_ASSERT(key    != nullptr, "key is nullptr");
+    HARD_ASSERT(value  != nullptr, "value is nullptr");
+    HARD_ASSERT(u_map->key_arena == nullptr, "byte keys go through the *_bytes functions");
 
     LOGGER_DEBUG("u_map_insert_elem started");
 
-    hm_error_t err = normalize_capacity(u_map);
+    RETURN_IF_ERROR(u_map_check_writable(u_map));
+
+    hm_error_t err = normalize_capacity(u_map, false);
+    RETURN_IF_ERROR(err);
+
+    bool is_new = false;
+    return u_map_put_hashed(u_map, key, u_map_finish_hash(u_map, raw_hash), value, &is_new);
+}
+
+void* u_map_get_ptr(const u_map_t* u_map, const void* key) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+    HARD_ASSERT(key   != nullptr, "key is nullptr");
+    HARD_ASSERT(u_map->key_arena == nullptr, "byte keys go through the *_bytes functions");
+
+    if (u_map->capacity == 0) return nullptr;
+
+    const u_map_t* table = nullptr;
+    size_t idx = 0;
+    if (!u_map_locate(u_map, key, u_map_hash_key(u_map, key), &table, &idx)) return nullptr;
+
+    u_map_cow_save_slot(table, idx);
+    return get_value(table, idx);
+}
+
+// Общая часть try_emplace и upsert: overwrite — писать ли value в уже существующий ключ
+static hm_error_t u_map_emplace_elem(u_map_t* u_map, const void* key, const void* value, bool overwrite,
+                                     void** value_ptr_out, bool* inserted_out) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+    HARD_ASSERT(key   != nullptr, "key is nullptr");
+    HARD_ASSERT(u_map->key_arena == nullptr, "byte keys go through the *_bytes functions");
+
+    RETURN_IF_ERROR(u_map_check_writable(u_map));
+
+    hm_error_t err = normalize_capacity(u_map, false);
+    RETURN_IF_ERROR(err);
+
+    u_map_t* table = nullptr;
+    size_t idx = 0;
+    bool is_new = false;
+    err = u_map_emplace_hashed(u_map, key, u_map_hash_key(u_map, key), &table, &idx, &is_new);
+    if (err != HM_ERR_OK) return err;
+
+    void* slot_value = get_value(table, idx);
+    if (is_new || overwrite) {
+        if (value != nullptr) memcpy(slot_value, value, u_map->value_size);
+        else                  memset(slot_value, 0,     u_map->value_size);
+    }
+
+    if (value_ptr_out != nullptr) *value_ptr_out = slot_value;
+    if (inserted_out  != nullptr) *inserted_out  = is_new;
+    return HM_ERR_OK;
+}
+
+hm_error_t u_map_try_emplace(u_map_t* u_map, const void* key, const void* value,
+                             void** value_ptr_out, bool* inserted_out) {
+    LOGGER_DEBUG("u_map_try_emplace started");
+    return u_map_emplace_elem(u_map, key, value, false, value_ptr_out, inserted_out);
+}
+
+hm_error_t u_map_upsert(u_map_t* u_map, const void* key, const void* value,
+                        void** value_ptr_out, bool* inserted_out) {
+    HARD_ASSERT(value != nullptr, "value is nullptr");
+
+    LOGGER_DEBUG("u_map_upsert started");
+    return u_map_emplace_elem(u_map, key, value, true, value_ptr_out, inserted_out);
+}
+
+static bool u_map_remove_hashed(u_map_t* u_map, const void* key, size_t hash, void* value_out) {
+    const u_map_t* found = nullptr;
+    size_t idx = 0;
+    if (!u_map_locate(u_map, key, hash, &found, &idx)) return false;
+
+    u_map_t* table = found == u_map ? u_map : u_map->old_table;
+    if (value_out != nullptr) {
+        memcpy(value_out, get_value(table, idx), u_map->value_size);
+    }
+
+    u_map_erase_slot(table, idx);
+    return true;
+}
+
+hm_error_t u_map_remove_elem(u_map_t* u_map, const void* key, void* value_out) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+    HARD_ASSERT(key   != nullptr, "key is nullptr");
+    HARD_ASSERT(u_map->key_arena == nullptr, "byte keys go through the *_bytes functions");
+
+    return u_map_remove_elem_hashed(u_map, key, u_map->hash_func(key), value_out);
+}
+
+hm_error_t u_map_remove_elem_hashed(u_map_t* u_map, const void* key, size_t raw_hash, void* value_out) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+    HARD_ASSERT(key   != nullptr, "key is nullptr");
+    HARD_ASSERT(u_map->key_arena == nullptr, "byte keys go through the *_bytes functions");
+
+    LOGGER_DEBUG("u_map_remove_elem started");
+
+    RETURN_IF_ERROR(u_map_check_writable(u_map));
+
+    hm_error_t err = normalize_capacity(u_map, true);
+    RETURN_IF_ERROR(err);
+
+    if (u_map->capacity == 0) return HM_ERR_NOT_FOUND;
+
+    const bool is_found = u_map_remove_hashed(u_map, key, u_map_finish_hash(u_map, raw_hash), value_out);
+    return is_found ? HM_ERR_OK : HM_ERR_NOT_FOUND;
+}
+
+//================================================================================
+//                              Продвинутые
+//================================================================================
+
+// Ёмкость (степень двойки), в которую count элементов влезают без роста
+static hm_error_t u_map_capacity_for(const u_map_t* u_map, size_t count, size_t* capacity_out) {
+    size_t need = (size_t)((double)count / u_map->load.max_load) + 1;
+    if (need < count) return HM_ERR_BAD_ARG;
+
+    need = next_pow2_size_t(need);
+    *capacity_out = need < INITIAL_CAPACITY ? INITIAL_CAPACITY : need;
+    return HM_ERR_OK;
+}
+
+hm_error_t u_map_reserve(u_map_t* u_map, size_t count) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+
+    LOGGER_DEBUG("u_map_reserve(%zu) started", count);
+
+    RETURN_IF_ERROR(u_map_check_writable(u_map));
+
+    size_t need = 0;
+    hm_error_t err = u_map_capacity_for(u_map, count, &need);
+    RETURN_IF_ERROR(err);
+
+    if (need <= u_map->capacity) return HM_ERR_OK;
+    if (u_map->is_static) return count <= u_map->capacity ? HM_ERR_OK : HM_ERR_FULL;
+
+    return u_map_rehash(u_map, need);
+}
+
+hm_error_t u_map_shrink_to_fit(u_map_t* u_map) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+
+    LOGGER_DEBUG("u_map_shrink_to_fit started");
+
+    if (u_map->capacity == 0) return HM_ERR_OK;
+    if (u_map->is_static)     return u_map_compact(u_map);
+
+    RETURN_IF_ERROR(u_map_check_writable(u_map));
+
+    size_t need = 0;
+    hm_error_t err = u_map_capacity_for(u_map, u_map_size(u_map), &need);
+    RETURN_IF_ERROR(err);
+
+    // Рехэш на той же ёмкости чистит надгробия; инкрементальный перенос дописывается сразу
+    err = u_map_rehash(u_map, need < u_map->capacity ? need : u_map->capacity);
+    RETURN_IF_ERROR(err);
+
+    return u_map_finish_rehash(u_map);
+}
+
+// Порядок вставки: устойчивая сортировка подсчетом по домашней позиции (старшие биты),
+// чтобы запись в таблицу шла по возрастанию адресов, а дубликаты сохраняли порядок входа
+static const size_t BULK_MIN_PAIRS      = 256;
+static const size_t BULK_MAX_PARTITIONS = 1u << 16;
+static const size_t BULK_PREFETCH_DISTANCE = 16;
+
+static hm_error_t u_map_bulk_build_sorted(u_map_t* u_map, const unsigned char* pairs, size_t pair_count,
+                                          size_t pair_stride, size_t value_off, size_t* duplicates_out) {
+    size_t positions = u_map->probe == U_MAP_PROBE_ROBIN_HOOD ? u_map->capacity
+                                                             : u_map_ctrl_bytes(u_map) / U_MAP_GROUP_WIDTH;
+    unsigned shift = 0;
+    while ((positions >> shift) > BULK_MAX_PARTITIONS) ++shift;
+    const size_t partitions = positions >> shift;
+
+    size_t* hashes = (size_t*)calloc(pair_count, sizeof(size_t));
+    size_t* order  = (size_t*)calloc(pair_count, sizeof(size_t));
+    size_t* counts = (size_t*)calloc(partitions + 1, sizeof(size_t));
+    if (!hashes || !order || !counts) {
+        free(hashes);
+        free(order);
+        free(counts);
+        return HM_ERR_MEM_ALLOC;
+    }
+
+    for (size_t i = 0; i < pair_count; ++i) {
+        hashes[i] = u_map_hash_key(u_map, pairs + i * pair_stride);
+        counts[(u_map_home_pos(u_map, hashes[i]) >> shift) + 1]++;
+    }
+    for (size_t p = 1; p <= partitions; ++p) counts[p] += counts[p - 1];
+    for (size_t i = 0; i < pair_count; ++i) {
+        order[counts[u_map_home_pos(u_map, hashes[i]) >> shift]++] = i;
+    }
+
+    hm_error_t err = HM_ERR_OK;
+    for (size_t n = 0; n < pair_count && err == HM_ERR_OK; ++n) {
+        // Пары читаются вразброс: подтягиваем их заранее
+        if (n + BULK_PREFETCH_DISTANCE < pair_count) {
+            __builtin_prefetch(pairs + order[n + BULK_PREFETCH_DISTANCE] * pair_stride);
+            __builtin_prefetch(hashes + order[n + BULK_PREFETCH_DISTANCE]);
+        }
+        const size_t i = order[n];
+        bool is_new = false;
+        err = u_map_put_hashed(u_map, pairs + i * pair_stride, hashes[i], pairs + i * pair_stride + value_off,
+                               &is_new);
+        if (!is_new) (*duplicates_out)++;
+    }
+
+    free(hashes);
+    free(order);
+    free(counts);
+    return err;
+}
+
+// Пары по частям на threads потоков, отложенные — в порядке частей, так что повторы ключа
+// по-прежнему обновляются в порядке входа
+static hm_error_t u_map_bulk_build_parallel(u_map_t* u_map, const unsigned char* pairs, size_t pair_count,
+                                            size_t pair_stride, size_t value_off, size_t* duplicates_out) {
+    par_fill_t fill;
+    memset(&fill, 0, sizeof(fill));
+    fill.target      = u_map;
+    fill.pairs       = pairs;
+    fill.pair_stride = pair_stride;
+    fill.value_off   = value_off;
+    fill.items       = pair_count;
+    fill.upsert      = true;
+
+    hm_error_t err = u_map_par_fill(&fill);
+    RETURN_IF_ERROR(err);
+
+    for (size_t p = 0; p < fill.parts && err == HM_ERR_OK; ++p) {
+        *duplicates_out += fill.part[p].duplicates;
+        for (size_t n = 0; n < fill.part[p].deferred && err == HM_ERR_OK; ++n) {
+            const size_t i = fill.order[fill.part[p].begin + n];
+            bool is_new = false;
+            err = u_map_put_hashed(u_map, pairs + i * pair_stride, fill.hashes[i], pairs + i * pair_stride + value_off,
+                                   &is_new);
+            if (err == HM_ERR_OK && !is_new) (*duplicates_out)++;
+        }
+    }
+
+    par_fill_free(&fill);
+    return err;
+}
+
+hm_error_t u_map_bulk_build(u_map_t* u_map, const void* arr, size_t pair_count, size_t* duplicates_out) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+    HARD_ASSERT(arr  != nullptr || pair_count == 0, "arr is nullptr");
+    HARD_ASSERT(u_map->key_arena == nullptr, "byte keys go through the *_bytes functions");
+
+    LOGGER_DEBUG("u_map_bulk_build(%zu) started", pair_count);
+
+    const unsigned char* ptr = (const unsigned char*)arr;
+
+    size_t key_part    = u_map->key_size;
+    size_t value_off   = round_up_to(key_part, u_map->value_align);
+    size_t pair_stride = value_off + u_map->value_size;
+
+    size_t duplicates = 0;
+    if (duplicates_out == nullptr) duplicates_out = &duplicates;
+    *duplicates_out = 0;
+
+    RETURN_IF_ERROR(u_map_check_writable(u_map));
+
+    hm_error_t err = u_map_finish_rehash(u_map);
     RETURN_IF_ERROR(err);
 
-    size_t idx = 0;
-    bool is_new = false;
-    if (!u_map_find_insert_slot(u_map, key, &idx, &is_new)) {
-        return HM_ERR_FULL;
+    // Таблица сразу получает итоговый размер: дальше вставки идут без нормализации
+    err = u_map_reserve(u_map, u_map_size(u_map) + pair_count);
+    if (err != HM_ERR_FULL) RETURN_IF_ERROR(err);
+    err = u_map_finish_rehash(u_map);
+    RETURN_IF_ERROR(err);
+
+    if (u_map_par_eligible(u_map, pair_count)) {
+        err = u_map_bulk_build_parallel(u_map, ptr, pair_count, pair_stride, value_off, duplicates_out);
+        if (err != HM_ERR_MEM_ALLOC) return err;
+        LOGGER_WARNING("No memory for parallel bulk build, building in one thread");
     }
 
-    if (!is_new) {
-        memcpy(get_value(u_map, idx), value, u_map->value_size);
-        return HM_ERR_OK;
+    // Плотной раскладке порядок записей важнее порядка слотов: вставка идет в порядке входа
+    if (!u_map->is_static && u_map->data_index == nullptr && pair_count >= BULK_MIN_PAIRS) {
+        err = u_map_bulk_build_sorted(u_map, ptr, pair_count, pair_stride, value_off, duplicates_out);
+        if (err != HM_ERR_MEM_ALLOC) return err;
+        LOGGER_WARNING("No memory for sorted bulk build, inserting in input order");
+    }
+
+    for (size_t i = 0; i < pair_count; ++i) {
+        const void* key   = (const void*)(ptr + i * pair_stride);
+        const void* value = (const void*)(ptr + i * pair_stride + value_off);
+
+        bool is_new = false;
+        err = u_map_put_hashed(u_map, key, u_map_hash_key(u_map, key), value, &is_new);
+        RETURN_IF_ERROR(err);
+        if (!is_new) (*duplicates_out)++;
+    }
+
+    return HM_ERR_OK;
+}
+
+hm_error_t read_arr_to_u_map(u_map_t* u_map, const void* arr, size_t pair_count) {
+    return u_map_bulk_build(u_map, arr, pair_count, nullptr);
+}
+
+//================================================================================
+//                              Пакетные операции
+//================================================================================
+
+// Конвейер пакета в две стадии. За BATCH_AHEAD ключей до поиска считается хэш и
+// подтягивается домашняя позиция; за BATCH_AHEAD / 2 — когда управляющие байты уже в кэше —
+// подтягиваются ключ и значение первого кандидата группы. К моменту поиска промахи кэша
+// разных ключей уже перекрылись, и цепочка зависимых загрузок не ждет память
+static const size_t BATCH_AHEAD = 16;
+
+typedef struct batch_pipe_t {
+    const unsigned char* keys;
+    size_t count;
+    size_t hashes[BATCH_AHEAD];
+} batch_pipe_t;
+
+static inline void u_map_prefetch_slot(const u_map_t* u_map, size_t idx) {
+    // Плотная раскладка: адрес записи станет известен только после загрузки номера
+    if (u_map->data_index != nullptr) {
+        __builtin_prefetch(u_map->data_index + idx);
+        return;
+    }
+    __builtin_prefetch((const unsigned char*)u_map->data_keys   + idx * u_map->key_stride);
+    __builtin_prefetch((const unsigned char*)u_map->data_values + idx * u_map->value_stride);
+    if (u_map->data_hashes != nullptr) __builtin_prefetch(u_map->data_hashes + idx);
+}
+
+// Первая стадия: в robin hood домашний слот известен точно, в swiss — только группа
+static inline void u_map_prefetch_home(const u_map_t* u_map, size_t hash) {
+    if (u_map->probe == U_MAP_PROBE_ROBIN_HOOD) {
+        const size_t home = rh_home(u_map, hash);
+        __builtin_prefetch(u_map->data_states + home);
+        u_map_prefetch_slot(u_map, home);
+        return;
+    }
+    __builtin_prefetch(u_map->data_states + probe_start(u_map, hash).group * U_MAP_GROUP_WIDTH);
+}
+
+// Вторая стадия (только swiss): слот первого совпавшего отпечатка в домашней группе
+static inline void u_map_prefetch_candidate(const u_map_t* u_map, size_t hash) {
+    if (u_map->probe == U_MAP_PROBE_ROBIN_HOOD) return;
+
+    const size_t base = probe_start(u_map, hash).group * U_MAP_GROUP_WIDTH;
+    const u_map_group_mask_t match = u_map_group_match(u_map->data_states + base, u_map_hash_h2(hash));
+    if (match != 0) u_map_prefetch_slot(u_map, base + u_map_mask_lowest_bit(match));
+}
+
+static inline void batch_pipe_feed(const u_map_t* u_map, batch_pipe_t* pipe, size_t n) {
+    const size_t hash = u_map_hash_key(u_map, pipe->keys + n * u_map->key_size);
+    pipe->hashes[n % BATCH_AHEAD] = hash;
+    u_map_prefetch_home(u_map, hash);
+}
+
+static void batch_pipe_start(const u_map_t* u_map, batch_pipe_t* pipe, const void* keys, size_t count) {
+    pipe->keys  = (const unsigned char*)keys;
+    pipe->count = count;
+    for (size_t n = 0; n < count && n < BATCH_AHEAD; ++n) {
+        batch_pipe_feed(u_map, pipe, n);
+    }
+    for (size_t n = 0; n < count && n < BATCH_AHEAD / 2; ++n) {
+        u_map_prefetch_candidate(u_map, pipe->hashes[n]);
+    }
+}
+
+// Хэш ключа n; конвейер сдвигается на один ключ
+static inline size_t batch_pipe_take(const u_map_t* u_map, batch_pipe_t* pipe, size_t n) {
+    const size_t hash = pipe->hashes[n % BATCH_AHEAD];
+    if (n + BATCH_AHEAD / 2 < pipe->count) {
+        u_map_prefetch_candidate(u_map, pipe->hashes[(n + BATCH_AHEAD / 2) % BATCH_AHEAD]);
+    }
+    if (n + BATCH_AHEAD < pipe->count) batch_pipe_feed(u_map, pipe, n + BATCH_AHEAD);
+    return hash;
+}
+
+size_t u_map_get_batch(const u_map_t* u_map, const void* keys, size_t count, void* values_out, bool* found_out) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+    HARD_ASSERT(keys  != nullptr || count == 0, "keys is nullptr");
+
+    if (u_map->capacity == 0) {
+        if (found_out != nullptr) memset(found_out, 0, count * sizeof(bool));
+        return 0;
     }
 
-    if (u_map->data_states[idx] == EMPTY) {
-        u_map->occupied++;
-        u_map->size++;
-    } else if (u_map->data_states[idx] == DELETED) {
-        u_map->size++;
+    unsigned char* values = (unsigned char*)values_out;
+    size_t found_count = 0;
+
+    batch_pipe_t pipe = {};
+    batch_pipe_start(u_map, &pipe, keys, count);
+
+    for (size_t n = 0; n < count; ++n) {
+        const size_t hash = batch_pipe_take(u_map, &pipe, n);
+        void* value_out = values != nullptr ? values + n * u_map->value_size : nullptr;
+
+        const bool is_found = u_map_get_hashed(u_map, pipe.keys + n * u_map->key_size, hash, value_out);
+        if (found_out != nullptr) found_out[n] = is_found;
+        found_count += is_found;
     }
 
-    u_map->data_states[idx] = USED;
-    memcpy(get_key  (u_map, idx), key,   u_map->key_size);
-    memcpy(get_value(u_map, idx), value, u_map->value_size);
+    return found_count;
+}
+
+hm_error_t u_map_insert_batch(u_map_t* u_map, const void* keys, const void* values, size_t count) {
+    HARD_ASSERT(u_map  != nullptr, "u_map is nullptr");
+    HARD_ASSERT(keys   != nullptr || count == 0, "keys is nullptr");
+    HARD_ASSERT(values != nullptr || count == 0, "values is nullptr");
+    HARD_ASSERT(u_map->key_arena == nullptr, "byte keys go through the *_bytes functions");
+
+    LOGGER_DEBUG("u_map_insert_batch(%zu) started", count);
+
+    RETURN_IF_ERROR(u_map_check_writable(u_map));
+
+    // Размер подбирается один раз на весь пакет
+    hm_error_t err = normalize_capacity(u_map, false);
+    RETURN_IF_ERROR(err);
+    err = u_map_reserve(u_map, u_map_size(u_map) + count);
+    if (err != HM_ERR_FULL) RETURN_IF_ERROR(err);
+
+    const unsigned char* value_bytes = (const unsigned char*)values;
+
+    batch_pipe_t pipe = {};
+    batch_pipe_start(u_map, &pipe, keys, count);
+
+    for (size_t n = 0; n < count; ++n) {
+        const size_t hash = batch_pipe_take(u_map, &pipe, n);
+        bool is_new = false;
+        err = u_map_put_hashed(u_map, pipe.keys + n * u_map->key_size, hash,
+                               value_bytes + n * u_map->value_size, &is_new);
+        RETURN_IF_ERROR(err);
+    }
 
     return HM_ERR_OK;
 }
 
-hm_error_t u_map_remove_elem(u_map_t* u_map, const void* key, void* value_out) {
+size_t u_map_remove_batch(u_map_t* u_map, const void* keys, size_t count, void* values_out, bool* found_out) {
     HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
-    HARD_ASSERT(key   != nullptr, "key is nullptr");
+    HARD_ASSERT(keys  != nullptr || count == 0, "keys is nullptr");
+    HARD_ASSERT(u_map->key_arena == nullptr, "byte keys go through the *_bytes functions");
 
-    LOGGER_DEBUG("u_map_remove_elem started");
+    LOGGER_DEBUG("u_map_remove_batch(%zu) started", count);
+
+    if (u_map_check_writable(u_map) != HM_ERR_OK) {
+        if (found_out != nullptr) memset(found_out, 0, count * sizeof(bool));
+        return 0;
+    }
+
+    // Ошибка нормализации не мешает удалению: таблица остается прежней
+    hm_error_t err = normalize_capacity(u_map, true);
+    if (err != HM_ERR_OK) {
+        LOGGER_WARNING("normalize_capacity failed before batch remove: %d", err);
+    }
+
+    if (u_map->capacity == 0) {
+        if (found_out != nullptr) memset(found_out, 0, count * sizeof(bool));
+        return 0;
+    }
+
+    unsigned char* values = (unsigned char*)values_out;
+    size_t removed = 0;
+
+    batch_pipe_t pipe = {};
+    batch_pipe_start(u_map, &pipe, keys, count);
+
+    for (size_t n = 0; n < count; ++n) {
+        const size_t hash = batch_pipe_take(u_map, &pipe, n);
+        void* value_out = values != nullptr ? values + n * u_map->value_size : nullptr;
+
+        const bool is_found = u_map_remove_hashed(u_map, pipe.keys + n * u_map->key_size, hash, value_out);
+        if (found_out != nullptr) found_out[n] = is_found;
+        removed += is_found;
+    }
+
+    return removed;
+}
+
+//================================================================================
+//                         Ключи переменной длины
+//================================================================================
+
+hm_error_t u_map_init_bytes(u_map_t* u_map, size_t capacity,
+                            size_t value_size, size_t value_align,
+                            const u_map_opts_t* opts) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
 
-    hm_error_t err = normalize_capacity(u_map);
+    u_map_opts_t used_opts = opts ? *opts : u_map_default_opts();
+    used_opts.bytes_keys = true;
+
+    // Размер ключа, хэш и сравнение подставит u_map_init_with_allocator
+    return u_map_init_ex(u_map, capacity, U_MAP_BYTES_KEY_SIZE, alignof(bytes_key_t), value_size, value_align,
+                         bytes_key_hash, bytes_key_eq, &used_opts);
+}
+
+bool u_map_get_bytes(const u_map_t* u_map, const void* key, size_t len, void* value_out) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+    HARD_ASSERT(key   != nullptr || len == 0, "key is nullptr");
+    HARD_ASSERT(u_map->key_arena != nullptr || u_map->capacity == 0, "u_map is not created by u_map_init_bytes");
+
+    if (u_map->capacity == 0 || len > UINT32_MAX) return false;
+
+    // Запись для поиска ссылается прямо на байты пользователя
+    bytes_key_t rec = {};
+    const size_t hash = bytes_key_init(u_map, &rec, key, len, key);
+    return u_map_get_hashed(u_map, &rec, hash, value_out);
+}
+
+hm_error_t u_map_insert_bytes(u_map_t* u_map, const void* key, size_t len, const void* value) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+    HARD_ASSERT(key   != nullptr || len == 0, "key is nullptr");
+    HARD_ASSERT(value != nullptr, "value is nullptr");
+    HARD_ASSERT(u_map->key_arena != nullptr, "u_map is not created by u_map_init_bytes");
+
+    LOGGER_DEBUG("u_map_insert_bytes(%zu bytes) started", len);
+
+    RETURN_IF_ERROR(u_map_check_writable(u_map));
+    if (len > UINT32_MAX) {
+        LOGGER_ERROR("byte key of %zu bytes is too long", len);
+        return HM_ERR_BAD_ARG;
+    }
+
+    hm_error_t err = normalize_capacity(u_map, false);
     RETURN_IF_ERROR(err);
 
-    size_t idx = 0;
-    if (!u_map_find_slot(u_map, key, &idx)) {
-        return HM_ERR_NOT_FOUND;
+    // Длинный ключ копируется в арену заранее; если он уже был в таблице, копия откатывается
+    const bool is_long = len > U_MAP_BYTES_INLINE_MAX;
+    const void* stored = key;
+    if (is_long) {
+        unsigned char* copy = u_map_key_arena_alloc(u_map, len);
+        if (copy == nullptr) return HM_ERR_MEM_ALLOC;
+        memcpy(copy, key, len);
+        stored = copy;
+    }
+
+    bytes_key_t rec = {};
+    const size_t hash = bytes_key_init(u_map, &rec, key, len, stored);
+
+    bool is_new = false;
+    err = u_map_put_hashed(u_map, &rec, hash, value, &is_new);
+    if (is_long) {
+        if (err == HM_ERR_OK && is_new) u_map->key_arena->live += len;
+        else                            u_map_key_arena_pop(u_map, len);
     }
+    return err;
+}
+
+hm_error_t u_map_remove_bytes(u_map_t* u_map, const void* key, size_t len, void* value_out) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+    HARD_ASSERT(key   != nullptr || len == 0, "key is nullptr");
+    HARD_ASSERT(u_map->key_arena != nullptr || u_map->capacity == 0, "u_map is not created by u_map_init_bytes");
+
+    LOGGER_DEBUG("u_map_remove_bytes(%zu bytes) started", len);
+
+    RETURN_IF_ERROR(u_map_check_writable(u_map));
 
+    hm_error_t err = normalize_capacity(u_map, true);
+    RETURN_IF_ERROR(err);
+
+    if (u_map->capacity == 0 || len > UINT32_MAX) return HM_ERR_NOT_FOUND;
+
+    bytes_key_t rec = {};
+    const size_t hash = bytes_key_init(u_map, &rec, key, len, key);
+
+    const u_map_t* found = nullptr;
+    size_t idx = 0;
+    if (!u_map_locate(u_map, &rec, hash, &found, &idx)) return HM_ERR_NOT_FOUND;
+
+    u_map_t* table = found == u_map ? u_map : u_map->old_table;
     if (value_out != nullptr) {
-        memcpy(value_out, get_value(u_map, idx), u_map->value_size);
+        memcpy(value_out, get_value(table, idx), u_map->value_size);
     }
 
-    u_map->data_states[idx] = DELETED;
-    u_map->size--;
+    // Байты длинного ключа остаются в арене до рехэша
+    if (len > U_MAP_BYTES_INLINE_MAX) {
+        table->key_arena->live -= len;
+        table->key_arena->dead += len;
+    }
+    u_map_erase_slot(table, idx);
+    return HM_ERR_OK;
+}
+
+void u_map_bytes_key_view(const void* stored_key, const void** data_out, size_t* len_out) {
+    HARD_ASSERT(stored_key != nullptr, "stored_key is nullptr");
+    HARD_ASSERT(data_out   != nullptr, "data_out is nullptr");
+    HARD_ASSERT(len_out    != nullptr, "len_out is nullptr");
+
+    const unsigned char* data = nullptr;
+    bytes_key_view(stored_key, &data, len_out);
+    *data_out = data;
+}
+
+//================================================================================
+//                                 Обход
+//================================================================================
+
+// Первая живая позиция таблицы, начиная с *pos: запись (плотная раскладка) или занятый слот
+static bool u_map_iter_seek(const u_map_t* table, size_t* pos) {
+    if (table->data_index != nullptr) {
+        for (size_t e = *pos; e < table->entries_used; ++e) {
+            if (!table->data_alive[e]) continue;
+            *pos = e;
+            return true;
+        }
+        return false;
+    }
+
+    // Управляющие байты — группами; хвост маленькой таблицы заполнен SENTINEL и не совпадает
+    size_t base = *pos - *pos % U_MAP_GROUP_WIDTH;
+    u_map_group_mask_t full = u_map_group_match_full(table->data_states + base) &
+                              ~(((u_map_group_mask_t)1 << (*pos - base)) - 1);
+    while (full == 0) {
+        base += U_MAP_GROUP_WIDTH;
+        if (base >= table->capacity) return false;
+        full = u_map_group_match_full(table->data_states + base);
+    }
+    *pos = base + u_map_mask_lowest_bit(full);
+    return true;
+}
+
+void u_map_iter_init(const u_map_t* u_map, u_map_iter_t* iter) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+    HARD_ASSERT(iter  != nullptr, "iter is nullptr");
+
+    iter->u_map = u_map;
+    iter->table = u_map;
+    iter->pos   = 0;
+    iter->key   = nullptr;
+    iter->value = nullptr;
+}
+
+bool u_map_iter_next(u_map_iter_t* iter) {
+    HARD_ASSERT(iter != nullptr, "iter is nullptr");
+
+    while (iter->table != nullptr) {
+        const u_map_t* table = iter->table;
+        size_t pos = iter->pos;
+
+        if (table->capacity != 0 && pos < table->capacity && u_map_iter_seek(table, &pos)) {
+            // В плотной раскладке pos — уже номер записи
+            iter->key   = table->data_index != nullptr ? entry_key  (table, pos) : get_key  (table, pos);
+            iter->value = table->data_index != nullptr ? entry_value(table, pos) : get_value(table, pos);
+            iter->pos   = pos + 1;
+            return true;
+        }
+
+        iter->table = table == iter->u_map ? iter->u_map->old_table : nullptr;
+        iter->pos   = 0;
+    }
+
+    iter->key   = nullptr;
+    iter->value = nullptr;
+    return false;
+}
+
+// Позиций обхода: записей в плотной раскладке, иначе слотов
+static size_t u_map_scan_positions(const u_map_t* table) {
+    return table->data_index != nullptr ? table->entries_used : table->capacity;
+}
+
+// Живые элементы позиций [begin, end), begin кратно U_MAP_GROUP_WIDTH. Пустые и удаленные слоты
+// отбрасываются маской группы, удаленные записи — словом из восьми флагов data_alive.
+// visit вернул false — выставляет *stop; другие потоки видят его между группами
+static size_t u_map_scan_range(const u_map_t* table, size_t begin, size_t end, u_map_visit_t visit, void* ctx,
+                               bool* stop) {
+    size_t visited = 0;
+
+    if (table->data_index != nullptr) {
+        for (size_t e = begin; e < end; ++e) {
+            if (e % sizeof(uint64_t) == 0) {
+                if (__atomic_load_n(stop, __ATOMIC_RELAXED)) return visited;
+
+                uint64_t alive = 1;   // неполное слово в конце проверяется по байту
+                if (e + sizeof(alive) <= end) memcpy(&alive, table->data_alive + e, sizeof(alive));
+                if (alive == 0) {
+                    e += sizeof(alive) - 1;
+                    continue;
+                }
+            }
+            if (!table->data_alive[e]) continue;
+
+            visited++;
+            if (!visit(entry_key(table, e), entry_value(table, e), ctx)) {
+                __atomic_store_n(stop, true, __ATOMIC_RELAXED);
+                return visited;
+            }
+        }
+        return visited;
+    }
+
+    // Маска группы разбирается целиком, без повторного поиска, как в итераторе
+    for (size_t base = begin; base < end; base += U_MAP_GROUP_WIDTH) {
+        if (__atomic_load_n(stop, __ATOMIC_RELAXED)) return visited;
+
+        for (u_map_group_mask_t full = u_map_group_match_full(table->data_states + base); full != 0;
+             full &= full - 1) {
+            const size_t idx = base + u_map_mask_lowest_bit(full);
+            visited++;
+            if (!visit(entry_key(table, idx), entry_value(table, idx), ctx)) {
+                __atomic_store_n(stop, true, __ATOMIC_RELAXED);
+                return visited;
+            }
+        }
+    }
+    return visited;
+}
+
+size_t u_map_for_each(const u_map_t* u_map, u_map_visit_t visit, void* ctx) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+    HARD_ASSERT(visit != nullptr, "visit is nullptr");
+
+    size_t visited = 0;
+    bool stop = false;
+    for (const u_map_t* table = u_map; table != nullptr && !stop; table = table->old_table) {
+        if (table->capacity == 0) continue;
+        visited += u_map_scan_range(table, 0, u_map_scan_positions(table), visit, ctx, &stop);
+    }
+    return visited;
+}
+
+static_assert(U_MAP_SCAN_CHUNK % U_MAP_CACHE_LINE == 0 && U_MAP_SCAN_CHUNK % U_MAP_GROUP_WIDTH == 0,
+              "scan chunks must not share cache lines or groups");
+
+// Куски сначала идут по самой таблице, затем по old_table
+typedef struct par_scan_t {
+    const u_map_t* tables[2];
+    size_t         old_first;    // номер первого куска old_table
+    size_t         chunks;
+    u_map_visit_t  visit;
+    u_map_fold_t   fold;         // != nullptr — свертка, иначе обход visit
+    void*          ctx;
+    unsigned char* accs;         // аккумуляторы кусков через acc_stride
+    size_t         acc_stride;
+    size_t         visited;
+    bool           stop;
+} par_scan_t;
+
+typedef struct par_fold_t {
+    u_map_fold_t fold;
+    void*        acc;
+    void*        ctx;
+} par_fold_t;
+
+static bool par_fold_visit(const void* key, const void* value, void* ctx) {
+    par_fold_t* fold = (par_fold_t*)ctx;
+    fold->fold(fold->acc, key, value, fold->ctx);
+    return true;
+}
+
+static size_t u_map_scan_chunks(const u_map_t* table) {
+    if (table == nullptr || table->capacity == 0) return 0;
+    return (u_map_scan_positions(table) + U_MAP_SCAN_CHUNK - 1) / U_MAP_SCAN_CHUNK;
+}
+
+static void par_scan_init(par_scan_t* scan, const u_map_t* u_map) {
+    memset(scan, 0, sizeof(*scan));
+    scan->tables[0] = u_map;
+    scan->tables[1] = u_map->old_table;
+    scan->old_first = u_map_scan_chunks(u_map);
+    scan->chunks    = scan->old_first + u_map_scan_chunks(u_map->old_table);
+}
+
+static void par_scan_task(void* task_ctx, size_t chunk) {
+    par_scan_t*    scan   = (par_scan_t*)task_ctx;
+    const bool     is_old = chunk >= scan->old_first;
+    const u_map_t* table  = scan->tables[is_old ? 1 : 0];
+
+    const size_t positions = u_map_scan_positions(table);
+    const size_t begin     = (is_old ? chunk - scan->old_first : chunk) * U_MAP_SCAN_CHUNK;
+    const size_t end       = begin + U_MAP_SCAN_CHUNK < positions ? begin + U_MAP_SCAN_CHUNK : positions;
+
+    if (scan->fold != nullptr) {
+        par_fold_t fold = {scan->fold, scan->accs + chunk * scan->acc_stride, scan->ctx};
+        u_map_scan_range(table, begin, end, par_fold_visit, &fold, &scan->stop);
+        return;
+    }
+
+    const size_t visited = u_map_scan_range(table, begin, end, scan->visit, scan->ctx, &scan->stop);
+    __atomic_fetch_add(&scan->visited, visited, __ATOMIC_RELAXED);
+}
+
+size_t u_map_parallel_for_each(const u_map_t* u_map, u_map_visit_t visit, void* ctx) {
+    HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
+    HARD_ASSERT(visit != nullptr, "visit is nullptr");
+
+    par_scan_t scan;
+    par_scan_init(&scan, u_map);
+    if (scan.chunks == 0) return 0;
+
+    scan.visit = visit;
+    scan.ctx   = ctx;
+    u_map_par_run(u_map, par_scan_task, &scan, scan.chunks);
+    return scan.visited;
+}
+
+hm_error_t u_map_parallel_reduce(const u_map_t* u_map, void* acc, size_t acc_size,
+                                 u_map_fold_t fold, u_map_combine_t combine, void* ctx) {
+    HARD_ASSERT(u_map    != nullptr, "u_map is nullptr");
+    HARD_ASSERT(acc      != nullptr, "acc is nullptr");
+    HARD_ASSERT(acc_size != 0,       "acc_size is 0");
+    HARD_ASSERT(fold     != nullptr, "fold is nullptr");
+    HARD_ASSERT(combine  != nullptr, "combine is nullptr");
+
+    par_scan_t scan;
+    par_scan_init(&scan, u_map);
+    if (scan.chunks == 0) return HM_ERR_OK;
+
+    // Свой аккумулятор на кэш-линию: соседние куски не пишут в одну линию
+    scan.fold       = fold;
+    scan.ctx        = ctx;
+    scan.acc_stride = round_up_to(acc_size, U_MAP_CACHE_LINE);
+    scan.accs       = (unsigned char*)aligned_alloc(U_MAP_CACHE_LINE, scan.chunks * scan.acc_stride);
+    if (scan.accs == nullptr) return HM_ERR_MEM_ALLOC;
+
+    for (size_t c = 0; c < scan.chunks; ++c) memcpy(scan.accs + c * scan.acc_stride, acc, acc_size);
 
+    u_map_par_run(u_map, par_scan_task, &scan, scan.chunks);
+
+    memcpy(acc, scan.accs, acc_size);
+    for (size_t c = 1; c < scan.chunks; ++c) combine(acc, scan.accs + c * scan.acc_stride, ctx);
+
+    free(scan.accs);
     return HM_ERR_OK;
 }
 
 //================================================================================
-//                              Продвинутые
+//                           Снимки в файл
 //================================================================================
 
-hm_error_t read_arr_to_u_map(u_map_t* u_map, const void* arr, size_t pair_count) {
+static const char   U_MAP_FILE_MAGIC[8]     = {'U', 'M', 'A', 'P', 'S', 'N', 'A', 'P'};
+static const size_t U_MAP_FILE_HEADER_BYTES = 4096;      // буфер начинается с новой страницы
+static const uint32_t U_MAP_FILE_ENDIAN     = 0x01020304;
+static const uint64_t CHECKSUM_MUL          = 0xff51afd7ed558ccdULL;
+
+typedef struct u_map_file_header_t {
+    char     magic[8];
+    uint32_t version;
+    uint32_t endian;
+    uint32_t size_t_bytes;
+    uint32_t probe;
+    uint64_t store_hashes;
+    uint64_t dense;
+    uint64_t strong_hash;
+    uint64_t seed;
+
+    double   max_load;         // пороги уже с подставленными значениями по умолчанию
+    double   shrink_load;
+    double   garbage_load;
+    uint64_t no_auto_shrink;
+
+    uint64_t capacity;
+    uint64_t size;
+    uint64_t occupied;
+    uint64_t entries_used;
+
+    uint64_t key_size;
+    uint64_t key_align;
+    uint64_t value_size;
+    uint64_t value_align;
+
+    uint64_t data_bytes;
+    uint64_t data_checksum;
+    uint64_t header_checksum;  // по всем полям выше
+} u_map_file_header_t;
+
+static_assert(sizeof(u_map_file_header_t) <= 4096, "header must fit its page");
+
+// Четыре независимые дорожки по 8 байт: сумма гигабайтного буфера упирается в память, а не в умножения
+static uint64_t u_map_checksum(const void* data, size_t bytes) {
+    const unsigned char* ptr = (const unsigned char*)data;
+
+    uint64_t lanes[4] = {U_MAP_GOLD_64, U_MAP_BIG_RANDOM_EVEN_NUM_1, U_MAP_BIG_RANDOM_EVEN_NUM_2, CHECKSUM_MUL};
+    size_t i = 0;
+    for (; i + sizeof(lanes) <= bytes; i += sizeof(lanes)) {
+        for (size_t lane = 0; lane < 4; ++lane) {
+            uint64_t word = 0;
+            memcpy(&word, ptr + i + lane * sizeof(uint64_t), sizeof(word));
+            lanes[lane] = (lanes[lane] ^ word) * CHECKSUM_MUL;
+            lanes[lane] ^= lanes[lane] >> 29;
+        }
+    }
+
+    uint64_t hash = bytes;
+    for (size_t lane = 0; lane < 4; ++lane) hash = u_map_mix_hash((size_t)(hash ^ lanes[lane]));
+    for (; i < bytes; ++i) hash = (hash ^ ptr[i]) * CHECKSUM_MUL;
+    return u_map_mix_hash((size_t)hash);
+}
+
+static bool is_pow2(uint64_t x) {
+    return x != 0 && (x & (x - 1)) == 0;
+}
+
+static hm_error_t u_map_file_check_header(const u_map_file_header_t* header, size_t file_bytes) {
+    HARD_ASSERT(header != nullptr, "header is nullptr");
+
+    if (memcmp(header->magic, U_MAP_FILE_MAGIC, sizeof(U_MAP_FILE_MAGIC)) != 0) {
+        LOGGER_ERROR("not a u_map snapshot");
+        return HM_ERR_BAD_ARG;
+    }
+    if (header->version != U_MAP_FILE_VERSION) {
+        LOGGER_ERROR("snapshot version %u, expected %d", header->version, U_MAP_FILE_VERSION);
+        return HM_ERR_BAD_ARG;
+    }
+    if (header->endian != U_MAP_FILE_ENDIAN || header->size_t_bytes != sizeof(size_t)) {
+        LOGGER_ERROR("snapshot was written on another platform");
+        return HM_ERR_BAD_ARG;
+    }
+    if (header->header_checksum != u_map_checksum(header, offsetof(u_map_file_header_t, header_checksum))) {
+        LOGGER_ERROR("snapshot header is corrupted");
+        return HM_ERR_BAD_ARG;
+    }
+
+    // Дальше поля защищены суммой, проверяется только то, на что опирается раскладка
+    const bool is_sane = (header->probe == U_MAP_PROBE_SWISS || header->probe == U_MAP_PROBE_ROBIN_HOOD) &&
+                         is_pow2(header->capacity) && header->capacity <= file_bytes &&
+                         header->key_size   > 0 && is_pow2(header->key_align)   &&
+                         header->value_size > 0 && is_pow2(header->value_align) &&
+                         header->key_align   <= U_MAP_FILE_HEADER_BYTES &&
+                         header->value_align <= U_MAP_FILE_HEADER_BYTES &&
+                         header->size <= header->occupied && header->occupied <= header->capacity &&
+                         (header->dense ? header->size <= header->entries_used &&
+                                          header->entries_used <= header->capacity &&
+                                          header->capacity <= (uint64_t)UINT32_MAX + 1
+                                        : header->entries_used == 0);
+    if (!is_sane) {
+        LOGGER_ERROR("snapshot header has impossible parameters");
+        return HM_ERR_BAD_ARG;
+    }
+
+    const u_map_layout_t layout = u_map_calc_layout((size_t)header->capacity,
+                                                    (size_t)header->key_size,   (size_t)header->key_align,
+                                                    (size_t)header->value_size, (size_t)header->value_align,
+                                                    header->store_hashes != 0, header->dense != 0);
+    if (layout.total_bytes != header->data_bytes || file_bytes != U_MAP_FILE_HEADER_BYTES + header->data_bytes) {
+        LOGGER_ERROR("snapshot size does not match its header");
+        return HM_ERR_BAD_ARG;
+    }
+    return HM_ERR_OK;
+}
+
+static bool u_map_file_write(FILE* file, const unsigned char* page, const void* data, size_t data_bytes) {
+    if (fwrite(page, U_MAP_FILE_HEADER_BYTES, 1, file) != 1) return false;
+    if (data_bytes != 0 && fwrite(data, data_bytes, 1, file) != 1) return false;
+    return fflush(file) == 0 && fsync(fileno(file)) == 0;
+}
+
+hm_error_t u_map_save(const u_map_t* u_map, const char* path) {
     HARD_ASSERT(u_map != nullptr, "u_map is nullptr");
-    HARD_ASSERT(arr  != nullptr || pair_count == 0, "arr is nullptr");
+    HARD_ASSERT(path  != nullptr, "path is nullptr");
 
-    const unsigned char* ptr = (const unsigned char*)arr;
+    LOGGER_DEBUG("u_map_save(%s) started", path);
 
-    size_t key_part    = u_map->key_size;
-    size_t value_off   = round_up_to(key_part, u_map->value_align);
-    size_t pair_stride = value_off + u_map->value_size;
+    if (u_map->data == nullptr) return HM_ERR_BAD_ARG;
+    if (u_map->key_arena != nullptr) {
+        LOGGER_ERROR("u_map_save does not support byte keys: they point into process memory");
+        return HM_ERR_BAD_ARG;
+    }
+    if (u_map->old_table != nullptr) {
+        LOGGER_ERROR("u_map_save during incremental rehash, call u_map_finish_rehash first");
+        return HM_ERR_BAD_ARG;
+    }
 
-    for (size_t i = 0; i < pair_count; ++i) {
-        const void* key   = (const void*)(ptr + i * pair_stride);
-        const void* value = (const void*)(ptr + i * pair_stride + value_off);
+    const u_map_opts_t opts = u_map_opts_of(u_map);
+    const size_t data_bytes = u_map_required_bytes_ex(u_map->capacity, u_map->key_size, u_map->key_align,
+                                                      u_map->value_size, u_map->value_align, &opts);
+
+    u_map_file_header_t header = {};
+    memcpy(header.magic, U_MAP_FILE_MAGIC, sizeof(U_MAP_FILE_MAGIC));
+    header.version       = U_MAP_FILE_VERSION;
+    header.endian        = U_MAP_FILE_ENDIAN;
+    header.size_t_bytes  = sizeof(size_t);
+    header.probe         = (uint32_t)u_map->probe;
+    header.store_hashes  = opts.store_hashes;
+    header.dense         = opts.dense;
+    header.strong_hash   = opts.strong_hash;
+    header.seed          = opts.seed;
+    header.max_load       = opts.load.max_load;
+    header.shrink_load    = opts.load.shrink_load;
+    header.garbage_load   = opts.load.garbage_load;
+    header.no_auto_shrink = opts.load.no_auto_shrink;
+    header.capacity      = u_map->capacity;
+    header.size          = u_map->size;
+    header.occupied      = u_map->occupied;
+    header.entries_used  = u_map->entries_used;
+    header.key_size      = u_map->key_size;
+    header.key_align     = u_map->key_align;
+    header.value_size    = u_map->value_size;
+    header.value_align   = u_map->value_align;
+    header.data_bytes    = data_bytes;
+    header.data_checksum = u_map_checksum(u_map->data, data_bytes);
+    header.header_checksum = u_map_checksum(&header, offsetof(u_map_file_header_t, header_checksum));
+
+    unsigned char page[U_MAP_FILE_HEADER_BYTES] = {};
+    memcpy(page, &header, sizeof(header));
+
+    // Пишется во временный файл и переименовывается: старый снимок не портится на полпути
+    const size_t path_len = strlen(path);
+    char* tmp_path = (char*)malloc(path_len + sizeof(".tmp"));
+    if (tmp_path == nullptr) return HM_ERR_MEM_ALLOC;
+    memcpy(tmp_path, path, path_len);
+    memcpy(tmp_path + path_len, ".tmp", sizeof(".tmp"));
+
+    FILE* file = fopen(tmp_path, "wb");
+    bool is_written = file != nullptr && u_map_file_write(file, page, u_map->data, data_bytes);
+    if (file != nullptr && fclose(file) != 0) is_written = false;
+    if (is_written && rename(tmp_path, path) != 0) is_written = false;
+
+    if (!is_written) {
+        LOGGER_ERROR("cannot write snapshot %s", path);
+        remove(tmp_path);
+    }
+    free(tmp_path);
+    return is_written ? HM_ERR_OK : HM_ERR_IO;
+}
 
-        hm_error_t err = u_map_insert_elem(u_map, key, value);
-        RETURN_IF_ERROR(err);
+hm_error_t u_map_open_mmap(u_map_t* u_map, const char* path,
+                           key_func_t hash_func, key_cmp_t key_cmp, unsigned flags) {
+    HARD_ASSERT(u_map     != nullptr, "u_map is nullptr");
+    HARD_ASSERT(path      != nullptr, "path is nullptr");
+    HARD_ASSERT(hash_func != nullptr, "hash_func is nullptr");
+    HARD_ASSERT(key_cmp   != nullptr, "key_cmp is nullptr");
+
+    LOGGER_DEBUG("u_map_open_mmap(%s) started", path);
+
+    memset(u_map, 0, sizeof(*u_map));
+
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        LOGGER_ERROR("cannot open snapshot %s", path);
+        return HM_ERR_IO;
+    }
+
+    struct stat st = {};
+    u_map_file_header_t header = {};
+    if (fstat(fd, &st) != 0 || pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+        close(fd);
+        return HM_ERR_IO;
+    }
+    const size_t file_bytes = (size_t)st.st_size;
+    RETURN_IF_ERROR(u_map_file_check_header(&header, file_bytes), close(fd));
+
+    // MAP_PRIVATE в обоих режимах: записи writable-таблицы остаются в памяти процесса
+    const bool is_writable = (flags & U_MAP_OPEN_WRITABLE) != 0;
+    const int  prot        = is_writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    const int  map_flags   = MAP_PRIVATE | ((flags & U_MAP_OPEN_POPULATE) ? MAP_POPULATE : 0);
+    void* mapping = mmap(nullptr, file_bytes, prot, map_flags, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        LOGGER_ERROR("cannot map snapshot %s", path);
+        return HM_ERR_MEM_ALLOC;
+    }
+
+    unsigned char* data = (unsigned char*)mapping + U_MAP_FILE_HEADER_BYTES;
+    if ((flags & U_MAP_OPEN_VERIFY) && u_map_checksum(data, (size_t)header.data_bytes) != header.data_checksum) {
+        LOGGER_ERROR("snapshot %s is corrupted", path);
+        munmap(mapping, file_bytes);
+        return HM_ERR_BAD_ARG;
+    }
+
+    u_map_opts_t opts = u_map_default_opts();
+    opts.probe        = (u_map_probe_t)header.probe;
+    opts.store_hashes = header.store_hashes != 0;
+    opts.dense        = header.dense != 0;
+    opts.strong_hash  = header.strong_hash != 0;
+    opts.seed         = header.seed;
+    opts.load.max_load       = header.max_load;
+    opts.load.shrink_load    = header.shrink_load;
+    opts.load.garbage_load   = header.garbage_load;
+    opts.load.no_auto_shrink = header.no_auto_shrink != 0;
+    RETURN_IF_ERROR(u_map_check_load_policy(&opts.load), munmap(mapping, file_bytes));
+
+    const u_map_layout_t    layout    = u_map_calc_layout((size_t)header.capacity,
+                                                          (size_t)header.key_size,   (size_t)header.key_align,
+                                                          (size_t)header.value_size, (size_t)header.value_align,
+                                                          opts.store_hashes, opts.dense);
+    const u_map_allocator_t allocator = u_map_default_allocator();
+    u_map_setup(u_map, data, (size_t)header.capacity, &layout,
+                (size_t)header.key_size,   (size_t)header.key_align,
+                (size_t)header.value_size, (size_t)header.value_align,
+                hash_func, key_cmp, &opts, &allocator, false);
+
+    u_map->size          = (size_t)header.size;
+    u_map->occupied      = (size_t)header.occupied;
+    u_map->entries_used  = (size_t)header.entries_used;
+    u_map->mapping       = mapping;
+    u_map->mapping_bytes = file_bytes;
+    u_map->is_read_only  = !is_writable;
+
+    // Раскладка слотов сохранена хэшами той машины, что писала файл. Другой hash_func (или
+    // u_map_hash_bytes с AES-NI на одной машине и без него на другой) не найдет ни одного ключа:
+    // проверяем на первом же
+    u_map_iter_t iter = {};
+    u_map_iter_init(u_map, &iter);
+    if (u_map_iter_next(&iter)) {
+        const u_map_t* table = nullptr;
+        size_t idx = 0;
+        if (!u_map_locate(u_map, iter.key, u_map_hash_key(u_map, iter.key), &table, &idx)) {
+            LOGGER_ERROR("snapshot %s was saved with a different hash_func", path);
+            munmap(mapping, file_bytes);
+            memset(u_map, 0, sizeof(*u_map));
+            return HM_ERR_BAD_ARG;
+        }
     }
 
+    RETURN_IF_ERROR(u_map_counters_create(u_map), munmap(mapping, file_bytes), memset(u_map, 0, sizeof(*u_map)));
     return HM_ERR_OK;
 }